@@ -0,0 +1,185 @@
+#include "AugmentStream.h"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+template <typename T>
+AugmentStream<T>::AugmentStream(const std::vector<std::vector<T>>& images, const std::vector<int>& labels, const AugmentConfig& config)
+    : images_t(images), labels_t(labels), config_t(config)
+{
+    if (images.size() != labels.size()) {
+        throw std::runtime_error("Mismatch in images and labels sizes.");
+    }
+    if (images.empty() || config.batchSize == 0) {
+        throw std::runtime_error("AugmentStream needs images and a non-zero batch size.");
+    }
+    if (images[0].size() != 28 * 28) {
+        throw std::runtime_error("AugmentStream works on 28x28 images.");
+    }
+
+    passes_t = config.copies + (config.includeOriginal ? 1 : 0);
+    epochSize_t = images.size() * passes_t;
+    if (passes_t == 0 || epochSize_t > UINT32_MAX) {
+        throw std::runtime_error("Invalid number of augmented copies.");
+    }
+    batchesPerEpoch_t = (epochSize_t + config.batchSize - 1) / config.batchSize;
+
+    // Producers never get more than one epoch ahead, so two sample orders suffice
+    std::size_t capacity = std::clamp<std::size_t>(config.capacity, 1, batchesPerEpoch_t);
+    slots_t.resize(capacity);
+    for (Slot& slot : slots_t) {
+        slot.batch.imageSize = images[0].size();
+        slot.batch.images.resize(config.batchSize * slot.batch.imageSize);
+        slot.batch.labels.resize(config.batchSize);
+        slot.sources.resize(config.batchSize);
+        slot.transforms.resize(config.batchSize);
+    }
+
+    // Starting mid-epoch: no producer claims that epoch's first batch, so shuffle it here
+    claimed_t = consumed_t = released_t = config.firstBatch;
+    if (config.firstBatch % batchesPerEpoch_t != 0) {
+        shuffleEpoch(config.firstBatch / batchesPerEpoch_t);
+    }
+
+    for (std::size_t i = 0; i < std::max<std::size_t>(1, config.producers); ++i) {
+        producers_t.emplace_back(&AugmentStream::producerLoop, this);
+    }
+}
+
+template <typename T>
+AugmentStream<T>::~AugmentStream()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_t);
+        stop_t = true;
+    }
+    free_t.notify_all();
+    for (auto& producer : producers_t) {
+        producer.join();
+    }
+}
+
+template <typename T>
+const typename AugmentStream<T>::Batch& AugmentStream<T>::next()
+{
+    std::unique_lock<std::mutex> lock(mutex_t);
+
+    // The batch handed out last time is done with
+    if (released_t < consumed_t) {
+        released_t = consumed_t;
+        free_t.notify_all();
+    }
+
+    Slot& slot = slots_t[consumed_t % slots_t.size()];
+    ready_t.wait(lock, [&] { return error_t || (slot.ready && slot.seq == consumed_t); });
+    if (error_t) {
+        std::rethrow_exception(error_t);
+    }
+    slot.ready = false;
+    ++consumed_t;
+    return slot.batch;
+}
+
+template <typename T>
+void AugmentStream<T>::producerLoop()
+{
+    for (;;) {
+        std::uint64_t seq;
+        {
+            std::unique_lock<std::mutex> lock(mutex_t);
+            free_t.wait(lock, [&] { return stop_t || claimed_t < released_t + slots_t.size(); });
+            if (stop_t) {
+                return;
+            }
+            seq = claimed_t++;
+            // Later batches of the epoch are claimed after this, so they see the new order
+            if (seq % batchesPerEpoch_t == 0) {
+                shuffleEpoch(seq / batchesPerEpoch_t);
+            }
+        }
+
+        Slot& slot = slots_t[seq % slots_t.size()];
+        try {
+            fill(slot, seq);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_t);
+            if (!error_t) {
+                error_t = std::current_exception();
+            }
+            stop_t = true;
+            ready_t.notify_all();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_t);
+            slot.seq = seq;
+            slot.ready = true;
+        }
+        ready_t.notify_all();
+    }
+}
+
+template <typename T>
+void AugmentStream<T>::shuffleEpoch(std::uint64_t epoch)
+{
+    // Epoch - 2, which used the same buffer, has been fully consumed by now
+    std::vector<std::uint32_t>& order = orders_t[epoch % 2];
+    order.resize(epochSize_t);
+    for (std::size_t i = 0; i < epochSize_t; ++i) {
+        order[i] = static_cast<std::uint32_t>(i);
+    }
+    std::seed_seq seeds{ config_t.seed, static_cast<unsigned int>(epoch) };
+    std::mt19937 rng(seeds);
+    std::shuffle(order.begin(), order.end(), rng);
+}
+
+template <typename T>
+void AugmentStream<T>::fill(Slot& slot, std::uint64_t seq) const
+{
+    const auto started = std::chrono::steady_clock::now();
+    const std::uint64_t epoch = seq / batchesPerEpoch_t;
+    const std::size_t start = (seq % batchesPerEpoch_t) * config_t.batchSize;
+    const std::vector<std::uint32_t>& order = orders_t[epoch % 2];
+    const std::size_t numImages = images_t.size();
+    Batch& batch = slot.batch;
+
+    std::seed_seq seeds{ config_t.seed, static_cast<unsigned int>(seq), static_cast<unsigned int>(seq >> 32), 0xA5u };
+    std::mt19937 rng(seeds);
+    std::uniform_real_distribution<double> angleDist(-config_t.maxAngle, config_t.maxAngle);
+    std::uniform_real_distribution<double> scaleDist(config_t.minScale, config_t.maxScale);
+    std::uniform_int_distribution<int> shiftDist(-config_t.maxShift, config_t.maxShift);
+    const utils::Affine identity{ 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f };
+
+    // Draw every sample's transform (the original pass keeps the image as it is),
+    // then warp the whole batch in one go
+    batch.count = std::min(config_t.batchSize, epochSize_t - start);
+    for (std::size_t b = 0; b < batch.count; ++b) {
+        const std::size_t v = order[start + b];
+        const std::size_t index = v % numImages;
+        if (images_t[index].size() != batch.imageSize) {
+            throw std::runtime_error("All training images must have the same size.");
+        }
+        slot.sources[b] = images_t[index].data();
+        batch.labels[b] = labels_t[index];
+
+        if (config_t.includeOriginal && v < numImages) {
+            slot.transforms[b] = identity;
+        }
+        else {
+            double angle = angleDist(rng);
+            double scale = scaleDist(rng);
+            int shiftX = shiftDist(rng);
+            int shiftY = shiftDist(rng);
+            slot.transforms[b] = utils::augmentTransform(angle, scale, shiftX, shiftY);
+        }
+    }
+    utils::warpImages(slot.sources.data(), slot.transforms.data(), batch.count, 28, 28,
+        batch.images.data(), config_t.sampling);
+    batch.augmentTime = std::chrono::steady_clock::now() - started;
+}
+
+template class AugmentStream<float>;
+template class AugmentStream<double>;
@@ -0,0 +1,124 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "math.h"
+#include "utils.h"
+
+struct AugmentConfig
+{
+    std::size_t batchSize = 32;
+
+    // Every epoch visits each training image once unchanged (if includeOriginal)
+    // and `copies` more times, each with a freshly drawn random transform
+    std::size_t copies = 10;
+    bool includeOriginal = true;
+
+    // Transform ranges (uniform): rotation in degrees, scale factor, shift in pixels
+    double maxAngle = 15.0;
+    double minScale = 0.7;
+    double maxScale = 1.3;
+    int maxShift = 3;
+    utils::Sampling sampling = utils::Sampling::Nearest;
+
+    // Background threads generating batches, and how many batches they may run
+    // ahead of the trainer (clamped to one epoch)
+    std::size_t producers = 2;
+    std::size_t capacity = 8;
+
+    // Shuffling and transforms are derived from the seed and the batch number only,
+    // so the stream is the same whatever the number of producers
+    unsigned int seed = 5489u;
+
+    // Number of the first batch next() returns: a stream started at batch k continues
+    // exactly like one that has already handed out k batches (used to resume training)
+    std::uint64_t firstBatch = 0;
+};
+
+/*
+
+ Endless stream of shuffled, augmented mini-batches over a training set.
+ Producer threads fill a fixed ring of `capacity` batches while the trainer
+ consumes them in order, so memory stays constant and augmentation overlaps
+ with training. The training images must outlive the stream.
+
+*/
+template <typename T>
+class AugmentStream
+{
+public:
+    struct Batch {
+        std::size_t count = 0;
+        std::size_t imageSize = 0;
+        math::AlignedVector<T> images; // [count][imageSize]
+        std::vector<int> labels;
+        std::chrono::steady_clock::duration augmentTime{}; // spent building the batch
+
+        const T* image(std::size_t i) const { return images.data() + i * imageSize; }
+    };
+
+    AugmentStream(const std::vector<std::vector<T>>& images,
+        const std::vector<int>& labels,
+        const AugmentConfig& config);
+    ~AugmentStream();
+
+    AugmentStream(const AugmentStream&) = delete;
+    AugmentStream& operator=(const AugmentStream&) = delete;
+
+    std::size_t batchSize() const { return config_t.batchSize; }
+    std::size_t epochSize() const { return epochSize_t; }
+    std::size_t batchesPerEpoch() const { return batchesPerEpoch_t; }
+    const AugmentConfig& config() const { return config_t; }
+
+    /*
+
+    Next batch in training order; blocks while the producers are behind.
+    The batch stays valid until the following call. Batches never straddle an
+    epoch boundary, so the last one of every epoch may be smaller.
+    Rethrows the first error a producer ran into.
+
+    */
+    const Batch& next();
+
+private:
+    struct Slot {
+        Batch batch;
+        std::vector<const T*> sources;       // image each sample is warped from
+        std::vector<utils::Affine> transforms;
+        std::uint64_t seq = 0;
+        bool ready = false;
+    };
+
+    void producerLoop();
+    void shuffleEpoch(std::uint64_t epoch);
+    void fill(Slot& slot, std::uint64_t seq) const;
+
+    const std::vector<std::vector<T>>& images_t;
+    const std::vector<int>& labels_t;
+    AugmentConfig config_t;
+    std::size_t passes_t;
+    std::size_t epochSize_t;
+    std::size_t batchesPerEpoch_t;
+
+    // Sample order of the (at most two) epochs in flight, indexed by epoch % 2.
+    // Entry v stands for image v % N in pass v / N.
+    std::vector<std::uint32_t> orders_t[2];
+
+    std::vector<Slot> slots_t; // batch seq lives in slots_t[seq % size]
+
+    std::mutex mutex_t;
+    std::condition_variable free_t;  // a slot was released
+    std::condition_variable ready_t; // a batch was published
+    std::uint64_t claimed_t = 0;     // next batch number a producer will take
+    std::uint64_t consumed_t = 0;    // next batch number next() returns
+    std::uint64_t released_t = 0;    // every batch below this may be overwritten
+    std::exception_ptr error_t;
+    bool stop_t = false;
+
+    std::vector<std::thread> producers_t;
+};
@@ -0,0 +1,553 @@
+/*
+
+ Headless microbenchmarks of the math and model hot paths (built by CMake as dnl_bench).
+
+   dnl_bench [--filter <text>] [--min-time <seconds>] [--out <file>]
+
+ Every case is timed over enough iterations to run for --min-time, five times;
+ the fastest repetition is reported. Results are printed as a table and written
+ as JSON lines to --out (default bench_results.jsonl): a "meta" record describing
+ the machine and build, then one "result" record per case with stable names, so
+ two files can be diffed or joined on `name` + `args`.
+
+ GFLOP/s counts a multiply-add as two operations; softmax counts four per element
+ (max, exp, sum, scale). bytes/op is the data a single call has to touch at least.
+
+*/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Canvas.h"
+#include "DataReader.h"
+#include "math.h"
+#include "Model.h"
+#include "Network.h"
+#include "SparseModel.h"
+#include "ThreadPool.h"
+#include "utils.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::string filter;
+        double minTime = 0.2;
+        std::string outFile = "bench_results.jsonl";
+    };
+
+    struct Result {
+        std::string name;   // e.g. "matVec/float"
+        std::string args;   // e.g. "128x784"
+        std::uint64_t iterations;
+        double nsPerOp;
+        double flopsPerOp;
+        double bytesPerOp;
+    };
+
+    // Keeps the optimizer from dropping benchmarked work whose result is unused
+    volatile double g_sink = 0.0;
+
+    template <typename T>
+    void consume(const T* p) {
+        g_sink = g_sink + static_cast<double>(p[0]);
+    }
+
+    template <typename T> const char* typeName();
+    template <> const char* typeName<float>() { return "float"; }
+    template <> const char* typeName<double>() { return "double"; }
+
+    std::string shape(std::size_t a, std::size_t b) {
+        return std::to_string(a) + "x" + std::to_string(b);
+    }
+
+    class Runner {
+    public:
+        explicit Runner(const Options& options) : options_t(options) {}
+
+        bool wants(const std::string& name) const {
+            return options_t.filter.empty() || name.find(options_t.filter) != std::string::npos;
+        }
+
+        /*
+
+        Time op() and record the case. op runs once to warm up, then the iteration
+        count is doubled until one batch takes a tenth of the time budget.
+
+        */
+        void run(const std::string& name, const std::string& args, double flopsPerOp, double bytesPerOp,
+            const std::function<void()>& op)
+        {
+            if (!wants(name)) {
+                return;
+            }
+            op();
+
+            const double target = options_t.minTime / 10.0;
+            std::uint64_t iterations = 1;
+            for (;;) {
+                double t = timeBatch(op, iterations);
+                if (t >= target || iterations >= (1ull << 40)) {
+                    // Aim for `target` seconds per repetition
+                    if (t > 0.0) {
+                        iterations = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(iterations * target / t));
+                    }
+                    break;
+                }
+                iterations *= 2;
+            }
+
+            double best = 1e300;
+            for (int rep = 0; rep < 5; ++rep) {
+                best = std::min(best, timeBatch(op, iterations));
+            }
+
+            Result r{ name, args, iterations, best * 1e9 / iterations, flopsPerOp, bytesPerOp };
+            print(r);
+            results_t.push_back(r);
+        }
+
+        const std::vector<Result>& results() const { return results_t; }
+
+    private:
+        static double timeBatch(const std::function<void()>& op, std::uint64_t iterations) {
+            auto start = Clock::now();
+            for (std::uint64_t i = 0; i < iterations; ++i) {
+                op();
+            }
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        static void print(const Result& r) {
+            std::cout << std::left << std::setw(28) << r.name << std::setw(14) << r.args << std::right
+                << std::fixed << std::setprecision(1) << std::setw(14) << r.nsPerOp << " ns/op"
+                << std::setprecision(2) << std::setw(10) << (r.flopsPerOp > 0 ? r.flopsPerOp / r.nsPerOp : 0.0) << " GFLOP/s"
+                << std::setprecision(0) << std::setw(12) << r.bytesPerOp << " B/op"
+                << std::setprecision(2) << std::setw(9) << (r.bytesPerOp / r.nsPerOp) << " GB/s"
+                << std::endl;
+        }
+
+        Options options_t;
+        std::vector<Result> results_t;
+    };
+
+    template <typename T>
+    std::vector<T> randomVector(std::size_t n, std::mt19937& rng, double lo = -1.0, double hi = 1.0) {
+        std::uniform_real_distribution<double> dist(lo, hi);
+        std::vector<T> v(n);
+        for (auto& x : v) {
+            x = static_cast<T>(dist(rng));
+        }
+        return v;
+    }
+
+    // Images with MNIST-like sparsity: mostly background, some strokes
+    template <typename T>
+    std::vector<std::vector<T>> randomImages(std::size_t count, std::mt19937& rng) {
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        std::vector<std::vector<T>> images(count, std::vector<T>(28 * 28));
+        for (auto& image : images) {
+            for (auto& p : image) {
+                double u = dist(rng);
+                p = static_cast<T>(u < 0.8 ? 0.0 : u);
+            }
+        }
+        return images;
+    }
+
+    template <typename T>
+    void benchMath(Runner& bench, std::mt19937& rng) {
+        const std::string type = typeName<T>();
+
+        // Single matrix-vector products: the two MNIST layers and a few square sizes
+        const std::size_t matVecShapes[][2] = { { 128, 784 }, { 10, 128 }, { 256, 256 }, { 1024, 1024 } };
+        for (const auto& s : matVecShapes) {
+            const std::size_t rows = s[0], cols = s[1], stride = math::alignedStride<T>(cols);
+            math::AlignedVector<T> M(rows * stride);
+            std::vector<T> random = randomVector<T>(rows * stride, rng);
+            std::copy(random.begin(), random.end(), M.begin());
+            std::vector<T> x = randomVector<T>(cols, rng), y(rows);
+            math::MatrixView<const T> view{ M.data(), rows, cols, stride };
+            bench.run("matVec/" + type, shape(rows, cols), 2.0 * rows * cols,
+                double(rows * cols + cols + rows) * sizeof(T),
+                [&] { math::matVecMultiply(view, x.data(), y.data()); consume(y.data()); });
+        }
+
+        // First layer on one image as the model runs it: the W1^T rows of the nonzero pixels
+        {
+            const std::size_t in = 784, hid = 128, stride = math::alignedStride<T>(hid);
+            math::AlignedVector<T> M(in * stride);
+            std::vector<T> random = randomVector<T>(in * stride, rng);
+            std::copy(random.begin(), random.end(), M.begin());
+            std::vector<T> image = randomImages<T>(1, rng)[0], y(hid);
+            math::SparseVector<T> x;
+            math::sparsify(image.data(), in, x);
+            const double nnz = static_cast<double>(x.nonzeros());
+            math::MatrixView<const T> view{ M.data(), in, hid, stride };
+            bench.run("sparseVecMat/" + type, shape(in, hid), 2.0 * nnz * hid,
+                (nnz * hid + in + hid) * sizeof(T),
+                [&] { math::sparsify(image.data(), in, x); math::sparseVecMat(x, view, y.data()); consume(y.data()); });
+        }
+
+        // Batched first layer (batch x 784) * W1^T, as run by predictBatch and training
+        for (std::size_t batch : { 1, 8, 32, 128 }) {
+            const std::size_t K = 784, N = 128;
+            const std::size_t lda = math::alignedStride<T>(K), ldb = math::alignedStride<T>(N), ldc = ldb;
+            math::AlignedVector<T> A(batch * lda), B(K * ldb), C(batch * ldc);
+            std::vector<T> ra = randomVector<T>(A.size(), rng), rb = randomVector<T>(B.size(), rng);
+            std::copy(ra.begin(), ra.end(), A.begin());
+            std::copy(rb.begin(), rb.end(), B.begin());
+            bench.run("gemm/" + type, shape(batch, N) + "x" + std::to_string(K), 2.0 * batch * N * K,
+                double(batch * K + N * K + batch * N) * sizeof(T),
+                [&] {
+                    math::gemm(false, false, batch, N, K, T(1), A.data(), lda, B.data(), ldb, T(0), C.data(), ldc);
+                    consume(C.data());
+                });
+        }
+
+        for (std::size_t n : { 10, 100, 1000 }) {
+            std::vector<T> logits = randomVector<T>(n, rng, -5.0, 5.0);
+            bench.run("softmax/" + type, std::to_string(n), 4.0 * n, 2.0 * n * sizeof(T),
+                [&] { auto p = math::softmax(logits); consume(p.data()); });
+        }
+    }
+
+    void benchInt8(Runner& bench, std::mt19937& rng) {
+        const std::size_t matVecShapes[][2] = { { 128, 784 }, { 10, 128 }, { 1024, 1024 } };
+        std::uniform_int_distribution<int> dist(-127, 127);
+        for (const auto& s : matVecShapes) {
+            const std::size_t rows = s[0], cols = s[1], stride = math::alignedStride<std::int8_t>(cols);
+            math::AlignedVector<std::int8_t> M(rows * stride);
+            std::vector<std::int8_t> x(cols);
+            std::vector<std::int32_t> y(rows);
+            for (auto& v : M) v = static_cast<std::int8_t>(dist(rng));
+            for (auto& v : x) v = static_cast<std::int8_t>(dist(rng));
+            math::MatrixView<const std::int8_t> view{ M.data(), rows, cols, stride };
+            bench.run("matVec/int8", shape(rows, cols), 2.0 * rows * cols, double(rows * cols + cols + 4 * rows),
+                [&] { math::matVecMultiply(view, x.data(), y.data()); consume(y.data()); });
+        }
+    }
+
+    template <typename T>
+    void benchModel(Runner& bench, std::mt19937& rng) {
+        const std::string type = typeName<T>();
+        const std::size_t in = 784, hid = 128, out = 10;
+        const std::string args = std::to_string(in) + "-" + std::to_string(hid) + "-" + std::to_string(out);
+        const double forwardFlops = 2.0 * (in * hid + hid * out);
+        const double weightBytes = double(in * hid + hid + hid * out + out) * sizeof(T);
+
+        // A tiny learning rate keeps the repeated updates from drifting the weights far
+        BasicModel<T> model(in, hid, out, 1e-6);
+        auto images = randomImages<T>(1024, rng);
+
+        // FLOPs and bytes are counted as dense; the first layer skips the zero pixels
+        bench.run("forward/" + type, args, forwardFlops, weightBytes + in * sizeof(T),
+            [&] { auto p = model.forward(images[0]); consume(p.data()); });
+
+        // backprop after one forward: dZ1 = W2^T dZ2, then rank-1 updates of W2 and W1
+        auto output = model.forward(images[0]);
+        std::vector<T> target(out, T(0));
+        target[3] = T(1);
+        bench.run("backprop/" + type, args, 2.0 * (2 * hid * out + in * hid), 2.0 * weightBytes,
+            [&] { model.backprop(images[0], output, target); });
+
+        bench.run("predict/" + type, args, forwardFlops, weightBytes + in * sizeof(T),
+            [&] { g_sink = g_sink + model.predict(images[0]); });
+
+        // predictBatch: ns/op and bytes/op are per batch
+        ThreadPool pool;
+        for (std::size_t batch : { 1, 16, 64, 256, 1024 }) {
+            std::span<const std::vector<T>> inputs(images.data(), batch);
+            bench.run("predictBatch/" + type, args + "/b" + std::to_string(batch), forwardFlops * batch,
+                weightBytes + double(batch * in) * sizeof(T),
+                [&] { auto labels = model.predictBatch(inputs, pool); g_sink = g_sink + labels[0]; });
+        }
+    }
+
+    // W1 pruned to 90% zeros (W2 to 50%) and packed block-sparse, against predict/float above.
+    // FLOPs are counted as dense; bytes/op is the packed model.
+    void benchSparse(Runner& bench, std::mt19937& rng) {
+        const std::size_t in = 784, hid = 128, out = 10;
+        auto images = randomImages<float>(1, rng);
+        for (std::size_t rows : { 1, 16 }) {
+            FloatModel model(in, hid, out, 0.01);
+            PruneConfig config;
+            config.sparsity1 = 0.9;
+            config.sparsity2 = 0.5;
+            config.blockRows = rows;
+            model.prune(config);
+            SparseModel sparse = SparseModel::fromModel(model, rows, 1);
+            bench.run("sparsePredict/float", "90%/" + shape(rows, 1), 2.0 * (in * hid + hid * out),
+                double(sparse.bytes() + in * sizeof(float)),
+                [&] { g_sink = g_sink + sparse.predict(images[0]); });
+        }
+    }
+
+    // Multiply-adds of one forward pass of a network on a square single-channel input
+    double networkMultiplyAdds(std::size_t inputSize, const std::vector<LayerSpec>& layers) {
+        std::size_t h = static_cast<std::size_t>(std::lround(std::sqrt(double(inputSize)))), w = h, c = 1;
+        double madds = 0.0;
+        for (const LayerSpec& layer : layers) {
+            switch (layer.type) {
+            case LayerType::Dense:
+                madds += double(h * w * c) * layer.units;
+                h = w = 1;
+                c = layer.units;
+                break;
+            case LayerType::Conv2D:
+                h = h + 2 * layer.pad - layer.kernel + 1;
+                w = w + 2 * layer.pad - layer.kernel + 1;
+                madds += double(layer.units) * layer.kernel * layer.kernel * c * h * w;
+                c = layer.units;
+                break;
+            case LayerType::MaxPool:
+                h /= layer.kernel;
+                w /= layer.kernel;
+                break;
+            default:
+                break;
+            }
+        }
+        return madds;
+    }
+
+    // Layer-stack networks: a small conv net against the dense MLP topology. ns/op and
+    // bytes/op of trainBatch are per batch; a training step counts as three forward passes.
+    template <typename T>
+    void benchNetwork(Runner& bench, std::mt19937& rng) {
+        const std::string type = typeName<T>();
+        auto images = randomImages<T>(64, rng);
+        std::vector<const T*> inputs;
+        std::vector<int> labels;
+        for (std::size_t i = 0; i < images.size(); ++i) {
+            inputs.push_back(images[i].data());
+            labels.push_back(static_cast<int>(i % 10));
+        }
+
+        for (const char* spec : { "conv8k5,relu,pool2,conv16k5,relu,pool2,10,softmax", "128,relu,10,softmax" }) {
+            BasicNetwork<T> network(784, parseLayers(spec), 1e-6);
+            const double weightBytes = double(network.paramCount()) * sizeof(T);
+            const double forwardFlops = 2.0 * networkMultiplyAdds(784, parseLayers(spec));
+
+            bench.run("network/forward/" + type, spec, forwardFlops, weightBytes + 784 * sizeof(T),
+                [&] { consume(network.forward(inputs.data(), 1)); });
+            for (std::size_t batch : { 1, 32 }) {
+                bench.run("network/trainBatch/" + type, std::string(spec) + "/b" + std::to_string(batch), 3.0 * forwardFlops * batch,
+                    2.0 * weightBytes + double(batch * 784) * sizeof(T),
+                    [&] { g_sink = g_sink + network.trainBatch(inputs.data(), labels.data(), batch); });
+            }
+        }
+    }
+
+    template <typename T>
+    void benchAugment(Runner& bench, std::mt19937& rng) {
+        const std::string type = typeName<T>();
+        const double imageBytes = 2.0 * 28 * 28 * sizeof(T);
+        auto images = randomImages<T>(256, rng);
+
+        bench.run("augmentImage/" + type, "28x28", 0.0, imageBytes,
+            [&] { auto a = utils::augmentImage(images[0], 12.0, 1.1, 2, -1); consume(a.data()); });
+
+        // warpImages: ns/op and bytes/op are per batch
+        std::vector<const T*> sources(images.size());
+        std::vector<utils::Affine> transforms(images.size());
+        for (std::size_t i = 0; i < images.size(); ++i) {
+            sources[i] = images[i].data();
+            transforms[i] = utils::augmentTransform(-10.0 + 0.1 * i, 0.9 + 0.001 * i, int(i % 7) - 3, int(i % 5) - 2);
+        }
+        math::AlignedVector<T> warped(images.size() * 28 * 28);
+        for (utils::Sampling sampling : { utils::Sampling::Nearest, utils::Sampling::Bilinear }) {
+            const std::string mode = sampling == utils::Sampling::Nearest ? "nearest" : "bilinear";
+            for (std::size_t batch : { 1, 32, 256 }) {
+                bench.run("warpImages/" + type, mode + "/b" + std::to_string(batch), 0.0, imageBytes * batch,
+                    [&] {
+                        utils::warpImages(sources.data(), transforms.data(), batch, 28, 28, warped.data(), sampling);
+                        consume(warped.data());
+                    });
+            }
+        }
+    }
+
+    // The GUI's prediction input: a digit-sized stroke on the 280x280 canvas, captured as 28x28
+    void benchCanvas(Runner& bench) {
+        Canvas canvas(280, 280);
+        auto strokeDigit = [&] {
+            for (int t = 0; t <= 200; ++t) {
+                const double a = t * 0.0314;
+                canvas.stamp(140.0f + 50.0f * float(std::cos(a)), 140.0f + 90.0f * float(std::sin(a)), 4.8f);
+            }
+        };
+        strokeDigit();
+
+        std::vector<double> out(28 * 28);
+        bench.run("canvas/capture", "280x280", 0.0, 0.0,
+            [&] { canvas.capture(out.data()); consume(out.data()); });
+        bench.run("canvas/stroke", "200 stamps", 0.0, 0.0,
+            [&] { canvas.clear(); strokeDigit(); consume(canvas.pixels()); });
+    }
+
+    void writeBigEndian(std::ofstream& ofs, std::uint32_t v) {
+        const char bytes[4] = { char(v >> 24), char(v >> 16), char(v >> 8), char(v) };
+        ofs.write(bytes, 4);
+    }
+
+    // Reading a full MNIST-sized set (60000 images) from synthetic IDX files in the temp directory
+    template <typename T>
+    void benchReader(Runner& bench, std::mt19937& rng) {
+        const std::string name = std::string("readMNIST/") + typeName<T>();
+        if (!bench.wants(name)) {
+            return;
+        }
+        const std::uint32_t count = 60000, rows = 28, cols = 28;
+        const auto dir = std::filesystem::temp_directory_path();
+        const std::string imagesPath = (dir / "dnl_bench-images-idx3-ubyte").string();
+        const std::string labelsPath = (dir / "dnl_bench-labels-idx1-ubyte").string();
+        {
+            std::vector<char> pixels(std::size_t(count) * rows * cols);
+            std::uniform_int_distribution<int> dist(0, 255);
+            for (auto& p : pixels) p = char(dist(rng));
+            std::ofstream images(imagesPath, std::ios::binary);
+            writeBigEndian(images, 2051);
+            writeBigEndian(images, count);
+            writeBigEndian(images, rows);
+            writeBigEndian(images, cols);
+            images.write(pixels.data(), pixels.size());
+
+            std::ofstream labels(labelsPath, std::ios::binary);
+            writeBigEndian(labels, 2049);
+            writeBigEndian(labels, count);
+            for (std::uint32_t i = 0; i < count; ++i) labels.put(char(i % 10));
+        }
+
+        const double fileBytes = double(count) * (rows * cols + 1);
+        bench.run(name, std::to_string(count) + "x" + shape(rows, cols), 0.0,
+            fileBytes + double(count) * rows * cols * sizeof(T),
+            [&] {
+                auto [images, labels] = DataReader::readMNISTImagesAndLabels<T>(imagesPath, labelsPath);
+                consume(images.back().data());
+            });
+
+        std::filesystem::remove(imagesPath);
+        std::filesystem::remove(labelsPath);
+    }
+
+    std::string jsonEscape(const std::string& s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+    std::string compilerName() {
+#if defined(__clang__)
+        return "clang " __clang_version__;
+#elif defined(__GNUC__)
+        return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+        return "msvc " + std::to_string(_MSC_VER);
+#else
+        return "unknown";
+#endif
+    }
+
+    void writeResults(const std::string& path, const Options& options, const std::vector<Result>& results) {
+        std::ofstream ofs(path);
+        if (!ofs) {
+            throw std::runtime_error("Cannot open benchmark output: " + path);
+        }
+
+        char date[32];
+        std::time_t now = std::time(nullptr);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+        ofs << "{\"kind\":\"meta\",\"date\":\"" << date << "\""
+            << ",\"simd\":\"" << math::simdLevel() << "\""
+            << ",\"compiler\":\"" << jsonEscape(compilerName()) << "\""
+#ifdef NDEBUG
+            << ",\"build\":\"release\""
+#else
+            << ",\"build\":\"debug\""
+#endif
+            << ",\"threads\":" << std::thread::hardware_concurrency()
+            << ",\"minTime\":" << options.minTime << "}\n";
+
+        ofs << std::setprecision(6);
+        for (const Result& r : results) {
+            ofs << "{\"kind\":\"result\",\"name\":\"" << jsonEscape(r.name) << "\""
+                << ",\"args\":\"" << jsonEscape(r.args) << "\""
+                << ",\"iterations\":" << r.iterations
+                << ",\"ns_per_op\":" << r.nsPerOp
+                << ",\"gflops\":" << (r.flopsPerOp > 0 ? r.flopsPerOp / r.nsPerOp : 0.0)
+                << ",\"bytes_per_op\":" << r.bytesPerOp
+                << ",\"gbytes_per_s\":" << r.bytesPerOp / r.nsPerOp << "}\n";
+        }
+    }
+
+    void printUsage() {
+        std::cout << "Usage: dnl_bench [--filter <text>] [--min-time <seconds>] [--out <file>]\n";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        }
+        else if (arg == "--min-time" && i + 1 < argc) {
+            options.minTime = std::stod(argv[++i]);
+        }
+        else if (arg == "--out" && i + 1 < argc) {
+            options.outFile = argv[++i];
+        }
+        else {
+            printUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    try {
+        std::cout << "SIMD: " << math::simdLevel() << "\n";
+        Runner bench(options);
+        std::mt19937 rng(1234);
+
+        benchMath<float>(bench, rng);
+        benchMath<double>(bench, rng);
+        benchInt8(bench, rng);
+        benchModel<float>(bench, rng);
+        benchModel<double>(bench, rng);
+        benchSparse(bench, rng);
+        benchNetwork<float>(bench, rng);
+        benchNetwork<double>(bench, rng);
+        benchAugment<float>(bench, rng);
+        benchAugment<double>(bench, rng);
+        benchCanvas(bench);
+        benchReader<float>(bench, rng);
+        benchReader<double>(bench, rng);
+
+        writeResults(options.outFile, options, bench.results());
+        std::cout << bench.results().size() << " results written to " << options.outFile << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "Canvas.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+Canvas::Canvas(std::size_t width, std::size_t height)
+    : width_t(width), height_t(height), pixels_t(width * height, 0),
+    minX_t(INT_MAX), minY_t(INT_MAX), maxX_t(-1), maxY_t(-1)
+{
+}
+
+void Canvas::stamp(float x, float y, float radius)
+{
+    if (radius <= 0.0f) {
+        return;
+    }
+    const int w = static_cast<int>(width_t);
+    const int h = static_cast<int>(height_t);
+
+    // Pixel (px, py) covers [px, px + 1) x [py, py + 1); it is painted when its centre is in the circle
+    const int y0 = std::max(0, static_cast<int>(std::ceil(y - radius - 0.5f)));
+    const int y1 = std::min(h - 1, static_cast<int>(std::floor(y + radius - 0.5f)));
+    for (int py = y0; py <= y1; ++py) {
+        const float dy = py + 0.5f - y;
+        const float reach = radius * radius - dy * dy;
+        if (reach < 0.0f) {
+            continue;
+        }
+        const float half = std::sqrt(reach);
+        const int x0 = std::max(0, static_cast<int>(std::ceil(x - half - 0.5f)));
+        const int x1 = std::min(w - 1, static_cast<int>(std::floor(x + half - 0.5f)));
+        if (x1 < x0) {
+            continue;
+        }
+        std::memset(pixels_t.data() + static_cast<std::size_t>(py) * width_t + x0, 255, static_cast<std::size_t>(x1 - x0 + 1));
+        minX_t = std::min(minX_t, x0);
+        maxX_t = std::max(maxX_t, x1);
+        minY_t = std::min(minY_t, py);
+        maxY_t = std::max(maxY_t, py);
+    }
+}
+
+void Canvas::clear()
+{
+    for (int y = minY_t; y <= maxY_t; ++y) {
+        std::memset(pixels_t.data() + static_cast<std::size_t>(y) * width_t + minX_t, 0, static_cast<std::size_t>(maxX_t - minX_t + 1));
+    }
+    minX_t = minY_t = INT_MAX;
+    maxX_t = maxY_t = -1;
+}
+
+template <typename T>
+void Canvas::capture(T* out, std::size_t size, std::size_t box) const
+{
+    std::fill(out, out + size * size, T(0));
+    if (empty() || size == 0) {
+        return;
+    }
+
+    // Scale the bounding box so its larger side becomes `box` output pixels, centred
+    const int bw = maxX_t - minX_t + 1;
+    const int bh = maxY_t - minY_t + 1;
+    const double scale = static_cast<double>(std::min(box, size)) / std::max(bw, bh);
+    const int scaledW = std::max(1, static_cast<int>(std::lround(bw * scale)));
+    const int scaledH = std::max(1, static_cast<int>(std::lround(bh * scale)));
+    const int offsetX = (static_cast<int>(size) - scaledW) / 2;
+    const int offsetY = (static_cast<int>(size) - scaledH) / 2;
+
+    // Output pixel j covers [j / scale, (j + 1) / scale) of the box; canvas pixel i
+    // contributes the length of its overlap with that span
+    struct Span {
+        int first, last;
+        double begin, end;
+        double weight(int i) const { return std::min(end, i + 1.0) - std::max(begin, static_cast<double>(i)); }
+    };
+    auto span = [scale](int j, int origin, int extent) {
+        Span s;
+        s.begin = origin + j / scale;
+        s.end = std::min(origin + (j + 1) / scale, static_cast<double>(origin + extent));
+        s.first = static_cast<int>(std::floor(s.begin));
+        s.last = std::max(s.first, static_cast<int>(std::ceil(s.end)) - 1);
+        return s;
+    };
+
+    // 1) Horizontal pass: every box row reduced to scaledW column sums
+    std::vector<double> rows(static_cast<std::size_t>(bh) * scaledW, 0.0);
+    std::vector<Span> columns(scaledW);
+    for (int j = 0; j < scaledW; ++j) {
+        columns[j] = span(j, minX_t, bw);
+    }
+    for (int y = 0; y < bh; ++y) {
+        const std::uint8_t* src = pixels_t.data() + static_cast<std::size_t>(minY_t + y) * width_t;
+        double* dst = rows.data() + static_cast<std::size_t>(y) * scaledW;
+        for (int j = 0; j < scaledW; ++j) {
+            // Only the two end pixels can be partly covered
+            const Span& s = columns[j];
+            if (s.first == s.last) {
+                dst[j] = s.weight(s.first) * src[s.first];
+                continue;
+            }
+            unsigned inner = 0;
+            for (int i = s.first + 1; i < s.last; ++i) {
+                inner += src[i];
+            }
+            dst[j] = s.weight(s.first) * src[s.first] + inner + s.weight(s.last) * src[s.last];
+        }
+    }
+
+    // 2) Vertical pass: weighted sums of whole reduced rows, normalised by the area
+    //    each output pixel covers
+    std::vector<double> acc(scaledW);
+    for (int k = 0; k < scaledH; ++k) {
+        const Span s = span(k, minY_t, bh);
+        std::fill(acc.begin(), acc.end(), 0.0);
+        for (int i = s.first; i <= s.last; ++i) {
+            const double w = s.weight(i);
+            const double* row = rows.data() + static_cast<std::size_t>(i - minY_t) * scaledW;
+            for (int j = 0; j < scaledW; ++j) {
+                acc[j] += w * row[j];
+            }
+        }
+        T* dst = out + static_cast<std::size_t>(offsetY + k) * size + offsetX;
+        for (int j = 0; j < scaledW; ++j) {
+            const double area = (s.end - s.begin) * (columns[j].end - columns[j].begin);
+            dst[j] = static_cast<T>(std::min(1.0, acc[j] / (255.0 * area)));
+        }
+    }
+}
+
+template <typename T>
+std::vector<T> Canvas::capture(std::size_t size, std::size_t box) const
+{
+    std::vector<T> out(size * size);
+    capture(out.data(), size, box);
+    return out;
+}
+
+template void Canvas::capture<float>(float*, std::size_t, std::size_t) const;
+template void Canvas::capture<double>(double*, std::size_t, std::size_t) const;
+template std::vector<float> Canvas::capture<float>(std::size_t, std::size_t) const;
+template std::vector<double> Canvas::capture<double>(std::size_t, std::size_t) const;
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+
+ CPU-side copy of the GUI drawing: a width x height grayscale image (0 = black,
+ 255 = full stroke) updated as the brush is stamped, plus the bounding box of
+ everything drawn since the last clear. The window keeps rendering the strokes
+ on the GPU; prediction reads this buffer instead of copying the texture back.
+
+*/
+class Canvas
+{
+public:
+    Canvas(std::size_t width, std::size_t height);
+
+    std::size_t width() const { return width_t; }
+    std::size_t height() const { return height_t; }
+    const std::uint8_t* pixels() const { return pixels_t.data(); }
+
+    // Paint a filled circle of the given radius centred on (x, y): every pixel whose
+    // centre lies inside it (what an sf::CircleShape of that radius covers)
+    void stamp(float x, float y, float radius);
+
+    // Back to black; only the dirty region is cleared
+    void clear();
+
+    bool empty() const { return maxX_t < minX_t; }
+
+    /*
+
+    The drawing as an MNIST-style size x size input in [0..1]: the bounding box is
+    scaled so its larger side is `box` pixels and centred, each output pixel the
+    average over the canvas area it covers. Only the bounding box is read.
+    An empty canvas gives all zeros.
+
+    */
+    template <typename T>
+    void capture(T* out, std::size_t size = 28, std::size_t box = 20) const;
+
+    template <typename T>
+    std::vector<T> capture(std::size_t size = 28, std::size_t box = 20) const;
+
+private:
+    std::size_t width_t;
+    std::size_t height_t;
+    std::vector<std::uint8_t> pixels_t;
+
+    // Inclusive bounding box of the stamped pixels (empty when max < min)
+    int minX_t, minY_t, maxX_t, maxY_t;
+};
@@ -0,0 +1,288 @@
+#include "Checkpoint.h"
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#include "utils.h"
+
+namespace {
+    constexpr char kCheckpointMagic[4] = { 'D', 'N', 'L', 'C' };
+    constexpr std::uint32_t kCheckpointVersion = 3; // 2: W1 stored input-major, as in model files v3; 3: validator state
+
+    // Writes fields one after another, keeping the running CRC of everything written
+    struct CheckedWriter {
+        std::ofstream& ofs;
+        std::uint32_t crc = 0;
+
+        void bytes(const void* data, std::size_t size) {
+            ofs.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            crc = utils::crc32(data, size, crc);
+        }
+        template <typename V>
+        void value(V v) { bytes(&v, sizeof(v)); }
+        template <typename V>
+        void values(const V* data, std::size_t n) {
+            value<std::uint64_t>(n);
+            bytes(data, n * sizeof(V));
+        }
+        void point(const ValidationPoint& p) {
+            value<std::int32_t>(p.epoch);
+            value<std::uint64_t>(p.batch);
+            value<double>(p.accuracy);
+            value<double>(p.loss);
+        }
+    };
+
+    struct CheckedReader {
+        std::ifstream& ifs;
+        const std::string& filename;
+        std::uint32_t crc = 0;
+
+        void bytes(void* data, std::size_t size) {
+            ifs.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+            if (!ifs) {
+                throw std::runtime_error("Checkpoint file is truncated: " + filename);
+            }
+            crc = utils::crc32(data, size, crc);
+        }
+        template <typename V>
+        V value() {
+            V v{};
+            bytes(&v, sizeof(v));
+            return v;
+        }
+        template <typename Vec>
+        void values(Vec& out, std::size_t limit) {
+            std::uint64_t n = value<std::uint64_t>();
+            if (n > limit) {
+                throw std::runtime_error("Checkpoint file sizes are inconsistent: " + filename);
+            }
+            out.resize(static_cast<std::size_t>(n));
+            bytes(out.data(), out.size() * sizeof(typename Vec::value_type));
+        }
+        ValidationPoint point() {
+            ValidationPoint p;
+            p.epoch = value<std::int32_t>();
+            p.batch = value<std::uint64_t>();
+            p.accuracy = value<double>();
+            p.loss = value<double>();
+            return p;
+        }
+    };
+
+    // Checks magic and version; returns the bytes per value
+    std::uint32_t readPreamble(CheckedReader& in) {
+        char magic[sizeof(kCheckpointMagic)];
+        in.bytes(magic, sizeof(magic));
+        if (!std::equal(magic, magic + sizeof(magic), kCheckpointMagic)) {
+            throw std::runtime_error("Not a checkpoint file: " + in.filename);
+        }
+        std::uint32_t version = in.value<std::uint32_t>();
+        if (version != kCheckpointVersion) {
+            throw std::runtime_error("Unsupported checkpoint version " + std::to_string(version) + ": " + in.filename);
+        }
+        return in.value<std::uint32_t>();
+    }
+}
+
+bool readCheckpointPosition(const std::string& filename, CheckpointPosition& position)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        return false;
+    }
+    CheckedReader in{ ifs, filename };
+    readPreamble(in);
+    position.batch = in.value<std::uint64_t>();
+    in.value<std::uint64_t>(); // batches per epoch
+    position.streamSeed = in.value<std::uint32_t>();
+    return true;
+}
+
+template <typename T>
+void saveCheckpoint(const TrainingCheckpoint<T>& checkpoint, const std::string& filename)
+{
+    const std::string temp = filename + ".tmp";
+    {
+        std::ofstream ofs(temp, std::ios::binary);
+        if (!ofs) {
+            throw std::runtime_error("Could not open file for writing: " + temp);
+        }
+        CheckedWriter out{ ofs };
+        out.bytes(kCheckpointMagic, sizeof(kCheckpointMagic));
+        out.value<std::uint32_t>(kCheckpointVersion);
+        out.value<std::uint32_t>(sizeof(T));
+        out.value<std::uint64_t>(checkpoint.batch);
+        out.value<std::uint64_t>(checkpoint.batchesPerEpoch);
+        out.value<std::uint32_t>(checkpoint.streamSeed);
+        out.value<std::uint64_t>(checkpoint.threads);
+        out.value<double>(checkpoint.epochLoss);
+        out.value<std::uint32_t>(static_cast<std::uint32_t>(checkpoint.shape.size()));
+        out.bytes(checkpoint.shape.data(), checkpoint.shape.size() * sizeof(std::uint64_t));
+        out.values(checkpoint.params.data(), checkpoint.params.size());
+        out.value<std::uint64_t>(checkpoint.optimizerSteps);
+        out.values(checkpoint.firstMoment.data(), checkpoint.firstMoment.size());
+        out.values(checkpoint.secondMoment.data(), checkpoint.secondMoment.size());
+        out.value<std::uint64_t>(checkpoint.validationHistory.size());
+        for (const ValidationPoint& point : checkpoint.validationHistory) {
+            out.point(point);
+        }
+        out.value<std::uint32_t>(checkpoint.hasBestValidation ? 1 : 0);
+        out.point(checkpoint.bestValidation);
+        out.values(checkpoint.bestParams.data(), checkpoint.bestParams.size());
+        out.value<std::uint64_t>(checkpoint.staleValidations);
+        const std::uint32_t crc = out.crc;
+        ofs.write(reinterpret_cast<const char*>(&crc), sizeof(crc));
+
+        ofs.flush();
+        if (!ofs) {
+            throw std::runtime_error("Could not write checkpoint file: " + temp);
+        }
+    }
+
+    // Replaces the previous checkpoint in one step
+    std::filesystem::rename(temp, filename);
+}
+
+template <typename T>
+TrainingCheckpoint<T> loadCheckpoint(const std::string& filename)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Could not open file for reading: " + filename);
+    }
+    ifs.seekg(0, std::ios::end);
+    const std::size_t fileSize = static_cast<std::size_t>(ifs.tellg());
+    ifs.seekg(0);
+
+    CheckedReader in{ ifs, filename };
+    if (readPreamble(in) != sizeof(T)) {
+        throw std::runtime_error("Checkpoint was saved with another scalar type: " + filename);
+    }
+
+    TrainingCheckpoint<T> checkpoint;
+    checkpoint.batch = in.value<std::uint64_t>();
+    checkpoint.batchesPerEpoch = in.value<std::uint64_t>();
+    checkpoint.streamSeed = in.value<std::uint32_t>();
+    checkpoint.threads = in.value<std::uint64_t>();
+    checkpoint.epochLoss = in.value<double>();
+
+    // No section can hold more values than the file has bytes
+    const std::size_t limit = fileSize / sizeof(T);
+    checkpoint.shape.resize(in.value<std::uint32_t>());
+    if (checkpoint.shape.size() > limit) {
+        throw std::runtime_error("Checkpoint file sizes are inconsistent: " + filename);
+    }
+    in.bytes(checkpoint.shape.data(), checkpoint.shape.size() * sizeof(std::uint64_t));
+    in.values(checkpoint.params, limit);
+    checkpoint.optimizerSteps = in.value<std::uint64_t>();
+    in.values(checkpoint.firstMoment, limit);
+    in.values(checkpoint.secondMoment, limit);
+    const std::uint64_t validations = in.value<std::uint64_t>();
+    if (validations > fileSize / (sizeof(std::int32_t) + sizeof(std::uint64_t) + 2 * sizeof(double))) {
+        throw std::runtime_error("Checkpoint file sizes are inconsistent: " + filename);
+    }
+    checkpoint.validationHistory.resize(static_cast<std::size_t>(validations));
+    for (ValidationPoint& point : checkpoint.validationHistory) {
+        point = in.point();
+    }
+    checkpoint.hasBestValidation = in.value<std::uint32_t>() != 0;
+    checkpoint.bestValidation = in.point();
+    in.values(checkpoint.bestParams, limit);
+    checkpoint.staleValidations = in.value<std::uint64_t>();
+
+    const std::uint32_t crc = in.crc;
+    if (in.value<std::uint32_t>() != crc) {
+        throw std::runtime_error("Checkpoint file is corrupt (CRC mismatch): " + filename);
+    }
+    return checkpoint;
+}
+
+template <typename T>
+Checkpointer<T>::Checkpointer(std::string filename)
+    : filename_t(std::move(filename))
+{
+    thread_t = std::thread(&Checkpointer::run, this);
+}
+
+template <typename T>
+Checkpointer<T>::~Checkpointer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_t);
+        stop_t = true;
+    }
+    wake_t.notify_one();
+    thread_t.join();
+}
+
+template <typename T>
+TrainingCheckpoint<T>& Checkpointer<T>::begin()
+{
+    std::lock_guard<std::mutex> lock(mutex_t);
+    if (error_t) {
+        std::rethrow_exception(std::exchange(error_t, nullptr));
+    }
+    // A checkpoint still waiting to be written is about to be superseded anyway
+    pending_t = -1;
+    filling_t = writing_t == 0 ? 1 : 0;
+    return buffers_t[filling_t];
+}
+
+template <typename T>
+void Checkpointer<T>::commit()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_t);
+        pending_t = std::exchange(filling_t, -1);
+    }
+    wake_t.notify_one();
+}
+
+template <typename T>
+void Checkpointer<T>::finish()
+{
+    std::unique_lock<std::mutex> lock(mutex_t);
+    idle_t.wait(lock, [&] { return pending_t < 0 && writing_t < 0; });
+    if (error_t) {
+        std::rethrow_exception(std::exchange(error_t, nullptr));
+    }
+}
+
+template <typename T>
+void Checkpointer<T>::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_t);
+    for (;;) {
+        wake_t.wait(lock, [&] { return stop_t || pending_t >= 0; });
+        if (pending_t < 0) {
+            return; // stopping with nothing left to write
+        }
+        writing_t = std::exchange(pending_t, -1);
+
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            saveCheckpoint(buffers_t[writing_t], filename_t);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (error) {
+            error_t = error;
+        }
+        writing_t = -1;
+        idle_t.notify_all();
+    }
+}
+
+template void saveCheckpoint(const TrainingCheckpoint<float>&, const std::string&);
+template void saveCheckpoint(const TrainingCheckpoint<double>&, const std::string&);
+template TrainingCheckpoint<float> loadCheckpoint(const std::string&);
+template TrainingCheckpoint<double> loadCheckpoint(const std::string&);
+template class Checkpointer<float>;
+template class Checkpointer<double>;
@@ -0,0 +1,125 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "math.h"
+
+/*
+
+ One validation of a weight snapshot (see Validator)
+
+*/
+struct ValidationPoint
+{
+    int epoch = 0;
+    std::uint64_t batch = 0;  // batches trained when the snapshot was taken
+    double accuracy = 0.0;    // 0..1
+    double loss = 0.0;        // mean cross-entropy
+};
+
+/*
+
+ Everything a streaming training run needs to continue exactly where it stopped:
+ the parameters and optimizer state after `batch` batches, the augmentation
+ stream's seed (the stream is a pure function of seed and batch number, so that
+ is its whole RNG state) and, when it trains with a Validator, the validation
+ curve, the best weights and the patience count.
+
+ File: "DNLC" | u32 version | u32 bytes per value | u64 batch | u64 batches per epoch
+ | u32 stream seed | u64 thread count | f64 loss so far this epoch | u32 shape count
+ | u64 shape | u64 n, parameters | u64 optimizer steps | u64 n, first moment
+ | u64 n, second moment | u64 n, validation history | u32 has best | best point
+ | u64 n, best parameters | u64 validations since the best | u32 CRC-32 of everything before
+ A point is i32 epoch | u64 batch | f64 accuracy | f64 loss.
+
+*/
+template <typename T>
+struct TrainingCheckpoint
+{
+    std::uint64_t batch = 0;           // batches trained = number of the next stream batch
+    std::uint64_t batchesPerEpoch = 0;
+    std::uint32_t streamSeed = 0;
+    std::uint64_t threads = 0;         // the data-parallel split changes rounding, so it must match
+    double epochLoss = 0.0;            // summed loss of the current epoch's batches so far
+    std::vector<std::uint64_t> shape;  // layer sizes of the model
+    math::AlignedVector<T> params;
+    std::uint64_t optimizerSteps = 0;
+    math::AlignedVector<T> firstMoment;
+    math::AlignedVector<T> secondMoment;
+
+    // Validator state once every snapshot submitted so far was evaluated (empty without one)
+    std::vector<ValidationPoint> validationHistory;
+    bool hasBestValidation = false;
+    ValidationPoint bestValidation;
+    math::AlignedVector<T> bestParams;
+    std::uint64_t staleValidations = 0;
+};
+
+// Where a checkpoint continues, without reading the whole file; false if there is no checkpoint
+struct CheckpointPosition
+{
+    std::uint64_t batch = 0;
+    std::uint32_t streamSeed = 0;
+};
+bool readCheckpointPosition(const std::string& filename, CheckpointPosition& position);
+
+// Write to filename + ".tmp", then rename over filename: a crash leaves the old or the new file, never half of one
+template <typename T>
+void saveCheckpoint(const TrainingCheckpoint<T>& checkpoint, const std::string& filename);
+
+// Throws if the file is missing, corrupt or was saved with another scalar type
+template <typename T>
+TrainingCheckpoint<T> loadCheckpoint(const std::string& filename);
+
+/*
+
+ Writes checkpoints on a background thread so training never waits for the disk.
+ Two checkpoint buffers: while the writer saves one, the trainer fills the other
+ (begin(), fill, commit()). A checkpoint committed while the writer is still busy
+ replaces any earlier one that is still waiting, so only the newest is written.
+ The destructor writes whatever is still pending. Write errors are rethrown by
+ the next begin() or by finish().
+
+*/
+template <typename T>
+class Checkpointer
+{
+public:
+    explicit Checkpointer(std::string filename);
+    ~Checkpointer();
+
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+
+    // The buffer to fill: never the one being written, so this does not block on I/O
+    TrainingCheckpoint<T>& begin();
+    void commit();
+
+    // Wait until the last committed checkpoint is on disk
+    void finish();
+
+private:
+    void run();
+
+    std::string filename_t;
+    TrainingCheckpoint<T> buffers_t[2];
+
+    std::mutex mutex_t;
+    std::condition_variable wake_t;
+    std::condition_variable idle_t;
+    int filling_t = -1; // buffer the trainer is filling
+    int pending_t = -1; // buffer waiting to be written
+    int writing_t = -1; // buffer being written
+    std::exception_ptr error_t;
+    bool stop_t = false;
+
+    std::thread thread_t;
+};
+
+extern template class Checkpointer<float>;
+extern template class Checkpointer<double>;
@@ -1,117 +1,24 @@
 ﻿#include <iostream>
 #include <filesystem> 
 #include <SFML/Graphics.hpp>
+#include <iterator>
 #include <random>
 
+#include "Canvas.h"
 #include "math.h"
 #include "DataReader.h"
+#include "InferenceWorker.h"
 #include "Model.h"
+#include "Tools.h"
+#include "Validation.h"
 
 namespace fs = std::filesystem;
 
-// A helper to get a grayscale brightness in [0..1] from an SFML pixel
-inline double pixelBrightness(const sf::Color& c) {
-    // simple average of (r,g,b)
-    return (c.r + c.g + c.b) / 3.0 / 255.0;
-}
-
-// Helper: nearest-neighbor sampling from an sf::Image
-inline double sampleNearest(const sf::Image& img, float x, float y) {
-    // Round x,y
-    int ix = static_cast<int>(std::round(x));
-    int iy = static_cast<int>(std::round(y));
-    // Clamp to image bounds
-    ix = std::max(0, std::min(ix, (int)img.getSize().x - 1));
-    iy = std::max(0, std::min(iy, (int)img.getSize().y - 1));
-    return pixelBrightness(img.getPixel(ix, iy));
-}
-
-// Captures the user's 280×280 drawing in renderTex, extracts the bounding
-// box of non-black pixels, scales it to ~20×20, and centers it in 28×28.
-std::vector<double> captureAndScale(const sf::RenderTexture& renderTex) {
-    // 1) Copy the entire 280×280 image
-    sf::Image screenshot = renderTex.getTexture().copyToImage();
-    unsigned int W = screenshot.getSize().x; // e.g. 280
-    unsigned int H = screenshot.getSize().y; // e.g. 280
-
-    // 2) Find bounding box of the digit
-    //    i.e., minX, maxX, minY, maxY of pixels that are not "near black."
-    int minX = W, maxX = -1;
-    int minY = H, maxY = -1;
-
-    // We'll define "black" as brightness < some threshold (like 0.1).
-    // If your strokes are pure white on black, threshold can be small.
-    const double threshold = 0.1;
-
-    for (unsigned int y = 0; y < H; ++y) {
-        for (unsigned int x = 0; x < W; ++x) {
-            double b = pixelBrightness(screenshot.getPixel(x, y));
-            if (b > threshold) {
-                if ((int)x < minX) minX = x;
-                if ((int)x > maxX) maxX = x;
-                if ((int)y < minY) minY = y;
-                if ((int)y > maxY) maxY = y;
-            }
-        }
-    }
-
-    // If nothing found (digit not drawn), return a blank 28×28
-    if (maxX < 0 || maxY < 0) {
-        return std::vector<double>(28 * 28, 0.0);
-    }
-
-    // 3) Determine bounding box width/height
-    int bw = maxX - minX + 1;
-    int bh = maxY - minY + 1;
-
-    // 4) We want the largest dimension to be ~20,
-    //    so let's compute a scale factor
-    const int TARGET_SIZE = 20; // typical MNIST digit region is ~20x20
-    float scale = 1.0f;
-    int biggerDim = std::max(bw, bh);
-    if (biggerDim > 0) {
-        scale = (float)TARGET_SIZE / (float)biggerDim;
-    }
-
-    // 5) Now we create a 28x28 output, initially black
-    std::vector<double> out(28 * 28, 0.0);
-
-    // 6) We'll map each pixel in [0..27,0..27] to the bounding box
-    //    using the inverse transform:
-    //    X_in = minX + (x_out - cx_out)/scale + cx_box
-    // We'll center the scaled bounding box in the 28×28. 
-    // So the top-left corner of the scaled box in the 28×28 might be:
-    int scaledW = (int)std::round(bw * scale);
-    int scaledH = (int)std::round(bh * scale);
-
-    // Center offset in 28×28
-    int offsetX = (28 - scaledW) / 2;
-    int offsetY = (28 - scaledH) / 2;
-
-    for (int yOut = 0; yOut < 28; ++yOut) {
-        for (int xOut = 0; xOut < 28; ++xOut) {
-            // Check if we're within the scaled bounding box region
-            // in the output
-            if (xOut >= offsetX && xOut < offsetX + scaledW &&
-                yOut >= offsetY && yOut < offsetY + scaledH)
-            {
-                // Map output coords -> input coords
-                float inX = minX + ((xOut - offsetX) / scale);
-                float inY = minY + ((yOut - offsetY) / scale);
-
-                // Sample nearest from the screenshot
-                double val = sampleNearest(screenshot, inX, inY);
-                // Store in out[yOut * 28 + xOut]
-                out[yOut * 28 + xOut] = val;
-            }
-        }
-    }
-
-    return out;
-}
-
-int main()
+int main(int argc, char* argv[])
 {
+    // Command line tools (see Tools.h) run without opening a window
+    if (argc > 1)
+        return tools::run(argc, argv);
 
     std::string trainImagesFile = "dataset/train-images.idx3-ubyte";
     std::string trainLabelsFile = "dataset/train-labels.idx1-ubyte";
@@ -140,7 +47,8 @@ int main()
         }
         
         // 784 inputs -> 128 hidden -> 10 outputs
-        Model net(784, 128, 10, 0.01);
+        // (learning rate is applied to the batch-mean gradient, see TrainConfig)
+        Model net(784, 128, 10, 0.1);
 
         if (modelFiles.empty()) {
 
@@ -152,44 +60,66 @@ int main()
             auto [testImages, testLabels] =
                 DataReader::readMNISTImagesAndLabels(testImagesFile, testLabelsFile);
 
+            // The last 5000 training images are held out to validate on while training
+            const std::size_t heldOut = 5000;
+            std::vector<std::vector<double>> validationImages(
+                std::make_move_iterator(trainImages.end() - heldOut), std::make_move_iterator(trainImages.end()));
+            std::vector<int> validationLabels(trainLabels.end() - heldOut, trainLabels.end());
+            trainImages.resize(trainImages.size() - heldOut);
+            trainLabels.resize(trainLabels.size() - heldOut);
+
             std::cout << "Train set size: " << trainImages.size() << " images\n";
+            std::cout << "Validation set size: " << validationImages.size() << " images\n";
             std::cout << "Test set size:  " << testImages.size() << " images\n";
 
-            std::vector<std::vector<double>> augmentedImages = trainImages;
-            std::vector<int> augmentedLabels = trainLabels;
-
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_real_distribution<double> angleDist(-15.0, 15.0);
-            std::uniform_real_distribution<double> scaleDist(0.7, 1.3);
-            std::uniform_int_distribution<int> shiftDist(-3, 3);
-
-            for (std::size_t i = 0; i < trainImages.size(); ++i) {
-                // Generate 2 random transformations
-                for (int a = 0; a < 10; ++a) {
-                    double angle = angleDist(gen);
-                    double scale = scaleDist(gen);
-                    int shiftX = shiftDist(gen);
-                    int shiftY = shiftDist(gen);
-
-                    auto newImg = utils::augmentImage(trainImages[i], angle, scale, shiftX, shiftY);
-
-                    // Same label
-                    augmentedImages.push_back(newImg);
-                    augmentedLabels.push_back(trainLabels[i]);
-                }
+            // Augmented batches are generated on the fly by background threads:
+            // every epoch sees each image once as-is and 10 times with a fresh
+            // random rotation / scale / shift, at constant memory
+            AugmentConfig augment;
+            augment.batchSize = 32;
+            augment.copies = 10;
+            augment.seed = std::random_device{}();
+
+            // A run that was interrupted continues from its last checkpoint
+            std::string checkpointFile = (modelDir / "training.ckpt").string();
+            CheckpointPosition position;
+            if (readCheckpointPosition(checkpointFile, position)) {
+                augment.seed = position.streamSeed;
+                augment.firstBatch = position.batch;
             }
-
-            std::cout << "Augmented dataset size: " << augmentedImages.size() << " images\n";
-
-            // 4) Train (for e.g. 5 epochs)
-            net.train(augmentedImages, augmentedLabels, 8);
-
-            // 5) Evaluate on test data (accuracy)
+            AugmentStream<double> stream(trainImages, trainLabels, augment);
+
+            std::cout << "Augmented samples per epoch: " << stream.epochSize() << "\n";
+
+            // 4) Train (for e.g. 5 epochs), mini-batches split across all cores
+            // Throughput and per-phase timings go to models/training.jsonl
+            Telemetry telemetry((modelDir / "training.jsonl").string());
+            // Nesterov momentum with a cosine decay reaches in 4 epochs what
+            // plain SGD at a constant rate needed 8 for
+            TrainConfig config;
+            config.epochs = 4;
+            config.threads = 0;
+            config.optimizer.type = OptimizerType::Nesterov;
+            config.optimizer.schedule = LRSchedule::Cosine;
+            config.optimizer.warmupSteps = 500;
+            config.telemetry = &telemetry;
+            config.checkpointFile = checkpointFile;
+            config.resume = true;
+
+            // Validated every 2000 batches on its own thread; training stops once 4
+            // validations in a row bring no improvement and keeps the best weights
+            ValidationConfig validation;
+            validation.every = 2000;
+            validation.patience = 4;
+            Validator<double> validator(validationImages, validationLabels, validation);
+            net.train(stream, config, &validator);
+
+            // 5) Evaluate on test data (accuracy), batched across all cores
+            ThreadPool pool;
+            std::vector<int> preds = net.predictBatch(testImages, pool);
             int correct = 0;
             for (size_t i = 0; i < testImages.size(); ++i) {
-                int pred = net.predict(testImages[i]);
-                if (pred == testLabels[i]) {
+                if (preds[i] == testLabels[i]) {
                     correct++;
                 }
             }
@@ -200,6 +130,7 @@ int main()
             std::string defaultModel = (modelDir / "default.model").string();
             net.saveModel(defaultModel);
             std::cout << "Saved new model to: " << defaultModel << std::endl;
+            fs::remove(checkpointFile);
         }
         else {
             std::cout << "Found model files in 'models/' directory:\n";
@@ -218,8 +149,9 @@ int main()
             std::string chosenModel = modelFiles[choice];
             std::cout << "Loading model: " << chosenModel << std::endl;
 
-            // Example: If you're expecting the same network shape as was saved
-            net.loadModel(chosenModel);
+            // The network takes the shape stored in the file; current-format
+            // files are mapped and used without copying the weights
+            net.mapModel(chosenModel);
 
             // Now we can use net for inference or further training
             // e.g., evaluate on test set
@@ -230,10 +162,11 @@ int main()
             auto [testImages, testLabels] =
                 DataReader::readMNISTImagesAndLabels(testImagesFile, testLabelsFile);
 
+            ThreadPool pool;
+            std::vector<int> preds = net.predictBatch(testImages, pool);
             int correct = 0;
             for (size_t i = 0; i < testImages.size(); ++i) {
-                int pred = net.predict(testImages[i]);
-                if (pred == testLabels[i]) {
+                if (preds[i] == testLabels[i]) {
                     correct++;
                 }
             }
@@ -260,6 +193,16 @@ int main()
         renderTex.clear(sf::Color::Black);
         renderTex.display();
 
+        // The same strokes on the CPU, for prediction without reading the texture back
+        Canvas canvas(CANVAS_WIDTH, CANVAS_HEIGHT);
+
+        // Predictions run on a background thread; the loop below only submits the
+        // latest drawing and picks up results, so it never waits for the model
+        InferenceWorker<double> inference(net);
+        std::uint64_t clearedAt = 0; // results for requests up to this one predate a Clear
+        bool canvasChanged = false;
+        bool live = false;           // predict on every stroke instead of on Predict
+
         bool drawing = false;
         float brushRadius = 4.8f;//8.0f;
 
@@ -272,6 +215,10 @@ int main()
         btnPredict.setPosition((float)(CANVAS_WIDTH + 20), 120.0f);
         btnPredict.setFillColor(sf::Color(100, 100, 100)); // gray
 
+        sf::RectangleShape btnLive(sf::Vector2f(70, 40));
+        btnLive.setPosition((float)(CANVAS_WIDTH + 130), 120.0f);
+        btnLive.setFillColor(sf::Color(100, 100, 100)); // gray while off
+
         sf::Font font;
         if (!font.loadFromFile("Verdana.ttf")) {
             std::cout << "Warning: could not load font. Text won't display.\n";
@@ -290,6 +237,10 @@ int main()
         predictLabel.setFillColor(sf::Color::Black);
         predictLabel.setPosition(btnPredict.getPosition().x + 5, btnPredict.getPosition().y + 8);
 
+        sf::Text liveLabel("Live", font, 18);
+        liveLabel.setFillColor(sf::Color::Black);
+        liveLabel.setPosition(btnLive.getPosition().x + 14, btnLive.getPosition().y + 8);
+
         while (window.isOpen()) {
             sf::Event event;
             while (window.pollEvent(event)) {
@@ -315,16 +266,24 @@ int main()
                                 // Clear the canvas
                                 renderTex.clear(sf::Color::Black);
                                 renderTex.display();
+                                canvas.clear();
+                                clearedAt = inference.submitted();
+                                canvasChanged = false;
                                 predictionText.setString("Prediction: ?");
                             }
 
                             // Check if clicked "Predict" button
-                            if (btnPredict.getGlobalBounds().contains(mp)) {
-                                // Predict
-                                std::vector<double> scaled = captureAndScale(renderTex);
-                                int pred = net.predict(scaled);
-                                // Update the text
-                                predictionText.setString("Prediction: " + std::to_string(pred));
+                            if (btnPredict.getGlobalBounds().contains(mp) && !canvas.empty()) {
+                                // Predict (the text is updated when the result arrives)
+                                canvas.capture(inference.request().data());
+                                inference.submit();
+                                canvasChanged = false;
+                            }
+
+                            // "Live" toggles predicting while drawing
+                            if (btnLive.getGlobalBounds().contains(mp)) {
+                                live = !live;
+                                btnLive.setFillColor(live ? sf::Color(120, 200, 120) : sf::Color(100, 100, 100));
                             }
                         }
                     }
@@ -353,12 +312,29 @@ int main()
                     brush.setPosition(mousePos.x - brushRadius, mousePos.y - brushRadius);
                     renderTex.draw(brush);
                     renderTex.display();
+                    canvas.stamp((float)mousePos.x, (float)mousePos.y, brushRadius);
+                    canvasChanged = true;
                 }
                 else {
                     drawing = false;
                 }
             }
 
+            // In live mode every frame with new strokes asks for a prediction; the
+            // worker skips requests that a newer one replaced before it got to them
+            if (live && canvasChanged) {
+                canvas.capture(inference.request().data());
+                inference.submit();
+                canvasChanged = false;
+            }
+            if (const auto* result = inference.poll()) {
+                if (result->sequence > clearedAt) {
+                    const int confidence = static_cast<int>(100.0 * result->probs[result->label] + 0.5);
+                    predictionText.setString("Prediction: " + std::to_string(result->label)
+                        + "\n(" + std::to_string(confidence) + "%)");
+                }
+            }
+
             // ----------------------------------------------------------------
             // Draw everything
             // ----------------------------------------------------------------
@@ -371,11 +347,13 @@ int main()
             // 2) Draw buttons
             window.draw(btnClear);
             window.draw(btnPredict);
+            window.draw(btnLive);
 
             // 3) Draw button labels
             if (font.getInfo().family != "") { // means we loaded a font
                 window.draw(clearLabel);
                 window.draw(predictLabel);
+                window.draw(liveLabel);
                 window.draw(predictionText);
             }
 
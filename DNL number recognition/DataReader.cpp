@@ -0,0 +1,256 @@
+#include "DataReader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace DataReader {
+
+    MappedFile::MappedFile(const std::string& path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Cannot open file: " + path);
+        }
+        file_t = file;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            unmap();
+            throw std::runtime_error("Cannot map empty file: " + path);
+        }
+        length_t = static_cast<std::size_t>(size.QuadPart);
+
+        mapping_t = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_t == nullptr) {
+            unmap();
+            throw std::runtime_error("Cannot map file: " + path);
+        }
+        data_t = static_cast<const std::uint8_t*>(MapViewOfFile(mapping_t, FILE_MAP_READ, 0, 0, 0));
+        if (data_t == nullptr) {
+            unmap();
+            throw std::runtime_error("Cannot map file: " + path);
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open file: " + path);
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot map empty file: " + path);
+        }
+        length_t = static_cast<std::size_t>(st.st_size);
+
+        void* p = ::mmap(nullptr, length_t, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps the file referenced
+        if (p == MAP_FAILED) {
+            length_t = 0;
+            throw std::runtime_error("Cannot map file: " + path);
+        }
+        // The whole file is about to be read front to back
+        ::madvise(p, length_t, MADV_WILLNEED);
+        data_t = static_cast<const std::uint8_t*>(p);
+#endif
+    }
+
+    MappedFile::~MappedFile()
+    {
+        unmap();
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other) {
+            unmap();
+            std::swap(data_t, other.data_t);
+            std::swap(length_t, other.length_t);
+#ifdef _WIN32
+            std::swap(file_t, other.file_t);
+            std::swap(mapping_t, other.mapping_t);
+#endif
+        }
+        return *this;
+    }
+
+    void MappedFile::unmap()
+    {
+#ifdef _WIN32
+        if (data_t) {
+            UnmapViewOfFile(data_t);
+        }
+        if (mapping_t) {
+            CloseHandle(mapping_t);
+        }
+        if (file_t) {
+            CloseHandle(file_t);
+        }
+        file_t = nullptr;
+        mapping_t = nullptr;
+#else
+        if (data_t) {
+            ::munmap(const_cast<std::uint8_t*>(data_t), length_t);
+        }
+#endif
+        data_t = nullptr;
+        length_t = 0;
+    }
+
+    IdxFile::IdxFile(const std::string& path, std::uint32_t expectedMagic)
+        : file_t(path)
+    {
+        const std::uint8_t* bytes = file_t.data();
+        if (file_t.size() < 4) {
+            throw std::runtime_error("Truncated IDX header: " + path);
+        }
+        std::uint32_t magic = readBigEndianUInt32(bytes);
+        if (magic != expectedMagic) {
+            throw std::runtime_error("Invalid magic number in " + path +
+                " (expected " + std::to_string(expectedMagic) + ").");
+        }
+
+        // magic = 0x00 0x00 <type> <number of dimensions>; only unsigned bytes (0x08) are supported
+        const std::size_t numDims = bytes[3];
+        const std::size_t headerSize = 4 + 4 * numDims;
+        if (bytes[2] != 0x08 || numDims == 0) {
+            throw std::runtime_error("Unsupported IDX data type in " + path);
+        }
+        if (file_t.size() < headerSize) {
+            throw std::runtime_error("Truncated IDX header: " + path);
+        }
+
+        // Crafted dimensions must not overflow the sizes: every product is checked before it is formed
+        itemSize_t = 1;
+        for (std::size_t d = 0; d < numDims; ++d) {
+            dims_t.push_back(readBigEndianUInt32(bytes + 4 + 4 * d));
+            if (d > 0) {
+                if (dims_t[d] != 0 && itemSize_t > std::numeric_limits<std::size_t>::max() / dims_t[d]) {
+                    throw std::runtime_error("IDX dimensions are too large: " + path);
+                }
+                itemSize_t *= dims_t[d];
+            }
+        }
+        if (count() != 0 && itemSize_t > (file_t.size() - headerSize) / count()) {
+            throw std::runtime_error("IDX file is shorter than its header says: " + path);
+        }
+        payload_t = bytes + headerSize;
+    }
+
+    MNISTSet openMNIST(const std::string& imagesPath, const std::string& labelsPath)
+    {
+        MNISTSet set{ IdxFile(imagesPath, 2051), IdxFile(labelsPath, 2049) };
+        if (set.images.dims().size() != 3 || set.labels.dims().size() != 1) {
+            throw std::runtime_error("Expected 3-dimensional images and 1-dimensional labels: " + imagesPath + ", " + labelsPath);
+        }
+        if (set.images.count() != set.labels.count()) {
+            throw std::runtime_error("Mismatch: number of images != number of labels.");
+        }
+        // Labels index the 10 outputs
+        const std::uint8_t* labels = set.labels.data();
+        if (std::any_of(labels, labels + set.labels.count(), [](std::uint8_t label) { return label > 9; })) {
+            throw std::runtime_error("MNIST labels must be digits 0-9: " + labelsPath);
+        }
+        return set;
+    }
+
+    void readGrayImage(const std::string& path, std::size_t rows, std::size_t cols, std::vector<std::uint8_t>& pixels)
+    {
+        MappedFile file(path);
+        const std::uint8_t* bytes = file.data();
+        const std::size_t size = file.size();
+
+        std::size_t offset = 0;
+        std::size_t maxValue = 255;
+        if (size >= 2 && bytes[0] == 'P' && bytes[1] == '5') {
+            // Header: "P5" width height maxval, whitespace separated ('#' starts a comment),
+            // then exactly one whitespace byte before the pixels
+            offset = 2;
+            std::size_t fields[3] = {};
+            for (std::size_t& field : fields) {
+                while (offset < size && (std::isspace(bytes[offset]) || bytes[offset] == '#')) {
+                    if (bytes[offset] == '#') {
+                        while (offset < size && bytes[offset] != '\n') {
+                            ++offset;
+                        }
+                    }
+                    else {
+                        ++offset;
+                    }
+                }
+                if (offset == size || !std::isdigit(bytes[offset])) {
+                    throw std::runtime_error("Invalid PGM header: " + path);
+                }
+                while (offset < size && std::isdigit(bytes[offset])) {
+                    field = field * 10 + (bytes[offset++] - '0');
+                }
+            }
+            ++offset;
+            if (fields[0] != cols || fields[1] != rows) {
+                throw std::runtime_error(path + " is " + std::to_string(fields[0]) + "x" + std::to_string(fields[1]) +
+                    ", expected " + std::to_string(cols) + "x" + std::to_string(rows));
+            }
+            if (fields[2] == 0 || fields[2] > 255) {
+                throw std::runtime_error("Only 8-bit PGM images are supported: " + path);
+            }
+            if (size < offset + rows * cols) {
+                throw std::runtime_error("Truncated PGM image: " + path);
+            }
+            maxValue = fields[2];
+        }
+        else if (size != rows * cols) {
+            throw std::runtime_error(path + " is neither a binary PGM nor " + std::to_string(rows) + "x" +
+                std::to_string(cols) + " raw bytes");
+        }
+        pixels.assign(bytes + offset, bytes + offset + rows * cols);
+        if (maxValue != 255) {
+            for (std::uint8_t& p : pixels) {
+                p = static_cast<std::uint8_t>(std::min<std::size_t>(p, maxValue) * 255 / maxValue);
+            }
+        }
+    }
+
+    template <typename T>
+    std::pair<std::vector<std::vector<T>>, std::vector<int>>
+        readMNISTImagesAndLabels(const std::string& imagesPath, const std::string& labelsPath)
+    {
+        MNISTSet set = openMNIST(imagesPath, labelsPath);
+
+        std::vector<int> labels(set.size());
+        for (std::size_t i = 0; i < set.size(); ++i) {
+            labels[i] = set.label(i);
+        }
+
+        std::vector<std::vector<T>> images(set.size(), std::vector<T>(set.imageSize()));
+        for (std::size_t i = 0; i < set.size(); ++i) {
+            normalize(set.image(i), set.imageSize(), images[i].data());
+        }
+
+        return { std::move(images), std::move(labels) };
+    }
+
+    template std::pair<std::vector<std::vector<float>>, std::vector<int>>
+        readMNISTImagesAndLabels<float>(const std::string&, const std::string&);
+    template std::pair<std::vector<std::vector<double>>, std::vector<int>>
+        readMNISTImagesAndLabels<double>(const std::string&, const std::string&);
+}
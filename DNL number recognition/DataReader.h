@@ -1,88 +1,120 @@
 #pragma once
-#include <iostream>
-#include <fstream>
-#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
-#include <cstdint>
+
+#include "math.h"
 
 namespace DataReader {
-    uint32_t readBigEndianUInt32(std::ifstream& ifs) {
-        unsigned char bytes[4];
-        if (!ifs.read(reinterpret_cast<char*>(bytes), 4)) {
-            throw std::runtime_error("Error: unable to read 4 bytes from file.");
-        }
-        // Convert from big-endian to host-endian
+    // Convert 4 big-endian bytes to a host-endian value
+    inline uint32_t readBigEndianUInt32(const std::uint8_t* bytes) {
         return (uint32_t(bytes[0]) << 24) |
             (uint32_t(bytes[1]) << 16) |
             (uint32_t(bytes[2]) << 8) |
             uint32_t(bytes[3]);
     }
 
+    /*
+
+     Read-only memory mapping of a whole file.
+     The bytes stay valid for as long as the MappedFile lives.
+
+    */
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const std::string& path);
+        ~MappedFile();
+
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const std::uint8_t* data() const { return data_t; }
+        std::size_t size() const { return length_t; }
+
+    private:
+        void unmap();
+
+        const std::uint8_t* data_t = nullptr;
+        std::size_t length_t = 0;
+#ifdef _WIN32
+        void* file_t = nullptr;    // HANDLE
+        void* mapping_t = nullptr; // HANDLE
+#endif
+    };
+
+    /*
+
+     An IDX file of unsigned bytes (the MNIST format): big-endian magic and
+     dimensions, then the payload. The header is validated when the file is
+     opened; the payload is used in place from the mapping.
+
+    */
+    class IdxFile {
+    public:
+        IdxFile() = default;
+        // expectedMagic: 2049 for labels (1 dimension), 2051 for images (3 dimensions)
+        IdxFile(const std::string& path, std::uint32_t expectedMagic);
+
+        const std::vector<std::size_t>& dims() const { return dims_t; }
+        // Number of items (the first dimension) and bytes per item (the product of the rest)
+        std::size_t count() const { return dims_t.empty() ? 0 : dims_t[0]; }
+        std::size_t itemSize() const { return itemSize_t; }
+
+        const std::uint8_t* data() const { return payload_t; }
+        const std::uint8_t* item(std::size_t i) const { return payload_t + i * itemSize_t; }
+
+    private:
+        MappedFile file_t;
+        std::vector<std::size_t> dims_t;
+        std::size_t itemSize_t = 0;
+        const std::uint8_t* payload_t = nullptr;
+    };
+
+    // Matching MNIST image and label files, as raw bytes
+    struct MNISTSet {
+        IdxFile images;
+        IdxFile labels;
+
+        std::size_t size() const { return labels.count(); }
+        std::size_t rows() const { return images.dims()[1]; }
+        std::size_t cols() const { return images.dims()[2]; }
+        std::size_t imageSize() const { return images.itemSize(); }
+
+        // Contiguous [size()][imageSize()] pixels in [0..255]
+        const std::uint8_t* pixels() const { return images.data(); }
+        const std::uint8_t* image(std::size_t i) const { return images.item(i); }
+        int label(std::size_t i) const { return labels.data()[i]; }
+    };
+
+    // Map both files and check they describe the same number of samples
+    MNISTSet openMNIST(const std::string& imagesPath, const std::string& labelsPath);
+
+    /*
+
+     Read one 8-bit grayscale image: a binary PGM ("P5", maxval up to 255) of any
+     size, or any other file as raw rows x cols bytes (its size must match).
+     Pixels go row by row into `pixels` (resized), scaled to [0..255] if the PGM's
+     maxval is lower.
+
+    */
+    void readGrayImage(const std::string& path, std::size_t rows, std::size_t cols, std::vector<std::uint8_t>& pixels);
+
+    // Scale n pixels from [0..255] to [0..1] (SIMD, see math::scaleBytes)
+    template <typename T>
+    void normalize(const std::uint8_t* pixels, std::size_t n, T* dst) {
+        math::scaleBytes(pixels, n, T(1) / T(255), dst);
+    }
+
     // Read MNIST images & labels from the given file paths.
 // Returns a pair: (images, labels)
-//   - images: shape [num_samples][rows*cols], each pixel in [0..255]
+//   - images: shape [num_samples][rows*cols], each pixel scaled to [0..1] as T (float or double)
 //   - labels: shape [num_samples], each label in [0..9]
-    static std::pair<std::vector<std::vector<double>>, std::vector<int>>
-        readMNISTImagesAndLabels(const std::string& imagesPath, const std::string& labelsPath)
-    {
-        // 1) Read labels
-        std::ifstream labelsFile(labelsPath, std::ios::binary);
-        if (!labelsFile) {
-            throw std::runtime_error("Cannot open labels file: " + labelsPath);
-        }
-        uint32_t magic = readBigEndianUInt32(labelsFile);
-        if (magic != 2049) {
-            throw std::runtime_error("Invalid magic number in labels file (expected 2049).");
-        }
-        uint32_t numLabels = readBigEndianUInt32(labelsFile);
-
-        std::vector<int> labels(numLabels);
-        for (uint32_t i = 0; i < numLabels; ++i) {
-            unsigned char labelByte;
-            if (!labelsFile.read(reinterpret_cast<char*>(&labelByte), 1)) {
-                throw std::runtime_error("Error reading label data.");
-            }
-            labels[i] = static_cast<int>(labelByte);
-        }
-        labelsFile.close();
-
-        // 2) Read images
-        std::ifstream imagesFile(imagesPath, std::ios::binary);
-        if (!imagesFile) {
-            throw std::runtime_error("Cannot open images file: " + imagesPath);
-        }
-        magic = readBigEndianUInt32(imagesFile);
-        if (magic != 2051) {
-            throw std::runtime_error("Invalid magic number in images file (expected 2051).");
-        }
-        uint32_t numImages = readBigEndianUInt32(imagesFile);
-        uint32_t numRows = readBigEndianUInt32(imagesFile);
-        uint32_t numCols = readBigEndianUInt32(imagesFile);
-
-        // Check label/image count
-        if (numImages != numLabels) {
-            // Typically they match (e.g., 60000/60000 for training, 10000/10000 for test)
-            // but let's just warn
-            throw std::runtime_error("Mismatch: number of images != number of labels.");
-        }
-
-        // Read image data
-        const size_t imageSize = static_cast<size_t>(numRows) * numCols; // 28*28=784
-        std::vector<std::vector<double>> images(numImages, std::vector<double>(imageSize));
-
-        for (uint32_t i = 0; i < numImages; ++i) {
-            for (uint32_t px = 0; px < imageSize; ++px) {
-                unsigned char pixelByte;
-                if (!imagesFile.read(reinterpret_cast<char*>(&pixelByte), 1)) {
-                    throw std::runtime_error("Error reading image data.");
-                }
-                // Scale pixel from [0..255] to [0..1]
-                images[i][px] = static_cast<double>(pixelByte) / 255.0;
-            }
-        }
-        imagesFile.close();
-
-        return { images, labels };
-    }
-}
\ No newline at end of file
+    template <typename T = double>
+    std::pair<std::vector<std::vector<T>>, std::vector<int>>
+        readMNISTImagesAndLabels(const std::string& imagesPath, const std::string& labelsPath);
+}
@@ -0,0 +1,471 @@
+#include "InferenceServer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+
+#include "DataReader.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr char kServerMagic[4] = { 'D', 'N', 'L', 'S' };
+    constexpr std::uint32_t kProtocolVersion = 1;
+
+#ifdef _WIN32
+    const std::intptr_t kInvalidSocket = static_cast<std::intptr_t>(INVALID_SOCKET);
+
+    void startNetwork() {
+        struct Winsock {
+            Winsock() { WSADATA data; WSAStartup(MAKEWORD(2, 2), &data); }
+            ~Winsock() { WSACleanup(); }
+        };
+        static Winsock winsock;
+    }
+    void closeSocket(std::intptr_t s) { closesocket(static_cast<SOCKET>(s)); }
+    void shutdownSocket(std::intptr_t s) { shutdown(static_cast<SOCKET>(s), SD_BOTH); }
+    constexpr int kSendFlags = 0;
+#else
+    const std::intptr_t kInvalidSocket = -1;
+
+    void startNetwork() {}
+    void closeSocket(std::intptr_t s) { ::close(static_cast<int>(s)); }
+    void shutdownSocket(std::intptr_t s) { ::shutdown(static_cast<int>(s), SHUT_RDWR); }
+#ifdef MSG_NOSIGNAL
+    constexpr int kSendFlags = MSG_NOSIGNAL; // a closed peer is an error, not a SIGPIPE
+#else
+    constexpr int kSendFlags = 0;
+#endif
+#endif
+
+    bool sendAll(std::intptr_t s, const void* data, std::size_t n) {
+        const char* p = static_cast<const char*>(data);
+        while (n > 0) {
+            const auto sent = ::send(s, p, static_cast<int>(std::min<std::size_t>(n, 1 << 20)), kSendFlags);
+            if (sent <= 0) {
+                return false;
+            }
+            p += sent;
+            n -= static_cast<std::size_t>(sent);
+        }
+        return true;
+    }
+
+    bool recvAll(std::intptr_t s, void* data, std::size_t n) {
+        char* p = static_cast<char*>(data);
+        while (n > 0) {
+            const auto got = ::recv(s, p, static_cast<int>(std::min<std::size_t>(n, 1 << 20)), 0);
+            if (got <= 0) {
+                return false;
+            }
+            p += got;
+            n -= static_cast<std::size_t>(got);
+        }
+        return true;
+    }
+
+    struct Endpoint {
+        bool local = false; // Unix domain socket
+        std::string path;
+        std::uint16_t port = 0;
+    };
+
+    Endpoint parseEndpoint(const std::string& text) {
+        Endpoint endpoint;
+        if (text.rfind("unix:", 0) == 0 && text.size() > 5) {
+#ifdef _WIN32
+            throw std::runtime_error("Unix domain sockets are not supported on Windows: " + text);
+#else
+            endpoint.local = true;
+            endpoint.path = text.substr(5);
+            return endpoint;
+#endif
+        }
+        if (text.rfind("tcp:", 0) == 0) {
+            const unsigned long port = std::stoul(text.substr(4));
+            if (port == 0 || port > 65535) {
+                throw std::runtime_error("Invalid port in " + text);
+            }
+            endpoint.port = static_cast<std::uint16_t>(port);
+            return endpoint;
+        }
+        throw std::runtime_error("Endpoint must be tcp:<port> or unix:<path>, got " + text);
+    }
+
+    // A connected or bound socket for the endpoint; throws on failure
+    std::intptr_t openSocket(const Endpoint& endpoint, bool listen) {
+        startNetwork();
+        sockaddr_storage address{};
+        socklen_t length = 0;
+        int family = AF_INET;
+        if (endpoint.local) {
+#ifndef _WIN32
+            sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&address);
+            if (endpoint.path.size() >= sizeof(un->sun_path)) {
+                throw std::runtime_error("Socket path too long: " + endpoint.path);
+            }
+            un->sun_family = AF_UNIX;
+            std::memcpy(un->sun_path, endpoint.path.c_str(), endpoint.path.size() + 1);
+            length = sizeof(sockaddr_un);
+            family = AF_UNIX;
+#endif
+        }
+        else {
+            sockaddr_in* in = reinterpret_cast<sockaddr_in*>(&address);
+            in->sin_family = AF_INET;
+            in->sin_port = htons(endpoint.port);
+            in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            length = sizeof(sockaddr_in);
+        }
+
+        const std::intptr_t s = static_cast<std::intptr_t>(::socket(family, SOCK_STREAM, 0));
+        if (s == kInvalidSocket) {
+            throw std::runtime_error("Cannot create a socket");
+        }
+        const int one = 1;
+        bool ok;
+        if (listen) {
+            if (endpoint.local) {
+#ifndef _WIN32
+                ::unlink(endpoint.path.c_str());
+#endif
+            }
+            else {
+                setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+            }
+            ok = ::bind(s, reinterpret_cast<const sockaddr*>(&address), length) == 0 && ::listen(s, 64) == 0;
+        }
+        else {
+            ok = ::connect(s, reinterpret_cast<const sockaddr*>(&address), length) == 0;
+        }
+        if (!ok) {
+            closeSocket(s);
+            throw std::runtime_error(std::string(listen ? "Cannot listen on " : "Cannot connect to ") +
+                (endpoint.local ? "unix:" + endpoint.path : "tcp:" + std::to_string(endpoint.port)));
+        }
+        if (!endpoint.local) {
+            // Requests and answers are small: send them now rather than waiting to fill a packet
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+        }
+        return s;
+    }
+}
+
+template <typename T>
+MicroBatcher<T>::MicroBatcher(const BasicModel<T>& model, const BatchingConfig& config)
+    : model_t(model), config_t(config), pool_t(config.threads)
+{
+    config_t.maxBatch = std::max<std::size_t>(1, config_t.maxBatch);
+    batch_t.assign(config_t.maxBatch, std::vector<T>(model.inputSize()));
+    running_t.reserve(config_t.maxBatch);
+    latencies_t.reserve(kLatencyWindow);
+    thread_t = std::thread([this] { run(); });
+}
+
+template <typename T>
+MicroBatcher<T>::~MicroBatcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_t);
+        stop_t = true;
+    }
+    wake_t.notify_one();
+    thread_t.join();
+}
+
+template <typename T>
+int MicroBatcher<T>::classify(const T* input, T* probs)
+{
+    Request request{ input, probs, Clock::now() };
+    std::unique_lock<std::mutex> lock(mutex_t);
+    queue_t.push_back(&request);
+    maxQueueDepth_t = std::max(maxQueueDepth_t, queue_t.size());
+    // The scheduler only needs waking for the first request or a full batch
+    if (queue_t.size() == 1 || queue_t.size() == config_t.maxBatch) {
+        wake_t.notify_one();
+    }
+    done_t.wait(lock, [&] { return request.done; });
+    return request.label;
+}
+
+template <typename T>
+void MicroBatcher<T>::run()
+{
+    const std::size_t inputs = model_t.inputSize();
+    const std::size_t outputs = model_t.outputSize();
+
+    std::unique_lock<std::mutex> lock(mutex_t);
+    while (true) {
+        wake_t.wait(lock, [&] { return stop_t || !queue_t.empty(); });
+        if (queue_t.empty()) {
+            return; // stopping, and every request has been answered
+        }
+
+        // Give the batch until its oldest request's deadline to fill up
+        const Clock::time_point deadline = queue_t.front()->submitted + config_t.maxDelay;
+        wake_t.wait_until(lock, deadline, [&] { return stop_t || queue_t.size() >= config_t.maxBatch; });
+
+        const std::size_t count = std::min(config_t.maxBatch, queue_t.size());
+        running_t.assign(queue_t.begin(), queue_t.begin() + count);
+        queue_t.erase(queue_t.begin(), queue_t.begin() + count);
+        lock.unlock();
+
+        for (std::size_t i = 0; i < count; ++i) {
+            std::copy(running_t[i]->input, running_t[i]->input + inputs, batch_t[i].data());
+        }
+        std::vector<int> labels = model_t.predictBatch(std::span<const std::vector<T>>(batch_t.data(), count), pool_t, &probs_t);
+        const Clock::time_point finished = Clock::now();
+
+        lock.lock();
+        for (std::size_t i = 0; i < count; ++i) {
+            Request& request = *running_t[i];
+            request.label = labels[i];
+            if (request.probs) {
+                std::copy(probs_t.data() + i * outputs, probs_t.data() + (i + 1) * outputs, request.probs);
+            }
+            request.done = true;
+
+            const double latency = std::chrono::duration<double, std::micro>(finished - request.submitted).count();
+            if (latencies_t.size() < kLatencyWindow) {
+                latencies_t.push_back(latency);
+            }
+            else {
+                latencies_t[requests_t % kLatencyWindow] = latency;
+            }
+            ++requests_t;
+        }
+        ++batches_t;
+        done_t.notify_all();
+    }
+}
+
+template <typename T>
+typename MicroBatcher<T>::Stats MicroBatcher<T>::stats() const
+{
+    Stats stats;
+    std::vector<double> latencies;
+    {
+        std::lock_guard<std::mutex> lock(mutex_t);
+        stats.queueDepth = queue_t.size();
+        stats.maxQueueDepth = maxQueueDepth_t;
+        stats.requests = requests_t;
+        stats.batches = batches_t;
+        latencies = latencies_t;
+    }
+    if (stats.batches > 0) {
+        stats.meanBatch = static_cast<double>(stats.requests) / static_cast<double>(stats.batches);
+    }
+    auto percentile = [&](double q) {
+        auto nth = latencies.begin() + std::min(latencies.size() - 1, static_cast<std::size_t>(q * latencies.size()));
+        std::nth_element(latencies.begin(), nth, latencies.end());
+        return *nth;
+    };
+    if (!latencies.empty()) {
+        stats.p50Us = percentile(0.5);
+        stats.p99Us = percentile(0.99);
+    }
+    return stats;
+}
+
+template <typename T>
+InferenceServer<T>::InferenceServer(MicroBatcher<T>& batcher, const std::string& endpoint)
+    : batcher_t(batcher)
+{
+    const Endpoint parsed = parseEndpoint(endpoint);
+    listener_t = openSocket(parsed, true);
+    if (parsed.local) {
+        unixPath_t = parsed.path;
+    }
+}
+
+template <typename T>
+InferenceServer<T>::~InferenceServer()
+{
+    stop();
+    std::lock_guard<std::mutex> lock(mutex_t);
+    for (Connection& connection : connections_t) {
+        shutdownSocket(connection.socket); // ends the connection thread's blocking receive
+    }
+    for (Connection& connection : connections_t) {
+        connection.thread.join();
+        closeSocket(connection.socket);
+    }
+#ifndef _WIN32
+    closeSocket(listener_t);
+    if (!unixPath_t.empty()) {
+        ::unlink(unixPath_t.c_str());
+    }
+#endif
+}
+
+template <typename T>
+void InferenceServer<T>::stop()
+{
+    if (!stop_t.exchange(true)) {
+        // Wakes serve() from accept()
+        shutdownSocket(listener_t);
+#ifdef _WIN32
+        closeSocket(listener_t);
+#endif
+    }
+}
+
+template <typename T>
+void InferenceServer<T>::serve()
+{
+    while (!stop_t) {
+        const std::intptr_t client = static_cast<std::intptr_t>(::accept(listener_t, nullptr, nullptr));
+        if (client == kInvalidSocket) {
+            if (stop_t) {
+                break;
+            }
+            continue;
+        }
+        if (unixPath_t.empty()) {
+            const int one = 1;
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_t);
+        // Reap the connections that were closed meanwhile
+        for (auto it = connections_t.begin(); it != connections_t.end();) {
+            if (it->finished) {
+                it->thread.join();
+                closeSocket(it->socket);
+                it = connections_t.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        Connection& connection = connections_t.emplace_back();
+        connection.socket = client;
+        connection.thread = std::thread([this, &connection] { handle(connection); });
+    }
+}
+
+template <typename T>
+void InferenceServer<T>::handle(Connection& connection)
+{
+    const std::intptr_t s = connection.socket;
+    const std::uint32_t hello[3] = { kProtocolVersion,
+        static_cast<std::uint32_t>(batcher_t.inputSize()), static_cast<std::uint32_t>(batcher_t.outputSize()) };
+
+    std::vector<std::uint8_t> pixels(batcher_t.inputSize());
+    std::vector<T> input(batcher_t.inputSize());
+    std::vector<T> probs(batcher_t.outputSize());
+    std::vector<char> answer(sizeof(std::int32_t) + batcher_t.outputSize() * sizeof(float));
+
+    bool ok = sendAll(s, kServerMagic, sizeof(kServerMagic)) && sendAll(s, hello, sizeof(hello));
+    char op = 0;
+    while (ok && recvAll(s, &op, 1)) {
+        if (op == 'C') {
+            if (!recvAll(s, pixels.data(), pixels.size())) {
+                break;
+            }
+            DataReader::normalize(pixels.data(), pixels.size(), input.data());
+            const std::int32_t label = batcher_t.classify(input.data(), probs.data());
+            std::memcpy(answer.data(), &label, sizeof(label));
+            for (std::size_t i = 0; i < probs.size(); ++i) {
+                const float p = static_cast<float>(probs[i]);
+                std::memcpy(answer.data() + sizeof(label) + i * sizeof(float), &p, sizeof(p));
+            }
+            ok = sendAll(s, answer.data(), answer.size());
+        }
+        else if (op == 'S') {
+            const std::string json = statsJson();
+            const std::uint32_t length = static_cast<std::uint32_t>(json.size());
+            ok = sendAll(s, &length, sizeof(length)) && sendAll(s, json.data(), json.size());
+        }
+        else {
+            break; // unknown request: drop the connection
+        }
+    }
+    connection.finished = true;
+}
+
+template <typename T>
+std::string InferenceServer<T>::statsJson() const
+{
+    const typename MicroBatcher<T>::Stats stats = batcher_t.stats();
+    std::ostringstream out;
+    out << "{\"queue_depth\":" << stats.queueDepth
+        << ",\"max_queue_depth\":" << stats.maxQueueDepth
+        << ",\"requests\":" << stats.requests
+        << ",\"batches\":" << stats.batches
+        << ",\"mean_batch\":" << stats.meanBatch
+        << ",\"p50_us\":" << stats.p50Us
+        << ",\"p99_us\":" << stats.p99Us << "}";
+    return out.str();
+}
+
+InferenceClient::InferenceClient(const std::string& endpoint)
+    : socket_t(openSocket(parseEndpoint(endpoint), false))
+{
+    char magic[4];
+    std::uint32_t hello[3];
+    if (!recvAll(socket_t, magic, sizeof(magic)) || std::memcmp(magic, kServerMagic, sizeof(magic)) != 0 ||
+        !recvAll(socket_t, hello, sizeof(hello)) || hello[0] != kProtocolVersion) {
+        closeSocket(socket_t);
+        throw std::runtime_error("Not an inference server: " + endpoint);
+    }
+    inputSize_t = hello[1];
+    classes_t = hello[2];
+    buffer_t.resize(std::max(1 + inputSize_t, sizeof(std::int32_t) + classes_t * sizeof(float)));
+}
+
+InferenceClient::~InferenceClient()
+{
+    closeSocket(socket_t);
+}
+
+int InferenceClient::classify(const std::uint8_t* pixels, float* probs)
+{
+    // One send per request: with TCP_NODELAY a separate op byte would be its own packet
+    buffer_t[0] = 'C';
+    std::memcpy(buffer_t.data() + 1, pixels, inputSize_t);
+    if (!sendAll(socket_t, buffer_t.data(), 1 + inputSize_t) ||
+        !recvAll(socket_t, buffer_t.data(), sizeof(std::int32_t) + classes_t * sizeof(float))) {
+        throw std::runtime_error("Lost the connection to the inference server");
+    }
+    std::int32_t label;
+    std::memcpy(&label, buffer_t.data(), sizeof(label));
+    if (probs) {
+        std::memcpy(probs, buffer_t.data() + sizeof(label), classes_t * sizeof(float));
+    }
+    return label;
+}
+
+std::string InferenceClient::stats()
+{
+    const char op = 'S';
+    std::uint32_t length = 0;
+    if (!sendAll(socket_t, &op, 1) || !recvAll(socket_t, &length, sizeof(length))) {
+        throw std::runtime_error("Lost the connection to the inference server");
+    }
+    std::string json(length, '\0');
+    if (!recvAll(socket_t, json.data(), length)) {
+        throw std::runtime_error("Lost the connection to the inference server");
+    }
+    return json;
+}
+
+template class MicroBatcher<float>;
+template class MicroBatcher<double>;
+template class InferenceServer<float>;
+template class InferenceServer<double>;
@@ -0,0 +1,182 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Model.h"
+#include "ThreadPool.h"
+
+struct BatchingConfig
+{
+    // A batch runs as soon as it has maxBatch requests, or when its oldest request
+    // has waited maxDelay: a lone request pays at most maxDelay extra latency
+    std::size_t maxBatch = 32;
+    std::chrono::microseconds maxDelay{ 500 };
+
+    // Threads of the batched forward pass (0 = all hardware threads)
+    std::size_t threads = 1;
+};
+
+/*
+
+ Coalesces concurrent single-image requests into micro-batches for one resident
+ model, so every batch reads the weights once for all of its requests (predictBatch)
+ instead of once per request. Any number of threads may call classify(); one
+ scheduler thread forms and runs the batches.
+
+*/
+template <typename T>
+class MicroBatcher
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        std::size_t queueDepth = 0;    // requests waiting right now
+        std::size_t maxQueueDepth = 0;
+        std::uint64_t requests = 0;    // answered so far
+        std::uint64_t batches = 0;
+        double meanBatch = 0.0;
+        double p50Us = 0.0;            // request latency (queueing + inference) over the
+        double p99Us = 0.0;            // last kLatencyWindow requests
+    };
+
+    static constexpr std::size_t kLatencyWindow = 4096;
+
+    MicroBatcher(const BasicModel<T>& model, const BatchingConfig& config);
+    ~MicroBatcher();
+
+    MicroBatcher(const MicroBatcher&) = delete;
+    MicroBatcher& operator=(const MicroBatcher&) = delete;
+
+    // Classify one image of model.inputSize() values; blocks until its batch ran.
+    // probs, if given, receives model.outputSize() probabilities.
+    int classify(const T* input, T* probs = nullptr);
+
+    Stats stats() const;
+
+    std::size_t inputSize() const { return model_t.inputSize(); }
+    std::size_t outputSize() const { return model_t.outputSize(); }
+
+private:
+    struct Request {
+        const T* input;
+        T* probs;
+        Clock::time_point submitted;
+        int label = -1;
+        bool done = false;
+    };
+
+    void run();
+
+    const BasicModel<T>& model_t;
+    BatchingConfig config_t;
+    ThreadPool pool_t;
+
+    mutable std::mutex mutex_t;
+    std::condition_variable wake_t; // scheduler: requests arrived / stop
+    std::condition_variable done_t; // callers: a batch finished
+    std::deque<Request*> queue_t;
+    bool stop_t = false;
+
+    // Scheduler only: the batch being run
+    std::vector<std::vector<T>> batch_t;
+    std::vector<Request*> running_t;
+    std::vector<T> probs_t;
+
+    // Statistics, guarded by mutex_t
+    std::size_t maxQueueDepth_t = 0;
+    std::uint64_t requests_t = 0;
+    std::uint64_t batches_t = 0;
+    std::vector<double> latencies_t; // ring of the last kLatencyWindow, in microseconds
+
+    std::thread thread_t;
+};
+
+/*
+
+ Serves a MicroBatcher over a local socket, one thread per connection.
+ Endpoints are "tcp:<port>" (bound to 127.0.0.1 only) or "unix:<path>" (not on Windows).
+
+ Protocol (host byte order): on connect the server sends
+ "DNLS" | u32 version | u32 input size | u32 classes. Then, per request:
+   'C' + input size pixel bytes (0..255, row by row)  ->  i32 label | classes x f32 probabilities
+   'S'                                                ->  u32 length | JSON statistics
+ Requests on one connection are answered in order; concurrent connections are
+ batched together.
+
+*/
+template <typename T>
+class InferenceServer
+{
+public:
+    InferenceServer(MicroBatcher<T>& batcher, const std::string& endpoint);
+    ~InferenceServer();
+
+    InferenceServer(const InferenceServer&) = delete;
+    InferenceServer& operator=(const InferenceServer&) = delete;
+
+    // Accept connections until stop() is called from another thread
+    void serve();
+    void stop();
+
+    // The statistics as sent for 'S'
+    std::string statsJson() const;
+
+private:
+    struct Connection {
+        std::intptr_t socket;
+        std::thread thread;
+        std::atomic<bool> finished{ false };
+    };
+
+    void handle(Connection& connection);
+
+    MicroBatcher<T>& batcher_t;
+    std::string unixPath_t; // removed again when the server goes away
+    std::intptr_t listener_t;
+    std::atomic<bool> stop_t{ false };
+
+    std::mutex mutex_t;
+    std::list<Connection> connections_t;
+};
+
+/*
+
+ Blocking client of an InferenceServer, for tools and tests.
+
+*/
+class InferenceClient
+{
+public:
+    explicit InferenceClient(const std::string& endpoint);
+    ~InferenceClient();
+
+    InferenceClient(const InferenceClient&) = delete;
+    InferenceClient& operator=(const InferenceClient&) = delete;
+
+    std::size_t inputSize() const { return inputSize_t; }
+    std::size_t classes() const { return classes_t; }
+
+    // pixels: inputSize() bytes; probs, if given, receives classes() values
+    int classify(const std::uint8_t* pixels, float* probs = nullptr);
+    std::string stats();
+
+private:
+    std::intptr_t socket_t;
+    std::size_t inputSize_t = 0;
+    std::size_t classes_t = 0;
+    std::vector<std::uint8_t> buffer_t;
+};
+
+extern template class MicroBatcher<float>;
+extern template class MicroBatcher<double>;
+extern template class InferenceServer<float>;
+extern template class InferenceServer<double>;
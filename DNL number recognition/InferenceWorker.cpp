@@ -0,0 +1,71 @@
+#include "InferenceWorker.h"
+
+#include <algorithm>
+
+template <typename T>
+InferenceWorker<T>::InferenceWorker(const BasicModel<T>& model)
+    : model_t(model),
+    requests_t(Request{ 0, {}, std::vector<T>(model.inputSize(), T(0)) }),
+    results_t(Result{ 0, -1, std::vector<T>(model.outputSize(), T(0)), {} })
+{
+    thread_t = std::thread([this] { run(); });
+}
+
+template <typename T>
+InferenceWorker<T>::~InferenceWorker()
+{
+    stop_t.store(true);
+    signal_t.fetch_add(1);
+    signal_t.notify_one();
+    thread_t.join();
+}
+
+template <typename T>
+std::uint64_t InferenceWorker<T>::submit()
+{
+    Request& request = requests_t.back();
+    request.sequence = ++submitted_t;
+    request.submitted = std::chrono::steady_clock::now();
+    requests_t.publish();
+    signal_t.fetch_add(1, std::memory_order_release);
+    signal_t.notify_one();
+    return submitted_t;
+}
+
+template <typename T>
+const typename InferenceWorker<T>::Result* InferenceWorker<T>::poll()
+{
+    return results_t.take() ? &results_t.front() : nullptr;
+}
+
+template <typename T>
+void InferenceWorker<T>::run()
+{
+    typename BasicModel<T>::InferenceWorkspace ws;
+    while (true) {
+        // Read the signal before looking for work: a submit after the check changes it,
+        // so the wait below returns at once instead of missing the request
+        const std::uint32_t seen = signal_t.load(std::memory_order_acquire);
+        if (stop_t.load()) {
+            return;
+        }
+        if (!requests_t.take()) {
+            signal_t.wait(seen);
+            continue;
+        }
+
+        const Request& request = requests_t.front();
+        const T* probs = model_t.infer(request.input, ws);
+        const std::size_t outputs = model_t.outputSize();
+
+        Result& result = results_t.back();
+        result.sequence = request.sequence;
+        result.probs.assign(probs, probs + outputs);
+        result.label = static_cast<int>(std::max_element(probs, probs + outputs) - probs);
+        result.latency = std::chrono::steady_clock::now() - request.submitted;
+        results_t.publish();
+    }
+}
+
+template class InferenceWorker<float>;
+template class InferenceWorker<double>;
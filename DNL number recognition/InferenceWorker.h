@@ -0,0 +1,117 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "Model.h"
+
+/*
+
+ Lock-free single-producer / single-consumer hand-off where only the newest value
+ matters: a triple buffer. The producer fills back(), publish() swaps it with the
+ shared middle slot; the consumer's take() swaps the middle slot with its front()
+ if something new was published since. Values published in between are
+ overwritten (latest wins), and neither side ever waits for the other.
+ The three values are allocated once, so no allocation happens per hand-off.
+
+*/
+template <typename V>
+class LatestSlot
+{
+public:
+    // All three slots start as copies of initial (e.g. with their buffers sized)
+    explicit LatestSlot(const V& initial = V{})
+        : values_t{ initial, initial, initial } {}
+
+    V& back() { return values_t[back_t]; }
+    const V& front() const { return values_t[front_t]; }
+    V& front() { return values_t[front_t]; }
+
+    // Producer: make back() the newest value and start writing into another one
+    void publish() {
+        back_t = static_cast<std::uint8_t>(middle_t.exchange(back_t | kFresh, std::memory_order_acq_rel) & kIndex);
+    }
+
+    // Consumer: move the newest value into front(); false if nothing new was published
+    bool take() {
+        if (!(middle_t.load(std::memory_order_relaxed) & kFresh)) {
+            return false;
+        }
+        front_t = static_cast<std::uint8_t>(middle_t.exchange(front_t, std::memory_order_acq_rel) & kIndex);
+        return true;
+    }
+
+private:
+    static constexpr std::uint8_t kIndex = 3;
+    static constexpr std::uint8_t kFresh = 4;
+
+    V values_t[3];
+    std::uint8_t back_t = 0;  // producer only
+    std::uint8_t front_t = 1; // consumer only
+    std::atomic<std::uint8_t> middle_t{ 2 };
+};
+
+/*
+
+ Runs a model's predictions on a background thread so a GUI loop never waits
+ for inference. The caller fills request() with an input and submit()s it;
+ requests the worker has not started yet are replaced by newer ones. poll()
+ returns the latest finished prediction, if there is a new one. One thread
+ submits and polls, the worker only infers: both sides are lock-free and,
+ after construction, allocation-free. The model must outlive the worker and
+ must not be trained or reloaded meanwhile.
+
+*/
+template <typename T>
+class InferenceWorker
+{
+public:
+    struct Result {
+        std::uint64_t sequence = 0; // submit() number of the request it answers
+        int label = -1;
+        std::vector<T> probs;       // softmax output
+        std::chrono::steady_clock::duration latency{}; // from submit() until the result was ready
+    };
+
+    explicit InferenceWorker(const BasicModel<T>& model);
+    ~InferenceWorker();
+
+    InferenceWorker(const InferenceWorker&) = delete;
+    InferenceWorker& operator=(const InferenceWorker&) = delete;
+
+    // The next request's input (model.inputSize() values); filled by the caller before submit()
+    std::vector<T>& request() { return requests_t.back().input; }
+
+    // Hand request() to the worker; returns its sequence number (1, 2, ...)
+    std::uint64_t submit();
+
+    // Sequence number of the last submit() (0 before the first)
+    std::uint64_t submitted() const { return submitted_t; }
+
+    // The newest result not returned before, or nullptr. Valid until the next poll().
+    const Result* poll();
+
+private:
+    struct Request {
+        std::uint64_t sequence = 0;
+        std::chrono::steady_clock::time_point submitted;
+        std::vector<T> input;
+    };
+
+    void run();
+
+    const BasicModel<T>& model_t;
+    LatestSlot<Request> requests_t;
+    LatestSlot<Result> results_t;
+    std::uint64_t submitted_t = 0;
+
+    // Bumped on every submit and on shutdown; the worker sleeps on it when idle
+    std::atomic<std::uint32_t> signal_t{ 0 };
+    std::atomic<bool> stop_t{ false };
+    std::thread thread_t;
+};
+
+extern template class InferenceWorker<float>;
+extern template class InferenceWorker<double>;
@@ -1,77 +1,326 @@
 #include "Model.h"
+#include "Validation.h"
 
-Model::Model(std::size_t inputSize, std::size_t hiddenSize, std::size_t outputSize, double lr) {
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+    // Model file, version 3: a fixed FileHeader, zero padding up to dataOffset,
+    // then the parameter buffer exactly as BasicModel keeps it in memory
+    // ([ W1^T | b1 | W2 | b2 ], every row and section padded to `alignment` bytes).
+    // dataOffset is a multiple of the alignment, so a page-aligned mapping of
+    // the file can be handed to the kernels as it is.
+    //
+    // Version 2 files have the same header but store W1 hidden-major (one row
+    // per hidden unit). Version 1 files hold the same magic, version and bytes
+    // per value, then u64 inputSize | u64 hiddenSize | u64 outputSize and
+    // unpadded, hidden-major rows. Files written before the header existed start
+    // directly with the sizes and always hold doubles. loadModel still reads all
+    // of them.
+    constexpr char kModelMagic[4] = { 'D', 'N', 'L', 'M' };
+    constexpr std::uint32_t kModelVersion = 3;
+    constexpr std::uint32_t kHiddenMajorVersion = 2;
+    constexpr std::uint32_t kEndianTag = 0x01020304;
+
+    struct FileHeader {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t endianTag;      // reads back differently on a machine of the other endianness
+        std::uint32_t scalarBytes;    // 4 = float, 8 = double
+        std::uint32_t alignment;      // bytes
+        std::uint32_t layerCount;     // dense layers, shapes[i] = { outputs, inputs }
+        std::uint64_t shapes[2][2];
+        std::uint64_t dataOffset;
+        std::uint64_t dataBytes;
+        std::uint32_t dataCrc;        // CRC-32 of the parameter buffer
+        std::uint32_t headerCrc;      // CRC-32 of every header byte before this field
+    };
+    static_assert(sizeof(FileHeader) == 80, "FileHeader must not contain padding");
+
+    // Offsets (in values) of the sections of the parameter buffer
+    struct ParamLayout {
+        bool w1InputMajor;            // W1 stored transposed (version 3) or one row per hidden unit
+        std::size_t w1Stride, w2Stride;
+        std::size_t b1Offset, w2Offset, b2Offset;
+        std::size_t count;
+    };
+
+    ParamLayout paramLayout(std::size_t scalarBytes, std::size_t alignment,
+        std::size_t in, std::size_t hid, std::size_t out, bool w1InputMajor = true)
+    {
+        const std::size_t perLine = std::max<std::size_t>(1, alignment / scalarBytes);
+        auto stride = [perLine](std::size_t n) { return (n + perLine - 1) / perLine * perLine; };
+
+        ParamLayout l;
+        l.w1InputMajor = w1InputMajor;
+        l.w1Stride = stride(w1InputMajor ? hid : in);
+        l.w2Stride = stride(hid);
+        l.b1Offset = (w1InputMajor ? in : hid) * l.w1Stride;
+        l.w2Offset = l.b1Offset + stride(hid);
+        l.b2Offset = l.w2Offset + out * l.w2Stride;
+        l.count = l.b2Offset + stride(out);
+        return l;
+    }
+
+    std::uint32_t headerCrc(const FileHeader& h) {
+        return utils::crc32(&h, offsetof(FileHeader, headerCrc));
+    }
+
+    // Copy out and validate a version 2 or 3 header; the caller has already matched the magic
+    FileHeader checkHeader(const std::uint8_t* bytes, std::size_t fileSize, const std::string& filename) {
+        FileHeader h;
+        if (fileSize < sizeof(FileHeader)) {
+            throw std::runtime_error("Model file is truncated: " + filename);
+        }
+        std::memcpy(&h, bytes, sizeof(h));
+        if (h.endianTag != kEndianTag) {
+            throw std::runtime_error("Model file was written with a different byte order: " + filename);
+        }
+        if (h.headerCrc != headerCrc(h)) {
+            throw std::runtime_error("Model file header is corrupt (CRC mismatch): " + filename);
+        }
+        if ((h.scalarBytes != sizeof(float) && h.scalarBytes != sizeof(double)) ||
+            h.alignment == 0 || h.alignment % h.scalarBytes != 0 || h.layerCount != 2 ||
+            h.shapes[0][0] != h.shapes[1][1] || h.dataOffset < sizeof(FileHeader)) {
+            throw std::runtime_error("Unsupported model file layout: " + filename);
+        }
+        ParamLayout l = paramLayout(h.scalarBytes, h.alignment, h.shapes[0][1], h.shapes[0][0], h.shapes[1][0],
+            h.version != kHiddenMajorVersion);
+        if (h.dataBytes != l.count * h.scalarBytes) {
+            throw std::runtime_error("Model file sizes do not match its shapes: " + filename);
+        }
+        if (fileSize < h.dataOffset || fileSize - h.dataOffset < h.dataBytes) {
+            throw std::runtime_error("Model file is truncated: " + filename);
+        }
+        return h;
+    }
+
+    std::uint32_t readU32(std::ifstream& ifs) {
+        std::uint32_t v = 0;
+        ifs.read(reinterpret_cast<char*>(&v), sizeof(v));
+        return v;
+    }
+
+    std::uint64_t readU64(std::ifstream& ifs) {
+        std::uint64_t v = 0;
+        ifs.read(reinterpret_cast<char*>(&v), sizeof(v));
+        return v;
+    }
+
+    // Convert a stored parameter buffer to T, row by row, into another layout
+    // (transposing W1 when only one of the layouts stores it input-major)
+    template <typename T, typename V>
+    void convertParams(const V* src, const ParamLayout& from, T* dst, const ParamLayout& to,
+        std::size_t in, std::size_t hid, std::size_t out)
+    {
+        auto copy = [](const V* s, std::size_t n, T* d) {
+            std::transform(s, s + n, d, [](V v) { return static_cast<T>(v); });
+        };
+        if (from.w1InputMajor == to.w1InputMajor) {
+            const std::size_t rows = to.w1InputMajor ? in : hid;
+            for (std::size_t i = 0; i < rows; ++i) {
+                copy(src + i * from.w1Stride, to.w1InputMajor ? hid : in, dst + i * to.w1Stride);
+            }
+        }
+        else {
+            const std::size_t rows = from.w1InputMajor ? in : hid;
+            const std::size_t cols = from.w1InputMajor ? hid : in;
+            for (std::size_t i = 0; i < rows; ++i) {
+                for (std::size_t j = 0; j < cols; ++j) {
+                    dst[j * to.w1Stride + i] = static_cast<T>(src[i * from.w1Stride + j]);
+                }
+            }
+        }
+        copy(src + from.b1Offset, hid, dst + to.b1Offset);
+        for (std::size_t i = 0; i < out; ++i) {
+            copy(src + from.w2Offset + i * from.w2Stride, hid, dst + to.w2Offset + i * to.w2Stride);
+        }
+        copy(src + from.b2Offset, out, dst + to.b2Offset);
+    }
+
+    // Read n stored values of scalarBytes each into dst, converting to T
+    template <typename T>
+    void readValues(std::ifstream& ifs, T* dst, std::size_t n, std::uint32_t scalarBytes) {
+        if (scalarBytes == sizeof(T)) {
+            ifs.read(reinterpret_cast<char*>(dst), n * sizeof(T));
+            return;
+        }
+        if (scalarBytes == sizeof(double)) {
+            std::vector<double> tmp(n);
+            ifs.read(reinterpret_cast<char*>(tmp.data()), n * sizeof(double));
+            std::transform(tmp.begin(), tmp.end(), dst, [](double v) { return static_cast<T>(v); });
+        }
+        else {
+            std::vector<float> tmp(n);
+            ifs.read(reinterpret_cast<char*>(tmp.data()), n * sizeof(float));
+            std::transform(tmp.begin(), tmp.end(), dst, [](float v) { return static_cast<T>(v); });
+        }
+    }
+
+    // Zero the `sparsity` fraction of R x C blocks of a rows x cols layer with the smallest
+    // L2 norm; weight(i, j) and mask(i, j) are output i's entries for input j
+    template <typename Weight, typename Mask>
+    void pruneBlocks(std::size_t rows, std::size_t cols, std::size_t R, std::size_t C, double sparsity,
+        Weight weight, Mask mask)
+    {
+        const std::size_t blockRows = (rows + R - 1) / R;
+        const std::size_t blockCols = (cols + C - 1) / C;
+        auto forEach = [&](std::size_t block, auto&& f) {
+            const std::size_t i0 = block / blockCols * R, j0 = block % blockCols * C;
+            for (std::size_t i = i0; i < std::min(rows, i0 + R); ++i) {
+                for (std::size_t j = j0; j < std::min(cols, j0 + C); ++j) {
+                    f(i, j);
+                }
+            }
+        };
+
+        // (squared norm, block); ties go to the lower block, so pruning is deterministic
+        std::vector<std::pair<double, std::size_t>> scores(blockRows * blockCols);
+        for (std::size_t b = 0; b < scores.size(); ++b) {
+            double sum = 0.0;
+            forEach(b, [&](std::size_t i, std::size_t j) {
+                const double w = static_cast<double>(weight(i, j));
+                sum += w * w;
+            });
+            scores[b] = { sum, b };
+        }
+
+        const std::size_t count = std::min(scores.size(), static_cast<std::size_t>(sparsity * scores.size()));
+        std::nth_element(scores.begin(), scores.begin() + count, scores.end());
+        for (std::size_t b = 0; b < scores.size(); ++b) {
+            forEach(b, [&](std::size_t i, std::size_t j) { mask(i, j) = 1; });
+        }
+        for (std::size_t k = 0; k < count; ++k) {
+            forEach(scores[k].second, [&](std::size_t i, std::size_t j) {
+                weight(i, j) = 0;
+                mask(i, j) = 0;
+            });
+        }
+    }
+
+    // The loss indexes the outputs with the labels: reject any that is not a class
+    void checkLabels(const int* labels, std::size_t count, std::size_t classes) {
+        for (std::size_t i = 0; i < count; ++i) {
+            if (labels[i] < 0 || static_cast<std::size_t>(labels[i]) >= classes) {
+                throw std::runtime_error("Label " + std::to_string(labels[i]) + " is not one of the " +
+                    std::to_string(classes) + " classes.");
+            }
+        }
+    }
+}
+
+template <typename T>
+BasicModel<T>::BasicModel(std::size_t inputSize, std::size_t hiddenSize, std::size_t outputSize, double lr) {
 	inputSize_t = inputSize;
 	hiddenSize_t = hiddenSize;
 	outputSize_t = outputSize;
 	learningRate_t = lr;
 
-	w1_t.resize(hiddenSize_t, std::vector<double>(inputSize_t));
-	b1_t.resize(hiddenSize_t, 0.0);
+    // Lay out [ W1^T | b1 | W2 | b2 ] in one aligned buffer
+    setShape(inputSize, hiddenSize, outputSize);
+    params_t.assign(paramCount_t, 0.0);
 
-    // Initialize W1, B1
-    w1_t.resize(hiddenSize_t, std::vector<double>(inputSize_t));
-    b1_t.resize(hiddenSize_t, 0.0);
+    // Initialize W1, B1 (biases and row padding stay zero)
+    auto W1t = w1t();
     for (std::size_t i = 0; i < hiddenSize_t; ++i) {
         for (std::size_t j = 0; j < inputSize_t; ++j) {
-            w1_t[i][j] = utils::randomWeight(0.01);
+            W1t(j, i) = utils::randomWeight(0.01);
         }
-        b1_t[i] = 0.0;
     }
 
     // Initialize W2, B2
-    w2_t.resize(outputSize_t, std::vector<double>(hiddenSize_t));
-    b2_t.resize(outputSize_t, 0.0);
+    auto W2 = w2();
     for (std::size_t i = 0; i < outputSize_t; ++i) {
         for (std::size_t j = 0; j < hiddenSize_t; ++j) {
-            w2_t[i][j] = utils::randomWeight(0.01);
+            W2(i, j) = utils::randomWeight(0.01);
         }
-        b2_t[i] = 0.0;
     }
 }
 
-std::vector<double> Model::forward(const std::vector<double>& input)
+template <typename T>
+void BasicModel<T>::setShape(std::size_t inputSize, std::size_t hiddenSize, std::size_t outputSize)
+{
+    inputSize_t = inputSize;
+    hiddenSize_t = hiddenSize;
+    outputSize_t = outputSize;
+
+    ParamLayout l = paramLayout(sizeof(T), math::kAlignment, inputSize, hiddenSize, outputSize);
+    w1Stride_t = l.w1Stride;
+    w2Stride_t = l.w2Stride;
+    b1Offset_t = l.b1Offset;
+    w2Offset_t = l.w2Offset;
+    b2Offset_t = l.b2Offset;
+    paramCount_t = l.count;
+    if (!mask_t.empty() && mask_t.size() != paramCount_t) {
+        mask_t = math::AlignedVector<T>();
+    }
+}
+
+template <typename T>
+void BasicModel<T>::makeWritable()
 {
-    // 1) hidden pre-activation: z1 = W1 * input + b1
-    z1_t = math::matVecMultiply(w1_t, input);
-    math::addBias(z1_t, b1_t);
+    if (!mapping_t) {
+        return;
+    }
+    params_t.assign(mappedParams_t, mappedParams_t + paramCount_t);
+    mapping_t.reset();
+    mappedParams_t = nullptr;
+}
+
+template <typename T>
+std::vector<T> BasicModel<T>::forward(const std::vector<T>& input)
+{
+    // Only reads the parameters, which may still be mapped
+    const BasicModel& self = *this;
+
+    // 1) hidden pre-activation: z1 = W1 * input + b1, summing the W1^T rows of the nonzero pixels
+    hidden_t.resize(hiddenSize_t);
+    math::sparsify(input.data(), input.size(), sparseInput_t);
+    math::sparseVecMat(sparseInput_t, self.w1t(), hidden_t.data());
+    math::addBias(hidden_t.data(), self.b1(), hiddenSize_t);
 
-    // 2) hidden activation = ReLU(z1)
-    hidden_t = z1_t;  // copy
+    // 2) hidden activation = ReLU(z1), in place (hidden > 0 exactly where z1 > 0)
     math::reluInPlace(hidden_t);
 
     // 3) output pre-activation: z2 = W2 * hidden + b2
-    z2_t = math::matVecMultiply(w2_t, hidden_t);
-    math::addBias(z2_t, b2_t);
+    z2_t.resize(outputSize_t);
+    math::matVecMultiply(self.w2(), hidden_t.data(), z2_t.data());
+    math::addBias(z2_t.data(), self.b2(), outputSize_t);
 
     // 4) output activation = softmax(z2)
     return math::softmax(z2_t);
 }
 
-void Model::backprop(const std::vector<double>& input, const std::vector<double>& output, const std::vector<double>& target)
+template <typename T>
+void BasicModel<T>::backprop(const std::vector<T>& input, const std::vector<T>& output, const std::vector<T>& target)
 {
+    makeWritable();
+    auto W1t = w1t();
+    auto W2 = w2();
+    T* B1 = b1();
+    T* B2 = b2();
+
     // We know that for cross-entropy & softmax:
         //   dL/d(z2) = (output - target)
-    std::vector<double> dZ2(outputSize_t);
+    // (the scratch vectors keep their capacity, so this does not allocate after the first call)
+    std::vector<T>& dZ2 = dZ2_t;
+    dZ2.resize(outputSize_t);
     for (std::size_t i = 0; i < outputSize_t; ++i) {
         dZ2[i] = output[i] - target[i];
     }
 
     // hidden was ReLU(z1).
     // We need dZ1 = (W2^T * dZ2) * ReLU'(z1).
-    std::vector<double> dZ1(hiddenSize_t, 0.0);
-
-    // For each hidden neuron j:
+    // W2^T * dZ2 is accumulated row by row: sum_i dZ2[i] * W2[i]
+    std::vector<T>& dZ1 = dZ1_t;
+    dZ1.assign(hiddenSize_t, 0.0);
+    for (std::size_t i = 0; i < outputSize_t; ++i) {
+        math::axpy(hiddenSize_t, dZ2[i], W2.row(i), dZ1.data());
+    }
+    // derivative of ReLU (hidden > 0 exactly where z1 > 0)
     for (std::size_t j = 0; j < hiddenSize_t; ++j) {
-        double grad = 0.0;
-        for (std::size_t i = 0; i < outputSize_t; ++i) {
-            grad += w2_t[i][j] * dZ2[i];
-        }
-        // derivative of ReLU
-        if (z1_t[j] > 0.0) {
-            dZ1[j] = grad;
-        }
-        else {
+        if (hidden_t[j] <= 0.0) {
             dZ1[j] = 0.0;
         }
     }
@@ -80,48 +329,142 @@ void Model::backprop(const std::vector<double>& input, const std::vector<double>
     // w2_[i][j] -= learningRate * dZ2[i] * hidden_[j]
     // b2_[i]    -= learningRate * dZ2[i]
     for (std::size_t i = 0; i < outputSize_t; ++i) {
-        for (std::size_t j = 0; j < hiddenSize_t; ++j) {
-            w2_t[i][j] -= learningRate_t * dZ2[i] * hidden_t[j];
-        }
-        b2_t[i] -= learningRate_t * dZ2[i];
+        math::axpy(hiddenSize_t, -learningRate_t * dZ2[i], hidden_t.data(), W2.row(i));
+        B2[i] -= learningRate_t * dZ2[i];
     }
 
-    // Update W1, B1
+    // Update W1, B1; only the W1^T rows of nonzero pixels change
     // w1_[j][k] -= learningRate * dZ1[j] * input[k]
     // b1_[j]    -= learningRate * dZ1[j]
+    math::sparsify(input.data(), input.size(), sparseInput_t);
+    for (std::size_t k = 0; k < sparseInput_t.nonzeros(); ++k) {
+        math::axpy(hiddenSize_t, -learningRate_t * sparseInput_t.value[k], dZ1.data(), W1t.row(sparseInput_t.index[k]));
+    }
     for (std::size_t j = 0; j < hiddenSize_t; ++j) {
-        for (std::size_t k = 0; k < inputSize_t; ++k) {
-            w1_t[j][k] -= learningRate_t * dZ1[j] * input[k];
-        }
-        b1_t[j] -= learningRate_t * dZ1[j];
+        B1[j] -= learningRate_t * dZ1[j];
     }
 }
 
-void Model::train(const std::vector<std::vector<double>>& trainInputs, const std::vector<int>& trainLabels, int epochs)
+template <typename T>
+void BasicModel<T>::train(const std::vector<std::vector<T>>& trainInputs, const std::vector<int>& trainLabels, int epochs)
+{
+    trainPerSample(trainInputs, trainLabels, epochs, nullptr);
+}
+
+template <typename T>
+void BasicModel<T>::trainPerSample(const std::vector<std::vector<T>>& trainInputs, const std::vector<int>& trainLabels, int epochs, Telemetry* telemetry)
 {
+    makeWritable();
     if (trainInputs.size() != trainLabels.size()) {
         throw std::runtime_error("Mismatch in trainInputs and trainLabels sizes.");
     }
+    if (pruned()) {
+        throw std::runtime_error("A pruned model can only be trained with mini-batches.");
+    }
+    checkLabels(trainLabels.data(), trainLabels.size(), outputSize_t);
 
     std::size_t numSamples = trainInputs.size();
+    for (const auto& input : trainInputs) {
+        if (input.size() != inputSize_t) {
+            throw std::runtime_error("Input size mismatch.");
+        }
+    }
+
+    // Every step runs on this workspace: no allocations after the first sample
+    SampleWorkspace ws;
+    reserveSample(ws);
+    ws.timed = telemetry != nullptr;
 
     for (int epoch = 0; epoch < epochs; ++epoch) {
         double totalLoss = 0.0;
+        if (telemetry) {
+            telemetry->beginEpoch(epoch);
+        }
 
         for (std::size_t i = 0; i < numSamples; ++i) {
-            // Forward
-            auto out = forward(trainInputs[i]);
+            // Forward, fused softmax + cross-entropy, backward and update
+            ws.correct = 0;
+            double loss = sgdStep(ws, trainInputs[i], trainLabels[i]);
+            totalLoss += loss;
 
-            // Build one-hot target
-            std::vector<double> target(outputSize_t, 0.0);
-            target[trainLabels[i]] = 1.0;
+            if (telemetry) {
+                telemetry->addTime(TrainPhase::Forward, ws.forwardTime);
+                telemetry->addTime(TrainPhase::Backward, ws.backwardTime);
+                telemetry->addBatch(1, loss, ws.correct);
+            }
+        }
+        if (telemetry) {
+            telemetry->endEpoch();
+        }
 
-            // Calculate loss
-            double loss = math::crossEntropy(out, target);
-            totalLoss += loss;
+        std::cout << "Epoch " << epoch
+            << " - avg loss = " << (totalLoss / numSamples)
+            << std::endl;
+    }
+}
+
+template <typename T>
+void BasicModel<T>::train(const std::vector<std::vector<T>>& trainInputs, const std::vector<int>& trainLabels, const TrainConfig& config)
+{
+    makeWritable();
+    if (config.mode == TrainMode::Hogwild) {
+        trainHogwild(trainInputs, trainLabels, config);
+        return;
+    }
+    if (config.batchSize <= 1 && config.optimizer.isPlainSGD()) {
+        trainPerSample(trainInputs, trainLabels, config.epochs, config.telemetry);
+        return;
+    }
+    if (trainInputs.size() != trainLabels.size()) {
+        throw std::runtime_error("Mismatch in trainInputs and trainLabels sizes.");
+    }
+    checkLabels(trainLabels.data(), trainLabels.size(), outputSize_t);
+    for (const auto& input : trainInputs) {
+        if (input.size() != inputSize_t) {
+            throw std::runtime_error("Input size mismatch.");
+        }
+    }
+
+    std::size_t numSamples = trainInputs.size();
+    std::vector<std::size_t> order(numSamples);
+    for (std::size_t i = 0; i < numSamples; ++i) {
+        order[i] = i;
+    }
+    std::mt19937 rng(config.seed);
+
+    const std::size_t batchSize = std::max<std::size_t>(1, config.batchSize);
+    const std::size_t batchesPerEpoch = (numSamples + batchSize - 1) / batchSize;
+    optimizer_t.reset(config.optimizer, learningRate_t, paramCount_t,
+        batchesPerEpoch, batchesPerEpoch * std::max(0, config.epochs));
+
+    ThreadPool pool(config.threads);
+    std::vector<const T*> batchInputs(batchSize);
+    std::vector<int> batchLabels(batchSize);
 
-            // Backprop
-            backprop(trainInputs[i], out, target);
+    Telemetry* telemetry = config.telemetry;
+
+    for (int epoch = 0; epoch < config.epochs; ++epoch) {
+        if (config.shuffle) {
+            std::shuffle(order.begin(), order.end(), rng);
+        }
+        if (telemetry) {
+            telemetry->beginEpoch(epoch);
+        }
+
+        double totalLoss = 0.0;
+        for (std::size_t start = 0; start < numSamples; start += batchSize) {
+            std::size_t count = std::min(batchSize, numSamples - start);
+            {
+                PhaseTimer timer(telemetry, TrainPhase::Fetch);
+                for (std::size_t b = 0; b < count; ++b) {
+                    batchInputs[b] = trainInputs[order[start + b]].data();
+                    batchLabels[b] = trainLabels[order[start + b]];
+                }
+            }
+            totalLoss += miniBatchStep(pool, batchInputs.data(), batchLabels.data(), count, telemetry);
+        }
+        if (telemetry) {
+            telemetry->endEpoch();
         }
 
         std::cout << "Epoch " << epoch
@@ -130,95 +473,907 @@ void Model::train(const std::vector<std::vector<double>>& trainInputs, const std
     }
 }
 
-int Model::predict(const std::vector<double>& input)
+template <typename T>
+void BasicModel<T>::train(AugmentStream<T>& stream, const TrainConfig& config, Validator<T>* validator)
 {
-    auto out = forward(input);
-    return static_cast<int>(
-        std::distance(out.begin(), std::max_element(out.begin(), out.end())));
+    makeWritable();
+    if (config.mode != TrainMode::Synchronous) {
+        throw std::runtime_error("Streaming training only supports synchronous mini-batches.");
+    }
+
+    optimizer_t.reset(config.optimizer, learningRate_t, paramCount_t,
+        stream.batchesPerEpoch(), stream.batchesPerEpoch() * std::max(0, config.epochs));
+
+    ThreadPool pool(config.threads);
+    std::vector<const T*> batchInputs(stream.batchSize());
+
+    Telemetry* telemetry = config.telemetry;
+
+    // Where the stream starts is where training continues
+    const std::uint64_t firstBatch = stream.config().firstBatch;
+    double resumedLoss = 0.0;
+    if (config.resume && !config.checkpointFile.empty() && std::filesystem::exists(config.checkpointFile)) {
+        resumedLoss = restoreCheckpoint(config.checkpointFile, stream, pool.size(), validator);
+    }
+    else if (firstBatch != 0) {
+        throw std::runtime_error("The stream starts at batch " + std::to_string(firstBatch) +
+            " but there is no checkpoint to resume from.");
+    }
+
+    std::unique_ptr<Checkpointer<T>> checkpointer;
+    if (!config.checkpointFile.empty()) {
+        checkpointer = std::make_unique<Checkpointer<T>>(config.checkpointFile);
+    }
+    const std::size_t checkpointEvery = std::max<std::size_t>(1, config.checkpointEvery);
+
+    // The validator state goes into a checkpoint too, as of the checkpoint's batch, so a
+    // resumed run continues from the same best and patience. The trainer's part is
+    // filled right away; the checkpoint stays open until the validator has evaluated
+    // every snapshot submitted so far, and training only waits for it when asked to
+    TrainingCheckpoint<T>* openCheckpoint = nullptr;
+    auto completeCheckpoint = [&](bool wait) {
+        if (!openCheckpoint || (validator && !wait && !validator->idle())) {
+            return;
+        }
+        if (validator) {
+            validator->finish();
+            fillValidation(*openCheckpoint, *validator);
+        }
+        checkpointer->commit();
+        openCheckpoint = nullptr;
+    };
+
+    // A run checkpointed just as its patience ran out has nothing left to train
+    const int firstEpoch = validator && validator->shouldStop()
+        ? config.epochs : static_cast<int>(firstBatch / stream.batchesPerEpoch());
+    for (int epoch = firstEpoch; epoch < config.epochs; ++epoch) {
+        if (telemetry) {
+            telemetry->beginEpoch(epoch);
+        }
+
+        const std::size_t firstIndex = epoch == firstEpoch ? firstBatch % stream.batchesPerEpoch() : 0;
+        double totalLoss = epoch == firstEpoch ? resumedLoss : 0.0;
+        for (std::size_t i = firstIndex; i < stream.batchesPerEpoch(); ++i) {
+            const typename AugmentStream<T>::Batch* batch;
+            {
+                PhaseTimer timer(telemetry, TrainPhase::Fetch);
+                batch = &stream.next();
+            }
+            if (batch->imageSize != inputSize_t) {
+                throw std::runtime_error("Input size mismatch.");
+            }
+            checkLabels(batch->labels.data(), batch->count, outputSize_t);
+            if (telemetry) {
+                telemetry->addTime(TrainPhase::Augment, batch->augmentTime);
+            }
+            for (std::size_t b = 0; b < batch->count; ++b) {
+                batchInputs[b] = batch->image(b);
+            }
+            totalLoss += miniBatchStep(pool, batchInputs.data(), batch->labels.data(), batch->count, telemetry);
+
+            const std::uint64_t done = static_cast<std::uint64_t>(epoch) * stream.batchesPerEpoch() + i + 1;
+            const std::size_t every = validator ? validator->config().every : 0;
+            const bool validate = validator && ((every && done % every == 0) || i + 1 == stream.batchesPerEpoch());
+            const bool checkpoint = checkpointer && (done % checkpointEvery == 0 || i + 1 == stream.batchesPerEpoch());
+            // An open checkpoint must hold the validator state of its own batch: past a
+            // new snapshot or checkpoint it can no longer wait for the validator to catch up
+            completeCheckpoint(validate || checkpoint);
+            if (validate) {
+                validator->submit(*this, epoch, done);
+            }
+            if (checkpoint) {
+                // The next epoch starts from a zero loss
+                const double loss = i + 1 == stream.batchesPerEpoch() ? 0.0 : totalLoss;
+                openCheckpoint = &checkpointer->begin();
+                fillCheckpoint(*openCheckpoint, stream, done, pool.size(), loss);
+                completeCheckpoint(false);
+            }
+            if (validator && validator->shouldStop()) {
+                break;
+            }
+        }
+        if (telemetry) {
+            telemetry->endEpoch();
+        }
+
+        if (validator && validator->shouldStop()) {
+            std::cout << "Epoch " << epoch << " - stopping early, validation accuracy stopped improving" << std::endl;
+            break;
+        }
+        std::cout << "Epoch " << epoch
+            << " - avg loss = " << (totalLoss / stream.epochSize())
+            << std::endl;
+    }
+
+    if (checkpointer) {
+        completeCheckpoint(true);
+        checkpointer->finish();
+    }
+    if (validator) {
+        validator->finish();
+        if (validator->config().restoreBest && validator->hasBest()) {
+            copyParams(validator->bestModel());
+            std::cout << "Keeping the weights of the best validation: "
+                << 100.0 * validator->best().accuracy << "% after batch " << validator->best().batch << std::endl;
+        }
+    }
 }
 
-void Model::saveModel(const std::string& filename) const
+template <typename T>
+void BasicModel<T>::fillCheckpoint(TrainingCheckpoint<T>& checkpoint, const AugmentStream<T>& stream,
+    std::uint64_t batch, std::size_t threads, double epochLoss) const
 {
-    std::ofstream ofs(filename, std::ios::binary);
-    if (!ofs) {
-        throw std::runtime_error("Could not open file for writing: " + filename);
+    checkpoint.batch = batch;
+    checkpoint.batchesPerEpoch = stream.batchesPerEpoch();
+    checkpoint.streamSeed = stream.config().seed;
+    checkpoint.threads = threads;
+    checkpoint.epochLoss = epochLoss;
+    checkpoint.shape = { inputSize_t, hiddenSize_t, outputSize_t };
+    checkpoint.params.assign(params(), params() + paramCount_t);
+    checkpoint.optimizerSteps = optimizer_t.steps();
+    checkpoint.firstMoment.assign(optimizer_t.firstMoment().begin(), optimizer_t.firstMoment().end());
+    checkpoint.secondMoment.assign(optimizer_t.secondMoment().begin(), optimizer_t.secondMoment().end());
+
+    checkpoint.validationHistory.clear();
+    checkpoint.hasBestValidation = false;
+    checkpoint.bestValidation = {};
+    checkpoint.bestParams.clear();
+    checkpoint.staleValidations = 0;
+}
+
+template <typename T>
+void BasicModel<T>::fillValidation(TrainingCheckpoint<T>& checkpoint, const Validator<T>& validator)
+{
+    checkpoint.validationHistory = validator.history();
+    checkpoint.hasBestValidation = validator.hasBest();
+    checkpoint.staleValidations = validator.stale();
+    if (validator.hasBest()) {
+        const BasicModel& best = validator.bestModel();
+        checkpoint.bestValidation = validator.best();
+        checkpoint.bestParams.assign(best.params(), best.params() + best.paramCount_t);
     }
+}
 
-    // 1) Write network dimensions so we can check or reconstruct on load
-    ofs.write(reinterpret_cast<const char*>(&inputSize_t), sizeof(inputSize_t));
-    ofs.write(reinterpret_cast<const char*>(&hiddenSize_t), sizeof(hiddenSize_t));
-    ofs.write(reinterpret_cast<const char*>(&outputSize_t), sizeof(outputSize_t));
+template <typename T>
+double BasicModel<T>::restoreCheckpoint(const std::string& filename, const AugmentStream<T>& stream, std::size_t threads,
+    Validator<T>* validator)
+{
+    TrainingCheckpoint<T> checkpoint = loadCheckpoint<T>(filename);
+    const std::vector<std::uint64_t> shape{ inputSize_t, hiddenSize_t, outputSize_t };
+    if (checkpoint.shape != shape || checkpoint.params.size() != paramCount_t) {
+        throw std::runtime_error("Checkpoint is for a model of another shape: " + filename);
+    }
+    if (checkpoint.streamSeed != stream.config().seed || checkpoint.batchesPerEpoch != stream.batchesPerEpoch() ||
+        checkpoint.batch != stream.config().firstBatch) {
+        throw std::runtime_error("The stream does not continue where the checkpoint stopped: " + filename);
+    }
+    if (checkpoint.threads != threads) {
+        throw std::runtime_error("Checkpoint was trained with " + std::to_string(checkpoint.threads) +
+            " threads; resume with the same number: " + filename);
+    }
+    if (checkpoint.hasBestValidation && checkpoint.bestParams.size() != paramCount_t) {
+        throw std::runtime_error("Checkpoint is for a model of another shape: " + filename);
+    }
 
-    // 2) Write w1_ (hiddenSize_ rows, each row has inputSize_ doubles)
-    for (std::size_t i = 0; i < hiddenSize_t; ++i) {
-        ofs.write(reinterpret_cast<const char*>(w1_t[i].data()),
-            inputSize_t * sizeof(double));
+    std::copy(checkpoint.params.begin(), checkpoint.params.end(), params_t.begin());
+    optimizer_t.restore(checkpoint.optimizerSteps, checkpoint.firstMoment, checkpoint.secondMoment);
+    if (validator) {
+        BasicModel best(0, 0, 0);
+        if (checkpoint.hasBestValidation) {
+            best.copyParams(*this);
+            std::copy(checkpoint.bestParams.begin(), checkpoint.bestParams.end(), best.params_t.begin());
+        }
+        validator->restore(checkpoint.validationHistory, checkpoint.hasBestValidation ? &best : nullptr,
+            checkpoint.bestValidation, static_cast<std::size_t>(checkpoint.staleValidations));
+    }
+    std::cout << "Resuming from batch " << checkpoint.batch << " (" << filename << ")" << std::endl;
+    return checkpoint.epochLoss;
+}
+
+template <typename T>
+double BasicModel<T>::miniBatchStep(ThreadPool& pool, const T* const* inputs, const int* labels, std::size_t count,
+    Telemetry* telemetry)
+{
+    const std::size_t slices = std::min(pool.size(), count);
+    const std::size_t sliceSize = (count + slices - 1) / slices;
+    const std::size_t used = (count + sliceSize - 1) / sliceSize;
+    if (workers_t.size() < slices) {
+        workers_t.resize(slices);
+    }
+
+    // 1) Each worker computes the gradient of its slice (scaled by 1/count,
+    //    so the slices add up to the batch mean)
+    pool.parallelFor(used, [&](std::size_t s) {
+        std::size_t begin = s * sliceSize;
+        std::size_t n = std::min(count, begin + sliceSize) - begin;
+        reserveBatch(workers_t[s], sliceSize);
+        workers_t[s].timed = telemetry != nullptr;
+        workers_t[s].loss = batchGradient(workers_t[s], inputs + begin, labels + begin, n, T(1) / T(count));
+    });
+
+    // 2) Sum the slices into worker 0 (always in slice order) and let the
+    //    optimizer apply the sum in the same pass, while it is still in cache.
+    //    Parameters are reduced in chunks of whole cache lines, in parallel.
+    const std::size_t reduceChunk = math::alignedStride<T>(16384);
+    const std::size_t reduceTasks = (paramCount_t + reduceChunk - 1) / reduceChunk;
+    {
+        PhaseTimer timer(telemetry, TrainPhase::Update);
+        const typename Optimizer<T>::Step step = optimizer_t.next();
+        pool.parallelFor(reduceTasks, [&](std::size_t t) {
+            std::size_t begin = t * reduceChunk;
+            std::size_t n = std::min(reduceChunk, paramCount_t - begin);
+            T* sum = workers_t[0].grads.data() + begin;
+            for (std::size_t s = 1; s < used; ++s) {
+                math::axpy(n, T(1), workers_t[s].grads.data() + begin, sum);
+            }
+            optimizer_t.apply(step, begin, n, workers_t[0].grads.data(), params_t.data());
+            if (!mask_t.empty()) {
+                // Pruned weights stay pruned, whatever the optimizer's momentum says
+                T* p = params_t.data() + begin;
+                const T* m = mask_t.data() + begin;
+                for (std::size_t i = 0; i < n; ++i) {
+                    p[i] *= m[i];
+                }
+            }
+        });
     }
 
-    // 3) Write b1_
-    ofs.write(reinterpret_cast<const char*>(b1_t.data()),
-        hiddenSize_t * sizeof(double));
+    double loss = 0.0;
+    std::size_t correct = 0;
+    for (std::size_t s = 0; s < used; ++s) {
+        loss += workers_t[s].loss;
+        correct += workers_t[s].correct;
+    }
+    if (telemetry) {
+        // The workers ran side by side, so the slowest one is the step's critical path
+        Telemetry::Clock::duration forwardTime{}, backwardTime{};
+        for (std::size_t s = 0; s < used; ++s) {
+            forwardTime = std::max(forwardTime, workers_t[s].forwardTime);
+            backwardTime = std::max(backwardTime, workers_t[s].backwardTime);
+        }
+        telemetry->addTime(TrainPhase::Forward, forwardTime);
+        telemetry->addTime(TrainPhase::Backward, backwardTime);
+        telemetry->addBatch(count, loss, correct);
+    }
+    return loss;
+}
 
-    // 4) Write w2_ (outputSize_ rows, each row has hiddenSize_ doubles)
+template <typename T>
+void BasicModel<T>::trainHogwild(const std::vector<std::vector<T>>& trainInputs, const std::vector<int>& trainLabels, const TrainConfig& config)
+{
+    if (trainInputs.size() != trainLabels.size()) {
+        throw std::runtime_error("Mismatch in trainInputs and trainLabels sizes.");
+    }
+    checkLabels(trainLabels.data(), trainLabels.size(), outputSize_t);
+    if (!config.optimizer.isPlainSGD()) {
+        throw std::runtime_error("Hogwild training only supports plain SGD at a constant learning rate.");
+    }
+    if (pruned()) {
+        throw std::runtime_error("A pruned model can only be trained with mini-batches.");
+    }
+
+    std::size_t numSamples = trainInputs.size();
+    std::vector<std::size_t> order(numSamples);
+    for (std::size_t i = 0; i < numSamples; ++i) {
+        order[i] = i;
+    }
+    std::mt19937 rng(config.seed);
+
+    ThreadPool pool(config.threads);
+    const std::size_t shards = pool.size();
+    const std::size_t shardSize = (numSamples + shards - 1) / shards;
+    std::vector<SampleWorkspace> workspaces(shards);
+    for (auto& ws : workspaces) {
+        reserveSample(ws);
+    }
+    std::vector<double> shardLoss(shards);
+    Telemetry* telemetry = config.telemetry;
+
+    for (int epoch = 0; epoch < config.epochs; ++epoch) {
+        if (config.shuffle) {
+            std::shuffle(order.begin(), order.end(), rng);
+        }
+        if (telemetry) {
+            telemetry->beginEpoch(epoch);
+        }
+        for (auto& ws : workspaces) {
+            ws.correct = 0;
+        }
+
+        // Every worker runs plain SGD over its own shard, straight on params_t
+        pool.parallelFor(shards, [&](std::size_t s) {
+            std::size_t begin = std::min(numSamples, s * shardSize);
+            std::size_t end = std::min(numSamples, begin + shardSize);
+            double loss = 0.0;
+            for (std::size_t i = begin; i < end; ++i) {
+                loss += sgdStep(workspaces[s], trainInputs[order[i]], trainLabels[order[i]]);
+            }
+            shardLoss[s] = loss;
+        });
+
+        double totalLoss = 0.0;
+        for (double loss : shardLoss) {
+            totalLoss += loss;
+        }
+        if (telemetry) {
+            std::size_t correct = 0;
+            for (const auto& ws : workspaces) {
+                correct += ws.correct;
+            }
+            telemetry->addBatch(numSamples, totalLoss, correct);
+            telemetry->endEpoch();
+        }
+
+        std::cout << "Epoch " << epoch
+            << " - avg loss = " << (totalLoss / numSamples)
+            << std::endl;
+    }
+}
+
+template <typename T>
+void BasicModel<T>::reserveSample(SampleWorkspace& ws) const
+{
+    ws.hidden.assign(hiddenSize_t, 0.0);
+    ws.probs.assign(outputSize_t, 0.0);
+    ws.delta.assign(hiddenSize_t, 0.0);
+}
+
+template <typename T>
+double BasicModel<T>::sgdStep(SampleWorkspace& ws, const std::vector<T>& input, int label)
+{
+    auto W1t = w1t();
+    auto W2 = w2();
+    T* B1 = b1();
+    T* B2 = b2();
+    T* hidden = ws.hidden.data();
+    T* dZ2 = ws.probs.data();
+    T* dZ1 = ws.delta.data();
+    Telemetry::Clock::time_point start;
+    if (ws.timed) {
+        start = Telemetry::Clock::now();
+    }
+
+    // Forward: hidden = ReLU(W1 * input + b1), z2 = W2 * hidden + b2.
+    // The first layer reads only the W1^T rows of the input's nonzero pixels.
+    math::sparsify(input.data(), inputSize_t, ws.input);
+    math::sparseVecMat(ws.input, W1t, hidden);
+    math::addBias(hidden, B1, hiddenSize_t);
+    math::reluInPlace(hidden, hiddenSize_t);
+
+    math::matVecMultiply(W2, hidden, dZ2);
+    math::addBias(dZ2, B2, outputSize_t);
+
+    // Loss, and dZ2 = softmax(z2) - onehot(label) in place of z2
+    int predicted;
+    T loss = math::softmaxCrossEntropy(dZ2, outputSize_t, label, T(1), dZ2, &predicted);
+    if (predicted == label) {
+        ++ws.correct;
+    }
+    if (ws.timed) {
+        auto now = Telemetry::Clock::now();
+        ws.forwardTime = now - start;
+        start = now;
+    }
+
+    // dZ1 = (W2^T * dZ2) * ReLU'(z1); hidden > 0 exactly where z1 > 0
+    std::fill(dZ1, dZ1 + hiddenSize_t, 0.0);
     for (std::size_t i = 0; i < outputSize_t; ++i) {
-        ofs.write(reinterpret_cast<const char*>(w2_t[i].data()),
-            hiddenSize_t * sizeof(double));
+        math::axpy(hiddenSize_t, dZ2[i], W2.row(i), dZ1);
+    }
+    for (std::size_t j = 0; j < hiddenSize_t; ++j) {
+        if (hidden[j] <= 0.0) {
+            dZ1[j] = 0.0;
+        }
     }
 
-    // 5) Write b2_
-    ofs.write(reinterpret_cast<const char*>(b2_t.data()),
-        outputSize_t * sizeof(double));
+    // Update W2, B2, then W1, B1 (only the W1^T rows of nonzero pixels)
+    for (std::size_t i = 0; i < outputSize_t; ++i) {
+        math::axpy(hiddenSize_t, -learningRate_t * dZ2[i], hidden, W2.row(i));
+        B2[i] -= learningRate_t * dZ2[i];
+    }
+    for (std::size_t k = 0; k < ws.input.nonzeros(); ++k) {
+        math::axpy(hiddenSize_t, -learningRate_t * ws.input.value[k], dZ1, W1t.row(ws.input.index[k]));
+    }
+    for (std::size_t j = 0; j < hiddenSize_t; ++j) {
+        B1[j] -= learningRate_t * dZ1[j];
+    }
 
+    if (ws.timed) {
+        ws.backwardTime = Telemetry::Clock::now() - start;
+    }
+    return loss;
+}
+
+template <typename T>
+void BasicModel<T>::reserveBatch(BatchWorkspace& ws, std::size_t batchSize) const
+{
+    if (ws.capacity >= batchSize && ws.grads.size() == paramCount_t) {
+        return;
+    }
+    const std::size_t hiddenStride = math::alignedStride<T>(hiddenSize_t);
+    const std::size_t outputStride = math::alignedStride<T>(outputSize_t);
+
+    ws.capacity = batchSize;
+    ws.x.assign(batchSize * math::alignedStride<T>(inputSize_t), 0.0);
+    ws.hidden.assign(batchSize * hiddenStride, 0.0);
+    ws.delta.assign(batchSize * hiddenStride, 0.0);
+    ws.probs.assign(batchSize * outputStride, 0.0);
+    ws.grads.assign(paramCount_t, 0.0);
+}
+
+template <typename T>
+double BasicModel<T>::batchGradient(BatchWorkspace& ws, const T* const* inputs, const int* labels, std::size_t count, T gradScale) const
+{
+    const std::size_t inputStride = math::alignedStride<T>(inputSize_t);
+    const std::size_t hiddenStride = math::alignedStride<T>(hiddenSize_t);
+    const std::size_t outputStride = math::alignedStride<T>(outputSize_t);
+    const auto W1t = w1t();
+    const auto W2 = w2();
+    const auto gW1t = w1t(ws.grads.data());
+    const auto gW2 = w2(ws.grads.data());
+    T* gB1 = ws.grads.data() + b1Offset_t;
+    T* gB2 = ws.grads.data() + b2Offset_t;
+    Telemetry::Clock::time_point start;
+    if (ws.timed) {
+        start = Telemetry::Clock::now();
+    }
+
+    // Gather the batch into X [count][inputSize]
+    for (std::size_t b = 0; b < count; ++b) {
+        std::copy(inputs[b], inputs[b] + inputSize_t, ws.x.data() + b * inputStride);
+    }
+
+    // 1) hidden = ReLU(X * W1^T + b1)
+    math::gemm(false, false, count, hiddenSize_t, inputSize_t,
+        T(1), ws.x.data(), inputStride, W1t.data, W1t.stride,
+        T(0), ws.hidden.data(), hiddenStride);
+    for (std::size_t b = 0; b < count; ++b) {
+        T* h = ws.hidden.data() + b * hiddenStride;
+        math::addBias(h, b1(), hiddenSize_t);
+        math::reluInPlace(h, hiddenSize_t);
+    }
+
+    // 2) probs = softmax(hidden * W2^T + b2)
+    math::gemm(false, true, count, outputSize_t, hiddenSize_t,
+        T(1), ws.hidden.data(), hiddenStride, W2.data, W2.stride,
+        T(0), ws.probs.data(), outputStride);
+
+    // 3) loss, and dZ2 = (softmax(z2) - onehot) * gradScale in place of z2
+    double loss = 0.0;
+    ws.correct = 0;
+    for (std::size_t b = 0; b < count; ++b) {
+        T* p = ws.probs.data() + b * outputStride;
+        math::addBias(p, b2(), outputSize_t);
+
+        int predicted;
+        loss += math::softmaxCrossEntropy(p, outputSize_t, labels[b], gradScale, p, &predicted);
+        if (predicted == labels[b]) {
+            ++ws.correct;
+        }
+    }
+
+    if (ws.timed) {
+        auto now = Telemetry::Clock::now();
+        ws.forwardTime = now - start;
+        start = now;
+    }
+
+    // 4) dW2 = dZ2^T * hidden, db2 = column sums of dZ2
+    math::gemm(true, false, outputSize_t, hiddenSize_t, count,
+        T(1), ws.probs.data(), outputStride, ws.hidden.data(), hiddenStride,
+        T(0), gW2.data, gW2.stride);
+    std::fill(gB2, gB2 + outputSize_t, 0.0);
+    for (std::size_t b = 0; b < count; ++b) {
+        math::addBias(gB2, ws.probs.data() + b * outputStride, outputSize_t);
+    }
+
+    // 5) dZ1 = (dZ2 * W2) * ReLU'(z1); hidden > 0 exactly where z1 > 0
+    math::gemm(false, false, count, hiddenSize_t, outputSize_t,
+        T(1), ws.probs.data(), outputStride, W2.data, W2.stride,
+        T(0), ws.delta.data(), hiddenStride);
+    for (std::size_t b = 0; b < count; ++b) {
+        const T* h = ws.hidden.data() + b * hiddenStride;
+        T* d = ws.delta.data() + b * hiddenStride;
+        for (std::size_t j = 0; j < hiddenSize_t; ++j) {
+            if (h[j] <= 0.0) {
+                d[j] = 0.0;
+            }
+        }
+    }
+
+    // 6) dW1^T = X^T * dZ1, db1 = column sums of dZ1
+    math::gemm(true, false, inputSize_t, hiddenSize_t, count,
+        T(1), ws.x.data(), inputStride, ws.delta.data(), hiddenStride,
+        T(0), gW1t.data, gW1t.stride);
+    std::fill(gB1, gB1 + hiddenSize_t, 0.0);
+    for (std::size_t b = 0; b < count; ++b) {
+        math::addBias(gB1, ws.delta.data() + b * hiddenStride, hiddenSize_t);
+    }
+
+    if (ws.timed) {
+        ws.backwardTime = Telemetry::Clock::now() - start;
+    }
+    return loss;
+}
+
+template <typename T>
+void BasicModel<T>::reserveInference(InferenceWorkspace& ws, std::size_t batchSize) const
+{
+    const std::size_t inputStride = math::alignedStride<T>(inputSize_t);
+    const std::size_t hiddenStride = math::alignedStride<T>(hiddenSize_t);
+    const std::size_t outputStride = math::alignedStride<T>(outputSize_t);
+
+    // Only grows, so a workspace can be shared between models of different shapes
+    if (ws.x.size() < batchSize * inputStride) {
+        ws.x.resize(batchSize * inputStride);
+    }
+    if (ws.hidden.size() < batchSize * hiddenStride) {
+        ws.hidden.resize(batchSize * hiddenStride);
+    }
+    if (ws.probs.size() < batchSize * outputStride) {
+        ws.probs.resize(batchSize * outputStride);
+    }
+}
+
+template <typename T>
+typename BasicModel<T>::InferenceWorkspace& BasicModel<T>::threadWorkspace()
+{
+    thread_local InferenceWorkspace ws;
+    return ws;
+}
+
+template <typename T>
+const T* BasicModel<T>::infer(const std::vector<T>& input, InferenceWorkspace& ws) const
+{
+    if (input.size() != inputSize_t) {
+        throw std::runtime_error("Input size mismatch.");
+    }
+    reserveInference(ws, 1);
+    T* hidden = ws.hidden.data();
+    T* probs = ws.probs.data();
+
+    math::sparsify(input.data(), inputSize_t, ws.input);
+    math::sparseVecMat(ws.input, w1t(), hidden);
+    math::addBias(hidden, b1(), hiddenSize_t);
+    math::reluInPlace(hidden, hiddenSize_t);
+
+    math::matVecMultiply(w2(), hidden, probs);
+    math::addBias(probs, b2(), outputSize_t);
+    math::softmaxInPlace(probs, outputSize_t);
+    return probs;
+}
+
+template <typename T>
+void BasicModel<T>::inferBatch(InferenceWorkspace& ws, const std::vector<T>* inputs, std::size_t count) const
+{
+    const std::size_t inputStride = math::alignedStride<T>(inputSize_t);
+    const std::size_t hiddenStride = math::alignedStride<T>(hiddenSize_t);
+    const std::size_t outputStride = math::alignedStride<T>(outputSize_t);
+    const auto W1t = w1t();
+    const auto W2 = w2();
+    reserveInference(ws, count);
+
+    for (std::size_t b = 0; b < count; ++b) {
+        if (inputs[b].size() != inputSize_t) {
+            throw std::runtime_error("Input size mismatch.");
+        }
+        std::copy(inputs[b].begin(), inputs[b].end(), ws.x.data() + b * inputStride);
+    }
+
+    // hidden = ReLU(X * W1^T + b1)
+    math::gemm(false, false, count, hiddenSize_t, inputSize_t,
+        T(1), ws.x.data(), inputStride, W1t.data, W1t.stride,
+        T(0), ws.hidden.data(), hiddenStride);
+    for (std::size_t b = 0; b < count; ++b) {
+        T* h = ws.hidden.data() + b * hiddenStride;
+        math::addBias(h, b1(), hiddenSize_t);
+        math::reluInPlace(h, hiddenSize_t);
+    }
+
+    // probs = softmax(hidden * W2^T + b2)
+    math::gemm(false, true, count, outputSize_t, hiddenSize_t,
+        T(1), ws.hidden.data(), hiddenStride, W2.data, W2.stride,
+        T(0), ws.probs.data(), outputStride);
+    for (std::size_t b = 0; b < count; ++b) {
+        T* p = ws.probs.data() + b * outputStride;
+        math::addBias(p, b2(), outputSize_t);
+        math::softmaxInPlace(p, outputSize_t);
+    }
+}
+
+template <typename T>
+int BasicModel<T>::predict(const std::vector<T>& input, InferenceWorkspace& ws) const
+{
+    const T* out = infer(input, ws);
+    return static_cast<int>(std::max_element(out, out + outputSize_t) - out);
+}
+
+template <typename T>
+int BasicModel<T>::predict(const std::vector<T>& input) const
+{
+    return predict(input, threadWorkspace());
+}
+
+template <typename T>
+std::vector<int> BasicModel<T>::predictBatch(std::span<const std::vector<T>> inputs, ThreadPool& pool, std::vector<T>* probs) const
+{
+    const std::size_t outputStride = math::alignedStride<T>(outputSize_t);
+    const std::size_t chunks = (inputs.size() + kInferenceChunk - 1) / kInferenceChunk;
+
+    std::vector<int> labels(inputs.size());
+    if (probs) {
+        probs->resize(inputs.size() * outputSize_t);
+    }
+
+    pool.parallelFor(chunks, [&](std::size_t c) {
+        std::size_t begin = c * kInferenceChunk;
+        std::size_t count = std::min(kInferenceChunk, inputs.size() - begin);
+        InferenceWorkspace& ws = threadWorkspace();
+        inferBatch(ws, inputs.data() + begin, count);
+
+        for (std::size_t b = 0; b < count; ++b) {
+            const T* p = ws.probs.data() + b * outputStride;
+            labels[begin + b] = static_cast<int>(std::max_element(p, p + outputSize_t) - p);
+            if (probs) {
+                std::copy(p, p + outputSize_t, probs->data() + (begin + b) * outputSize_t);
+            }
+        }
+    });
+    return labels;
+}
+
+template <typename T>
+void BasicModel<T>::saveModel(const std::string& filename) const
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs) {
+        throw std::runtime_error("Could not open file for writing: " + filename);
+    }
+
+    const std::size_t dataBytes = paramCount_t * sizeof(T);
+
+    // 0) Header: format, shapes and checksums
+    FileHeader h{};
+    std::copy(kModelMagic, kModelMagic + sizeof(kModelMagic), h.magic);
+    h.version = kModelVersion;
+    h.endianTag = kEndianTag;
+    h.scalarBytes = static_cast<std::uint32_t>(sizeof(T));
+    h.alignment = static_cast<std::uint32_t>(math::kAlignment);
+    h.layerCount = 2;
+    h.shapes[0][0] = hiddenSize_t;
+    h.shapes[0][1] = inputSize_t;
+    h.shapes[1][0] = outputSize_t;
+    h.shapes[1][1] = hiddenSize_t;
+    h.dataOffset = math::alignedStride<std::uint8_t>(sizeof(FileHeader));
+    h.dataBytes = dataBytes;
+    h.dataCrc = utils::crc32(params(), dataBytes);
+    h.headerCrc = headerCrc(h);
+    ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+    // 1) Pad up to the aligned parameter section
+    const char zeros[math::kAlignment] = {};
+    ofs.write(zeros, static_cast<std::streamsize>(h.dataOffset - sizeof(h)));
+
+    // 2) The parameter buffer as it is, padding included
+    ofs.write(reinterpret_cast<const char*>(params()), static_cast<std::streamsize>(dataBytes));
+
+    if (!ofs) {
+        throw std::runtime_error("Could not write model file: " + filename);
+    }
     ofs.close();
 }
 
-void Model::loadModel(const std::string& filename)
+template <typename T>
+void BasicModel<T>::adoptParams(const std::uint8_t* data, std::size_t scalarBytes, std::size_t alignment,
+    std::size_t inputSize, std::size_t hiddenSize, std::size_t outputSize, bool w1InputMajor)
+{
+    ParamLayout from = paramLayout(scalarBytes, alignment, inputSize, hiddenSize, outputSize, w1InputMajor);
+
+    mapping_t.reset();
+    mappedParams_t = nullptr;
+    setShape(inputSize, hiddenSize, outputSize);
+    params_t.assign(paramCount_t, 0.0);
+    ParamLayout to = paramLayout(sizeof(T), math::kAlignment, inputSize, hiddenSize, outputSize);
+
+    // The stored values need not be aligned in memory, so convert from an aligned copy
+    if (scalarBytes == sizeof(float)) {
+        math::AlignedVector<float> src(from.count);
+        std::memcpy(src.data(), data, from.count * sizeof(float));
+        convertParams(src.data(), from, params_t.data(), to, inputSize, hiddenSize, outputSize);
+    }
+    else {
+        math::AlignedVector<double> src(from.count);
+        std::memcpy(src.data(), data, from.count * sizeof(double));
+        convertParams(src.data(), from, params_t.data(), to, inputSize, hiddenSize, outputSize);
+    }
+}
+
+template <typename T>
+void BasicModel<T>::loadModel(const std::string& filename)
 {
+    mask_t = math::AlignedVector<T>();
     std::ifstream ifs(filename, std::ios::binary);
     if (!ifs) {
         throw std::runtime_error("Could not open file for reading: " + filename);
     }
 
-    // 1) Read dimensions (inputSize, hiddenSize, outputSize)
+    // 0) Files without the header are the original format: size_t dimensions + doubles
+    std::uint32_t scalarBytes = sizeof(double);
     std::size_t inSize, hidSize, outSize;
-    ifs.read(reinterpret_cast<char*>(&inSize), sizeof(inSize));
-    ifs.read(reinterpret_cast<char*>(&hidSize), sizeof(hidSize));
-    ifs.read(reinterpret_cast<char*>(&outSize), sizeof(outSize));
-
-    // 2) Check if they match our current model
-    //    (Alternatively, you could re-allocate if you want the Model
-    //     to adopt whatever sizes are stored in the file.)
-    if (inSize != inputSize_t || hidSize != hiddenSize_t || outSize != outputSize_t) {
-        throw std::runtime_error(
-            "Dimension mismatch in loaded model: file("
-            + std::to_string(inSize) + ","
-            + std::to_string(hidSize) + ","
-            + std::to_string(outSize) + ") != current("
-            + std::to_string(inputSize_t) + ","
-            + std::to_string(hiddenSize_t) + ","
-            + std::to_string(outputSize_t) + ")"
-        );
-    }
-
-    // 3) Read w1_
+    char magic[sizeof(kModelMagic)] = {};
+    ifs.read(magic, sizeof(magic));
+    if (ifs && std::equal(magic, magic + sizeof(magic), kModelMagic)) {
+        std::uint32_t version = readU32(ifs);
+        if (version == kModelVersion || version == kHiddenMajorVersion) {
+            // Current format: check the header, then read and check the parameter block
+            ifs.seekg(0, std::ios::end);
+            const std::size_t fileSize = static_cast<std::size_t>(ifs.tellg());
+            std::uint8_t headerBytes[sizeof(FileHeader)] = {};
+            ifs.seekg(0);
+            ifs.read(reinterpret_cast<char*>(headerBytes), sizeof(headerBytes));
+            FileHeader h = checkHeader(headerBytes, ifs ? fileSize : 0, filename);
+
+            std::vector<std::uint8_t> data(h.dataBytes);
+            ifs.seekg(static_cast<std::streamoff>(h.dataOffset));
+            ifs.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!ifs) {
+                throw std::runtime_error("Model file is truncated: " + filename);
+            }
+            if (utils::crc32(data.data(), data.size()) != h.dataCrc) {
+                throw std::runtime_error("Model file parameters are corrupt (CRC mismatch): " + filename);
+            }
+            adoptParams(data.data(), h.scalarBytes, h.alignment, h.shapes[0][1], h.shapes[0][0], h.shapes[1][0],
+                version == kModelVersion);
+            return;
+        }
+        if (version != 1) {
+            throw std::runtime_error("Unsupported model file version " + std::to_string(version) + ": " + filename);
+        }
+        scalarBytes = readU32(ifs);
+        if (scalarBytes != sizeof(float) && scalarBytes != sizeof(double)) {
+            throw std::runtime_error("Unsupported scalar size in model file: " + filename);
+        }
+
+        // 1) Read dimensions (inputSize, hiddenSize, outputSize)
+        inSize = static_cast<std::size_t>(readU64(ifs));
+        hidSize = static_cast<std::size_t>(readU64(ifs));
+        outSize = static_cast<std::size_t>(readU64(ifs));
+    }
+    else {
+        ifs.clear();
+        ifs.seekg(0);
+
+        // 1) Read dimensions (inputSize, hiddenSize, outputSize)
+        ifs.read(reinterpret_cast<char*>(&inSize), sizeof(inSize));
+        ifs.read(reinterpret_cast<char*>(&hidSize), sizeof(hidSize));
+        ifs.read(reinterpret_cast<char*>(&outSize), sizeof(outSize));
+    }
+    if (!ifs) {
+        throw std::runtime_error("Model file is truncated: " + filename);
+    }
+
+    // 2) Adopt the stored sizes
+    mapping_t.reset();
+    mappedParams_t = nullptr;
+    setShape(inSize, hidSize, outSize);
+    params_t.assign(paramCount_t, 0.0);
+
+    // 3) Read w1_ (converting to T if the file was saved with the other precision),
+    // one hidden unit at a time into a column of W1^T
+    auto W1t = w1t();
+    std::vector<T> row(inputSize_t);
     for (std::size_t i = 0; i < hiddenSize_t; ++i) {
-        ifs.read(reinterpret_cast<char*>(w1_t[i].data()),
-            inputSize_t * sizeof(double));
+        readValues(ifs, row.data(), inputSize_t, scalarBytes);
+        for (std::size_t j = 0; j < inputSize_t; ++j) {
+            W1t(j, i) = row[j];
+        }
     }
 
     // 4) Read b1_
-    ifs.read(reinterpret_cast<char*>(b1_t.data()),
-        hiddenSize_t * sizeof(double));
+    readValues(ifs, b1(), hiddenSize_t, scalarBytes);
 
     // 5) Read w2_
     for (std::size_t i = 0; i < outputSize_t; ++i) {
-        ifs.read(reinterpret_cast<char*>(w2_t[i].data()),
-            hiddenSize_t * sizeof(double));
+        readValues(ifs, w2().row(i), hiddenSize_t, scalarBytes);
     }
 
     // 6) Read b2_
-    ifs.read(reinterpret_cast<char*>(b2_t.data()),
-        outputSize_t * sizeof(double));
+    readValues(ifs, b2(), outputSize_t, scalarBytes);
 
+    if (!ifs) {
+        throw std::runtime_error("Model file is truncated: " + filename);
+    }
     ifs.close();
 }
+
+template <typename T>
+bool BasicModel<T>::mapModel(const std::string& filename)
+{
+    mask_t = math::AlignedVector<T>();
+    auto file = std::make_shared<const DataReader::MappedFile>(filename);
+    const std::uint8_t* bytes = file->data();
+
+    std::uint32_t version = 0;
+    if (file->size() >= 8) {
+        std::memcpy(&version, bytes + 4, sizeof(version));
+    }
+    if (file->size() < 8 || !std::equal(kModelMagic, kModelMagic + sizeof(kModelMagic), bytes) || version != kModelVersion) {
+        // Older formats are always converted
+        loadModel(filename);
+        return false;
+    }
+
+    FileHeader h = checkHeader(bytes, file->size(), filename);
+    const std::uint8_t* data = bytes + h.dataOffset;
+    if (utils::crc32(data, h.dataBytes) != h.dataCrc) {
+        throw std::runtime_error("Model file parameters are corrupt (CRC mismatch): " + filename);
+    }
+
+    // Use the mapping in place only if it is exactly the buffer we would have built
+    if (h.scalarBytes != sizeof(T) || h.alignment != math::kAlignment ||
+        reinterpret_cast<std::uintptr_t>(data) % math::kAlignment != 0) {
+        adoptParams(data, h.scalarBytes, h.alignment, h.shapes[0][1], h.shapes[0][0], h.shapes[1][0]);
+        return false;
+    }
+    setShape(h.shapes[0][1], h.shapes[0][0], h.shapes[1][0]);
+    params_t = math::AlignedVector<T>();
+    mappedParams_t = reinterpret_cast<const T*>(data);
+    mapping_t = std::move(file);
+    return true;
+}
+
+template <typename T>
+BasicModel<T> BasicModel<T>::fromFile(const std::string& filename, bool map, double lr)
+{
+    BasicModel model(0, 0, 0, lr);
+    if (map) {
+        model.mapModel(filename);
+    }
+    else {
+        model.loadModel(filename);
+    }
+    return model;
+}
+
+template <typename T>
+void BasicModel<T>::copyParams(const BasicModel& other)
+{
+    if (&other == this) {
+        return;
+    }
+    const T* src = other.params();
+    mapping_t.reset();
+    mappedParams_t = nullptr;
+    setShape(other.inputSize_t, other.hiddenSize_t, other.outputSize_t);
+    params_t.assign(src, src + paramCount_t);
+}
+
+template <typename T>
+void BasicModel<T>::prune(const PruneConfig& config)
+{
+    if (config.blockRows == 0 || config.blockCols == 0) {
+        throw std::runtime_error("Pruning blocks must not be empty.");
+    }
+    if (!(config.sparsity1 >= 0.0 && config.sparsity1 <= 1.0 && config.sparsity2 >= 0.0 && config.sparsity2 <= 1.0)) {
+        throw std::runtime_error("Sparsity must be between 0 and 1.");
+    }
+    makeWritable();
+    if (mask_t.empty()) {
+        mask_t.assign(paramCount_t, T(1));
+    }
+
+    auto W1t = w1t();
+    auto mask1t = w1t(mask_t.data());
+    pruneBlocks(hiddenSize_t, inputSize_t, config.blockRows, config.blockCols, config.sparsity1,
+        [&](std::size_t i, std::size_t j) -> T& { return W1t(j, i); },
+        [&](std::size_t i, std::size_t j) -> T& { return mask1t(j, i); });
+
+    auto W2 = w2();
+    auto mask2 = w2(mask_t.data());
+    pruneBlocks(outputSize_t, hiddenSize_t, config.blockRows, config.blockCols, config.sparsity2,
+        [&](std::size_t i, std::size_t j) -> T& { return W2(i, j); },
+        [&](std::size_t i, std::size_t j) -> T& { return mask2(i, j); });
+}
+
+template class BasicModel<float>;
+template class BasicModel<double>;
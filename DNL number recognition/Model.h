@@ -7,23 +7,115 @@
 #include <stdexcept>
 #include <fstream>
 #include <string>
+#include <cstdint>
+#include <span>
+#include <memory>
 
+#include "AugmentStream.h"
+#include "Checkpoint.h"
+#include "DataReader.h"
+#include "Telemetry.h"
+#include "ThreadPool.h"
 #include "utils.h"
 #include "math.h"
+#include "Optimizer.h"
 
-class Model
+template <typename T>
+class Validator;
+
+enum class TrainMode
+{
+    // One shared set of weights updated in lock step: per-sample SGD for
+    // batchSize = 1, otherwise data-parallel mini-batches (see below)
+    Synchronous,
+
+    // Asynchronous per-sample SGD: `threads` workers each take a disjoint shard
+    // of the (shuffled) data and update the shared weights without any locking.
+    // MNIST inputs are sparse, so concurrent writes to the same W1 entries are
+    // rare and the lost updates don't hurt convergence. batchSize is ignored and
+    // results are not reproducible run to run.
+    Hogwild,
+};
+
+struct TrainConfig
+{
+    TrainMode mode = TrainMode::Synchronous;
+    int epochs = 5;
+
+    // 1 = plain per-sample SGD (one update per image).
+    // > 1 = mini-batch gradient descent: forward/backward for the whole batch as
+    //       matrix-matrix products, one update with the batch-mean gradient.
+    //       The mean gradient is smaller than a per-sample one, so larger batches
+    //       usually want a proportionally larger learning rate.
+    std::size_t batchSize = 1;
+
+    // Mini-batch and Hogwild modes visit the samples in a new random order every epoch
+    bool shuffle = true;
+    unsigned int seed = 5489u;
+
+    // Mini-batch mode: each batch is split into this many contiguous slices,
+    // one per worker, whose gradients are summed in slice order before the update.
+    // Results are deterministic for a fixed thread count.
+    // Hogwild mode: number of asynchronous workers. 0 = all hardware threads.
+    std::size_t threads = 1;
+
+    // How mini-batch updates are applied (momentum, Adam, learning rate schedule;
+    // the base rate is the model's). Anything but plain SGD at a constant rate
+    // trains batchSize = 1 as mini-batches of one; Hogwild mode only supports plain SGD.
+    OptimizerConfig optimizer;
+
+    // Streaming training only: every checkpointEvery batches and at the end of every
+    // epoch, snapshot the run into checkpointFile (written in the background, see
+    // Checkpointer). With resume set and the file present, training continues from
+    // it bit for bit; the stream must then start at the checkpoint's batch
+    // (AugmentConfig::firstBatch, see readCheckpointPosition). A validator's state is
+    // checkpointed too: the checkpoint is held back until the validator caught up with
+    // its batch, and training only waits for that when the next validation or
+    // checkpoint comes first.
+    std::string checkpointFile;
+    std::size_t checkpointEvery = 1000;
+    bool resume = false;
+
+    // Optional throughput / phase-time records (see Telemetry). Hogwild mode only
+    // records throughput, loss and accuracy, once per epoch.
+    Telemetry* telemetry = nullptr;
+};
+
+struct PruneConfig
+{
+    // Fraction of the weights of W1 / W2 to remove (0..1), rounded down to whole blocks
+    double sparsity1 = 0.9;
+    double sparsity2 = 0.0;
+
+    // Weights are removed in blocks of blockRows outputs x blockCols inputs, the blocks
+    // with the smallest L2 norm first (1 x 1 = single weights). Blocks of a whole SIMD
+    // register of outputs (16 x 1 for float) run fastest in a SparseModel.
+    std::size_t blockRows = 1;
+    std::size_t blockCols = 1;
+};
+
+/*
+
+ 784 -> hidden (ReLU) -> 10 (softmax) network, templated on the scalar type
+ used for weights, activations and inputs (float or double; see Model / FloatModel).
+
+*/
+template <typename T>
+class BasicModel
 {
 public:
-	Model(std::size_t inputSize, std::size_t hiddenSize, std::size_t outputSize, double lr = 0.01);
+    using Scalar = T;
+
+	BasicModel(std::size_t inputSize, std::size_t hiddenSize, std::size_t outputSize, double lr = 0.01);
 
     /*
     
      Forward pass for a single sample
      Returns the output layer (softmax probabilities)
-     Also stores intermediate results needed for backprop (z1, hidden)
+     Also stores intermediate results needed for backprop (hidden)
     
     */
-    std::vector<double> forward(const std::vector<double>& input);
+    std::vector<T> forward(const std::vector<T>& input);
 
     /*
     
@@ -33,30 +125,82 @@ public:
     target: one-hot vector for the correct label
 
     */
-    void backprop(const std::vector<double>& input,
-        const std::vector<double>& output,
-        const std::vector<double>& target);
+    void backprop(const std::vector<T>& input,
+        const std::vector<T>& output,
+        const std::vector<T>& target);
 
     /*
         
     Train loop
 
     */
-    void train(const std::vector<std::vector<double>>& trainInputs,
+    void train(const std::vector<std::vector<T>>& trainInputs,
         const std::vector<int>& trainLabels,
         int epochs = 5);
 
+    void train(const std::vector<std::vector<T>>& trainInputs,
+        const std::vector<int>& trainLabels,
+        const TrainConfig& config);
+
+    // Mini-batch training on batches drawn from an augmentation stream:
+    // config.epochs epochs of stream.batchesPerEpoch() batches each, split over
+    // config.threads workers like the synchronous mini-batch mode.
+    // The stream decides batch size and order; config.mode must be Synchronous.
+    // Checkpoints and resuming: see TrainConfig::checkpointFile.
+    // With a validator, weight snapshots are validated as training goes on, training
+    // stops early when it says so, and ends with the best snapshot's weights if configured.
+    void train(AugmentStream<T>& stream, const TrainConfig& config, Validator<T>* validator = nullptr);
+
+    /*
+
+    Scratch for the const inference functions below. A workspace belongs to one
+    thread at a time; the model itself can be shared by any number of threads
+    as long as nobody trains or loads it meanwhile.
+
+    */
+    struct InferenceWorkspace {
+        math::SparseVector<T> input;   // nonzeros of a single input (infer)
+        math::AlignedVector<T> x;      // [batch][input stride] inputs
+        math::AlignedVector<T> hidden; // [batch][hidden stride] ReLU(z1)
+        math::AlignedVector<T> probs;  // [batch][output stride] softmax
+    };
+
+    /*
+
+    Softmax probabilities for a single sample, computed in ws
+    (no allocation once ws has been used). Valid until ws is used again.
+
+    */
+    const T* infer(const std::vector<T>& input, InferenceWorkspace& ws) const;
+
     /*
     
     Predict a label for a single input
     returns the class index with max probability
+    The overload without a workspace uses one private to the calling thread.
     
     */
-    int predict(const std::vector<double>& input);
+    int predict(const std::vector<T>& input, InferenceWorkspace& ws) const;
+    int predict(const std::vector<T>& input) const;
+
+    /*
+
+    Predict every input. The inputs are cut into chunks of kInferenceChunk samples,
+    each run as two matrix products on one of pool's threads.
+    If probs is given it receives outputSize() probabilities per input, row after row.
+
+    */
+    std::vector<int> predictBatch(std::span<const std::vector<T>> inputs, ThreadPool& pool,
+        std::vector<T>* probs = nullptr) const;
+
+    static constexpr std::size_t kInferenceChunk = 64;
 
     /*
     
     Save the model to a binary file
+    The file records the scalar type, the layer shapes and a CRC, and stores the
+    parameters exactly as they sit in memory (64-byte aligned, padded rows),
+    so mapModel() can use them in place.
     
     */
     void saveModel(const std::string& filename) const;
@@ -64,27 +208,219 @@ public:
     /*
     
     Load the model from a binary file (overwrites current)
+    The network takes the shapes stored in the file. Files written with another
+    precision (including the original headerless double files) are converted
+    to T while loading.
 
     */
     void loadModel(const std::string& filename);
+
+    /*
+
+    Like loadModel, but when the file was saved with the same scalar type the
+    parameters are memory-mapped and used without copying: every process
+    mapping the file shares the same pages. The first training step copies
+    them into memory. Returns false if the file had to be loaded instead.
+
+    */
+    bool mapModel(const std::string& filename);
+
+    // A model with the shapes and parameters of a saved file (mapped when possible)
+    static BasicModel fromFile(const std::string& filename, bool map = true, double lr = 0.01);
+
+    // Take the shapes and parameters of another model, nothing else (no workspaces or
+    // optimizer state). Does not allocate once the shapes match: for weight snapshots.
+    void copyParams(const BasicModel& other);
+
+    /*
+
+    Magnitude pruning: zero the lowest-norm blocks of W1 and W2 (see PruneConfig).
+    The pruned weights stay zero through later mini-batch and streaming training,
+    so the model can be fine-tuned; pruning again at a higher sparsity keeps them
+    pruned, as their blocks then have the lowest norm. Per-sample SGD and Hogwild
+    training refuse a pruned model. Loading a model clears the pruning mask.
+
+    */
+    void prune(const PruneConfig& config);
+    bool pruned() const { return !mask_t.empty(); }
+
+    // Read-only access to the shape and parameters (e.g. for QuantizedModel).
+    // W1 is kept transposed: row k of weights1T() holds input k's weight into every hidden unit.
+    std::size_t inputSize() const { return inputSize_t; }
+    std::size_t hiddenSize() const { return hiddenSize_t; }
+    std::size_t outputSize() const { return outputSize_t; }
+    math::MatrixView<const T> weights1T() const { return w1t(); }
+    const T* bias1() const { return b1(); }
+    math::MatrixView<const T> weights2() const { return w2(); }
+    const T* bias2() const { return b2(); }
 private:
     // Dimensions
     std::size_t inputSize_t;
     std::size_t hiddenSize_t;
     std::size_t outputSize_t;
 
-    // Parameters
-    std::vector<std::vector<double>> w1_t; // [hiddenSize_][inputSize_]
-    std::vector<double> b1_t;              // [hiddenSize_]
+    // Parameters, packed into one 64-byte aligned buffer: [ W1^T | b1 | W2 | b2 ].
+    // W1 is stored input-major (one row of hiddenSize_t weights per input), so the
+    // first layer of a sparse input reads and updates only the rows of its nonzero
+    // pixels. Every section and every weight row starts on a 64-byte boundary,
+    // so rows are padded to w1Stride_t / w2Stride_t elements.
+    // After mapModel() they are read from the mapped file instead of params_t
+    // until makeWritable() copies them.
+    math::AlignedVector<T> params_t;
+    std::shared_ptr<const DataReader::MappedFile> mapping_t;
+    const T* mappedParams_t = nullptr;
+    std::size_t paramCount_t;
+    std::size_t w1Stride_t;
+    std::size_t w2Stride_t;
+    std::size_t b1Offset_t;
+    std::size_t w2Offset_t;
+    std::size_t b2Offset_t;
+
+    // Set the sizes and section offsets; params_t is left to the caller
+    void setShape(std::size_t inputSize, std::size_t hiddenSize, std::size_t outputSize);
+
+    // Called by everything that updates the parameters
+    void makeWritable();
+
+    // Take the shapes and parameters from a stored buffer of another precision, alignment
+    // or W1 orientation (model files before version 3 store W1 hidden-major)
+    void adoptParams(const std::uint8_t* data, std::size_t scalarBytes, std::size_t alignment,
+        std::size_t inputSize, std::size_t hiddenSize, std::size_t outputSize, bool w1InputMajor = true);
+
+    // The non-const accessors are only for code that ran makeWritable()
+    T* params() { return params_t.data(); }
+    const T* params() const { return mapping_t ? mappedParams_t : params_t.data(); }
+
+    math::MatrixView<T> w1t() { return { params(), inputSize_t, hiddenSize_t, w1Stride_t }; }
+    math::MatrixView<const T> w1t() const { return { params(), inputSize_t, hiddenSize_t, w1Stride_t }; }
+    T* b1() { return params() + b1Offset_t; }
+    const T* b1() const { return params() + b1Offset_t; }
+
+    math::MatrixView<T> w2() { return { params() + w2Offset_t, outputSize_t, hiddenSize_t, w2Stride_t }; }
+    math::MatrixView<const T> w2() const { return { params() + w2Offset_t, outputSize_t, hiddenSize_t, w2Stride_t }; }
+    T* b2() { return params() + b2Offset_t; }
+    const T* b2() const { return params() + b2Offset_t; }
 
-    std::vector<std::vector<double>> w2_t; // [outputSize_][hiddenSize_]
-    std::vector<double> b2_t;              // [outputSize_]
+    math::MatrixView<T> w1t(T* base) const { return { base, inputSize_t, hiddenSize_t, w1Stride_t }; }
+    math::MatrixView<T> w2(T* base) const { return { base + w2Offset_t, outputSize_t, hiddenSize_t, w2Stride_t }; }
+
+    // Scratch for one mini-batch; every row is padded like the weight rows
+    struct BatchWorkspace {
+        std::size_t capacity = 0;
+        math::AlignedVector<T> x;      // [batch][input stride] inputs
+        math::AlignedVector<T> hidden; // [batch][hiddenStride] ReLU(z1)
+        math::AlignedVector<T> delta;  // [batch][hiddenStride] dZ1
+        math::AlignedVector<T> probs;  // [batch][outputStride] softmax, then dZ2
+        math::AlignedVector<T> grads;  // laid out like params_t
+        double loss = 0.0;             // summed loss of the last slice
+        std::size_t correct = 0;       // correct predictions in the last slice
+
+        // When timed, batchGradient measures its forward and backward halves
+        bool timed = false;
+        Telemetry::Clock::duration forwardTime{};
+        Telemetry::Clock::duration backwardTime{};
+    };
+    // One per data-parallel worker
+    std::vector<BatchWorkspace> workers_t;
+
+    // Scratch for one per-sample SGD step
+    struct SampleWorkspace {
+        math::SparseVector<T> input;   // nonzeros of the current sample
+        math::AlignedVector<T> hidden; // ReLU(z1)
+        math::AlignedVector<T> probs;  // softmax, then dZ2
+        math::AlignedVector<T> delta;  // dZ1
+        std::size_t correct = 0;       // correct predictions, counted by sgdStep
+
+        // When timed, sgdStep measures its forward and backward halves
+        bool timed = false;
+        Telemetry::Clock::duration forwardTime{};
+        Telemetry::Clock::duration backwardTime{};
+    };
+
+    void reserveSample(SampleWorkspace& ws) const;
+
+    /*
+
+    Forward, backward and in-place weight update for one sample, touching only ws
+    and the parameters. Returns the sample's loss. Several threads may run this
+    at once on the same model (Hogwild): their reads and writes of params_t race,
+    which is the point - every element is a naturally aligned scalar, so a
+    racing update can be lost but never torn.
+
+    */
+    double sgdStep(SampleWorkspace& ws, const std::vector<T>& input, int label);
+
+    void trainPerSample(const std::vector<std::vector<T>>& trainInputs,
+        const std::vector<int>& trainLabels,
+        int epochs, Telemetry* telemetry);
+
+    void trainHogwild(const std::vector<std::vector<T>>& trainInputs,
+        const std::vector<int>& trainLabels,
+        const TrainConfig& config);
+
+    void reserveBatch(BatchWorkspace& ws, std::size_t batchSize) const;
+
+    void reserveInference(InferenceWorkspace& ws, std::size_t batchSize) const;
+
+    // Probabilities for inputs[0..count) into ws.probs (one padded row per sample)
+    void inferBatch(InferenceWorkspace& ws, const std::vector<T>* inputs, std::size_t count) const;
+
+    static InferenceWorkspace& threadWorkspace();
+
+    /*
+
+    Forward + backward for the `count` samples inputs[0..count) (each inputSize values).
+    Writes gradScale * (summed gradient) into ws.grads and returns the summed loss;
+    ws.correct counts the samples the current weights already classify correctly.
+
+    */
+    double batchGradient(BatchWorkspace& ws,
+        const T* const* inputs, const int* labels,
+        std::size_t count, T gradScale) const;
+
+    /*
+
+    One synchronous mini-batch update: the batch is split into one contiguous
+    slice per pool thread, the slice gradients are summed in slice order and
+    optimizer_t applies the mean gradient. Returns the summed loss.
+    Reports the step's phase times and the batch to telemetry, if any.
+
+    */
+    double miniBatchStep(ThreadPool& pool, const T* const* inputs, const int* labels, std::size_t count,
+        Telemetry* telemetry = nullptr);
+
+    // Streaming training state after `batch` batches, into a checkpoint buffer (copies only)
+    void fillCheckpoint(TrainingCheckpoint<T>& checkpoint, const AugmentStream<T>& stream,
+        std::uint64_t batch, std::size_t threads, double epochLoss) const;
+
+    // The validator's part of a checkpoint (after validator.finish())
+    static void fillValidation(TrainingCheckpoint<T>& checkpoint, const Validator<T>& validator);
+
+    // Continue from a checkpoint of this stream, and the validator from its state; returns
+    // the loss of its current epoch so far
+    double restoreCheckpoint(const std::string& filename, const AugmentStream<T>& stream, std::size_t threads,
+        Validator<T>* validator);
 
     // Intermediate results (for backprop)
-    std::vector<double> z1_t;     // pre-activation hidden
-    std::vector<double> hidden_t; // post-activation hidden
-    std::vector<double> z2_t;     // pre-softmax
+    std::vector<T> hidden_t; // post-activation hidden, ReLU(z1)
+    std::vector<T> z2_t;     // pre-softmax
+
+    // backprop scratch, kept to avoid allocating on every call
+    std::vector<T> dZ2_t;
+    std::vector<T> dZ1_t;
+    math::SparseVector<T> sparseInput_t; // forward / backprop input
+
+    // 0 for pruned weights, 1 elsewhere (params_t layout); empty = not pruned
+    math::AlignedVector<T> mask_t;
 
-    double learningRate_t;
+    T learningRate_t;
+
+    // Mini-batch updates and their state, reset by every train() call
+    Optimizer<T> optimizer_t;
 };
 
+using Model = BasicModel<double>;
+using FloatModel = BasicModel<float>;
+
+extern template class BasicModel<float>;
+extern template class BasicModel<double>;
@@ -0,0 +1,805 @@
+#include "Network.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+namespace {
+    constexpr char kNetworkMagic[4] = { 'D', 'N', 'L', 'N' };
+    constexpr std::uint32_t kNetworkVersion = 2;
+
+    std::string describeLayer(const LayerSpec& layer) {
+        switch (layer.type) {
+        case LayerType::Dense: return std::to_string(layer.units);
+        case LayerType::ReLU: return "relu";
+        case LayerType::Sigmoid: return "sigmoid";
+        case LayerType::Softmax: return "softmax";
+        case LayerType::Conv2D: {
+            // Appended piece by piece: GCC's -Wrestrict misfires on "p" + std::to_string(...) here
+            std::string name = "conv";
+            name += std::to_string(layer.units);
+            name += 'k';
+            name += std::to_string(layer.kernel);
+            if (layer.pad) {
+                name += 'p';
+                name += std::to_string(layer.pad);
+            }
+            return name;
+        }
+        case LayerType::MaxPool: return "pool" + std::to_string(layer.kernel);
+        }
+        return "?";
+    }
+
+    // Read the decimal number at item[pos..], moving pos past it; false if there is none
+    bool readNumber(const std::string& item, std::size_t& pos, std::size_t& value) {
+        const std::size_t end = item.find_first_not_of("0123456789", pos);
+        const std::size_t stop = end == std::string::npos ? item.size() : end;
+        if (stop == pos) {
+            return false;
+        }
+        value = std::stoul(item.substr(pos, stop - pos));
+        pos = stop;
+        return true;
+    }
+
+    template <typename V>
+    void writeRaw(std::ofstream& ofs, const V* data, std::size_t n, std::uint32_t& crc) {
+        ofs.write(reinterpret_cast<const char*>(data), n * sizeof(V));
+        crc = utils::crc32(data, n * sizeof(V), crc);
+    }
+
+    template <typename V>
+    V readRaw(std::ifstream& ifs) {
+        V v{};
+        ifs.read(reinterpret_cast<char*>(&v), sizeof(v));
+        return v;
+    }
+
+    // Read n stored values of scalarBytes each into dst, converting to T, and update the CRC
+    template <typename T>
+    void readValues(std::ifstream& ifs, T* dst, std::size_t n, std::uint32_t scalarBytes,
+        std::vector<char>& buffer, std::uint32_t& crc)
+    {
+        buffer.resize(n * scalarBytes);
+        ifs.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        crc = utils::crc32(buffer.data(), buffer.size(), crc);
+        for (std::size_t i = 0; i < n; ++i) {
+            if (scalarBytes == sizeof(double)) {
+                double v;
+                std::memcpy(&v, buffer.data() + i * sizeof(v), sizeof(v));
+                dst[i] = static_cast<T>(v);
+            }
+            else {
+                float v;
+                std::memcpy(&v, buffer.data() + i * sizeof(v), sizeof(v));
+                dst[i] = static_cast<T>(v);
+            }
+        }
+    }
+}
+
+std::vector<LayerSpec> parseLayers(const std::string& spec)
+{
+    std::vector<LayerSpec> layers;
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item == "relu") {
+            layers.push_back({ LayerType::ReLU, 0 });
+        }
+        else if (item == "sigmoid") {
+            layers.push_back({ LayerType::Sigmoid, 0 });
+        }
+        else if (item == "softmax") {
+            layers.push_back({ LayerType::Softmax, 0 });
+        }
+        else if (!item.empty() && item.find_first_not_of("0123456789") == std::string::npos) {
+            layers.push_back({ LayerType::Dense, std::stoul(item) });
+        }
+        else if (item.rfind("conv", 0) == 0) {
+            // conv<filters>k<kernel>[p<pad>]
+            LayerSpec layer{ LayerType::Conv2D };
+            std::size_t pos = 4;
+            bool valid = readNumber(item, pos, layer.units) && pos < item.size() && item[pos++] == 'k'
+                && readNumber(item, pos, layer.kernel);
+            if (valid && pos < item.size()) {
+                valid = item[pos++] == 'p' && readNumber(item, pos, layer.pad);
+            }
+            if (!valid || pos != item.size()) {
+                throw std::runtime_error("Bad convolution '" + item + "' in " + spec + " (expected e.g. conv8k5 or conv8k3p1)");
+            }
+            layers.push_back(layer);
+        }
+        else if (item.rfind("pool", 0) == 0) {
+            LayerSpec layer{ LayerType::MaxPool };
+            std::size_t pos = 4;
+            if (!readNumber(item, pos, layer.kernel) || pos != item.size()) {
+                throw std::runtime_error("Bad pooling '" + item + "' in " + spec + " (expected e.g. pool2)");
+            }
+            layers.push_back(layer);
+        }
+        else {
+            throw std::runtime_error("Unknown layer '" + item + "' in " + spec);
+        }
+    }
+    return layers;
+}
+
+std::string describeLayers(const std::vector<LayerSpec>& layers)
+{
+    std::string out;
+    for (const LayerSpec& layer : layers) {
+        if (!out.empty()) {
+            out += ',';
+        }
+        out += describeLayer(layer);
+    }
+    return out;
+}
+
+template <typename T>
+BasicNetwork<T>::BasicNetwork(std::size_t inputSize, const std::vector<LayerSpec>& layers, double lr, std::size_t maxBatch)
+{
+    learningRate_t = static_cast<T>(lr);
+    build(inputSize, layers);
+    reserve(std::max<std::size_t>(1, maxBatch));
+
+    // Uniform weights scaled by the layer's fan in and out (Glorot), zero biases: the
+    // fixed +-0.01 of BasicModel lets the signal vanish in deeper stacks
+    for (const Layer& layer : layers_t) {
+        if (layer.wRows == 0) {
+            continue;
+        }
+        const std::size_t fanOut = layer.wRows * (layer.type == LayerType::Conv2D ? layer.kernel * layer.kernel : 1);
+        const double range = std::sqrt(6.0 / static_cast<double>(layer.wCols + fanOut));
+        for (std::size_t i = 0; i < layer.wRows; ++i) {
+            T* row = params_t.data() + layer.wOffset + i * layer.wStride;
+            for (std::size_t j = 0; j < layer.wCols; ++j) {
+                row[j] = static_cast<T>(utils::randomWeight(range));
+            }
+        }
+    }
+}
+
+template <typename T>
+BasicNetwork<T> BasicNetwork<T>::fromFile(const std::string& filename, double lr, std::size_t maxBatch)
+{
+    BasicNetwork network(1, { { LayerType::Dense, 1 }, { LayerType::Softmax, 0 } }, lr, maxBatch);
+    network.loadModel(filename);
+    return network;
+}
+
+template <typename T>
+std::vector<typename BasicNetwork<T>::Layer> BasicNetwork<T>::plan(std::size_t inputSize,
+    const std::vector<LayerSpec>& layers, std::size_t& paramCount)
+{
+    if (inputSize == 0 || layers.empty()) {
+        throw std::runtime_error("A network needs inputs and at least one layer.");
+    }
+
+    // Lay out the parameters: [ W | b ] for every dense and convolution layer, rows padded
+    // to whole cache lines. A square input is one image channel, anything else is flat.
+    std::vector<Layer> planned;
+    const auto side = static_cast<std::size_t>(std::lround(std::sqrt(static_cast<double>(inputSize))));
+    std::size_t h = 1, w = 1, c = inputSize;
+    if (side * side == inputSize) {
+        h = w = side;
+        c = 1;
+    }
+    // Shapes read from a file can be anything: a size that does not fit is an error, not a wrap-around
+    auto product = [](std::size_t a, std::size_t b) {
+        if (b != 0 && a > std::numeric_limits<std::size_t>::max() / b) {
+            throw std::runtime_error("Network layers are too large.");
+        }
+        return a * b;
+    };
+    paramCount = 0;
+    for (std::size_t l = 0; l < layers.size(); ++l) {
+        const LayerSpec& spec = layers[l];
+        if (spec.type == LayerType::Softmax && l + 1 != layers.size()) {
+            throw std::runtime_error("Softmax is only supported as the last layer.");
+        }
+        if (spec.type == LayerType::Dense && spec.units == 0) {
+            throw std::runtime_error("A dense layer needs at least one unit.");
+        }
+        if (spec.type == LayerType::Conv2D) {
+            if (spec.units == 0 || spec.kernel == 0) {
+                throw std::runtime_error("A convolution needs filters and a kernel size.");
+            }
+            if (spec.pad >= spec.kernel) {
+                throw std::runtime_error("Convolution padding must be smaller than its kernel.");
+            }
+            if (h + 2 * spec.pad < spec.kernel || w + 2 * spec.pad < spec.kernel) {
+                throw std::runtime_error("Convolution kernel larger than its " + std::to_string(h) + "x"
+                    + std::to_string(w) + " input.");
+            }
+        }
+        if (spec.type == LayerType::MaxPool && (spec.kernel == 0 || h < spec.kernel || w < spec.kernel)) {
+            throw std::runtime_error("Pooling window larger than its " + std::to_string(h) + "x"
+                + std::to_string(w) + " input.");
+        }
+
+        Layer layer{};
+        layer.type = spec.type;
+        layer.inH = layer.outH = h;
+        layer.inW = layer.outW = w;
+        layer.inC = layer.outC = c;
+        switch (spec.type) {
+        case LayerType::Dense:
+            layer.outH = layer.outW = 1;
+            layer.outC = layer.wRows = spec.units;
+            layer.wCols = product(product(h, w), c);
+            break;
+        case LayerType::Conv2D:
+            layer.kernel = spec.kernel;
+            layer.pad = spec.pad;
+            layer.outH = h + 2 * spec.pad - spec.kernel + 1;
+            layer.outW = w + 2 * spec.pad - spec.kernel + 1;
+            layer.outC = layer.wRows = spec.units;
+            layer.wCols = product(product(spec.kernel, spec.kernel), c);
+            break;
+        case LayerType::MaxPool:
+            layer.kernel = spec.kernel;
+            layer.outH = h / spec.kernel;
+            layer.outW = w / spec.kernel;
+            break;
+        default:
+            break;
+        }
+        layer.in = product(product(h, w), c);
+        layer.out = product(product(layer.outH, layer.outW), layer.outC);
+        if (layer.wRows > 0) {
+            layer.wStride = math::alignedStride<T>(layer.wCols);
+            layer.wOffset = paramCount;
+            layer.bOffset = layer.wOffset + product(layer.wRows, layer.wStride);
+            paramCount = layer.bOffset + math::alignedStride<T>(layer.wRows);
+        }
+        layer.actStride = math::alignedStride<T>(layer.out);
+        h = layer.outH;
+        w = layer.outW;
+        c = layer.outC;
+        planned.push_back(layer);
+    }
+    return planned;
+}
+
+template <typename T>
+void BasicNetwork<T>::build(std::size_t inputSize, const std::vector<LayerSpec>& layers)
+{
+    std::size_t paramCount = 0;
+    std::vector<Layer> planned = plan(inputSize, layers, paramCount);
+
+    inputSize_t = inputSize;
+    layers_t = std::move(planned);
+    params_t.assign(paramCount, T(0));
+    capacity_t = 0;
+
+    // Direct trainBatch() calls get plain SGD until train() sets up an optimizer
+    optimizer_t.reset(OptimizerConfig{}, learningRate_t, paramCount, 1, 0);
+}
+
+template <typename T>
+void BasicNetwork<T>::reserve(std::size_t batchSize)
+{
+    if (batchSize <= capacity_t) {
+        return;
+    }
+
+    // Every block starts on a cache line: the strides are whole lines
+    std::size_t offset = 0;
+    inputStride_t = math::alignedStride<T>(inputSize_t);
+    inputOffset_t = offset;
+    offset += batchSize * inputStride_t;
+
+    std::size_t maxWidth = 0;
+    std::size_t colSize = 0;
+    for (Layer& layer : layers_t) {
+        layer.actOffset = offset;
+        offset += batchSize * layer.actStride;
+        maxWidth = std::max(maxWidth, layer.out);
+        if (layer.type == LayerType::Conv2D) {
+            colSize = std::max(colSize, layer.wCols * math::alignedStride<T>(layer.outH * layer.outW));
+        }
+    }
+
+    deltaStride_t = math::alignedStride<T>(maxWidth);
+    for (std::size_t& delta : deltaOffset_t) {
+        delta = offset;
+        offset += batchSize * deltaStride_t;
+    }
+
+    colOffset_t = offset;
+    offset += colSize;
+
+    gradOffset_t = offset;
+    offset += params_t.size();
+
+    arena_t.assign(offset, T(0));
+    capacity_t = batchSize;
+}
+
+template <typename T>
+std::vector<LayerSpec> BasicNetwork<T>::layers() const
+{
+    std::vector<LayerSpec> specs;
+    for (const Layer& layer : layers_t) {
+        specs.push_back({ layer.type, layer.wRows, layer.kernel, layer.pad });
+    }
+    return specs;
+}
+
+template <typename T>
+void BasicNetwork<T>::forwardLayers(std::size_t count, std::size_t end)
+{
+    for (std::size_t l = 0; l < end; ++l) {
+        const Layer& layer = layers_t[l];
+        const T* x = act(l);
+        const std::size_t sx = actStride(l);
+        T* y = act(l + 1);
+        const std::size_t sy = layer.actStride;
+
+        if (layer.type == LayerType::Dense) {
+            math::MatrixView<const T> W{ params_t.data() + layer.wOffset, layer.out, layer.in, layer.wStride };
+            const T* b = params_t.data() + layer.bOffset;
+            if (count == 1) {
+                math::matVecMultiply(W, x, y);
+            }
+            else {
+                math::gemm(false, true, count, layer.out, layer.in,
+                    T(1), x, sx, W.data, W.stride, T(0), y, sy);
+            }
+            for (std::size_t r = 0; r < count; ++r) {
+                math::addBias(y + r * sy, b, layer.out);
+            }
+            continue;
+        }
+
+        if (layer.type == LayerType::Conv2D) {
+            const T* W = params_t.data() + layer.wOffset;
+            const T* b = params_t.data() + layer.bOffset;
+            T* cols = arena_t.data() + colOffset_t;
+            const std::size_t positions = layer.outH * layer.outW;
+            const std::size_t colStride = math::alignedStride<T>(positions);
+            for (std::size_t r = 0; r < count; ++r) {
+                T* out = y + r * sy;
+                math::im2col(x + r * sx, layer.inH, layer.inW, layer.inC, layer.kernel, layer.pad, cols, colStride);
+                // filters x positions = W cols: the output image, one channel after the other
+                math::gemm(false, false, layer.wRows, positions, layer.wCols,
+                    T(1), W, layer.wStride, cols, colStride, T(0), out, positions);
+                for (std::size_t f = 0; f < layer.wRows; ++f) {
+                    T* channel = out + f * positions;
+                    for (std::size_t p = 0; p < positions; ++p) {
+                        channel[p] += b[f];
+                    }
+                }
+            }
+            continue;
+        }
+
+        if (layer.type == LayerType::MaxPool) {
+            for (std::size_t r = 0; r < count; ++r) {
+                math::maxPool(x + r * sx, layer.inH, layer.inW, layer.inC, layer.kernel, y + r * sy);
+            }
+            continue;
+        }
+
+        for (std::size_t r = 0; r < count; ++r) {
+            T* row = y + r * sy;
+            std::copy(x + r * sx, x + r * sx + layer.out, row);
+            switch (layer.type) {
+            case LayerType::ReLU: math::reluInPlace(row, layer.out); break;
+            case LayerType::Sigmoid: math::sigmoidInPlace(row, layer.out); break;
+            case LayerType::Softmax: math::softmaxInPlace(row, layer.out); break;
+            default: break;
+            }
+        }
+    }
+}
+
+template <typename T>
+const T* BasicNetwork<T>::forward(const T* const* inputs, std::size_t count)
+{
+    reserve(count);
+    for (std::size_t r = 0; r < count; ++r) {
+        std::copy(inputs[r], inputs[r] + inputSize_t, act(0) + r * inputStride_t);
+    }
+    forwardLayers(count, layers_t.size());
+    return act(layers_t.size());
+}
+
+template <typename T>
+std::vector<T> BasicNetwork<T>::forward(const std::vector<T>& input)
+{
+    if (input.size() != inputSize_t) {
+        throw std::runtime_error("Input size mismatch.");
+    }
+    const T* x = input.data();
+    const T* out = forward(&x, 1);
+    return std::vector<T>(out, out + outputSize());
+}
+
+template <typename T>
+int BasicNetwork<T>::predict(const std::vector<T>& input)
+{
+    if (input.size() != inputSize_t) {
+        throw std::runtime_error("Input size mismatch.");
+    }
+    const T* x = input.data();
+    const T* out = forward(&x, 1);
+    return static_cast<int>(std::max_element(out, out + outputSize()) - out);
+}
+
+template <typename T>
+double BasicNetwork<T>::trainBatch(const T* const* inputs, const int* labels, std::size_t count,
+    std::size_t* correct, Telemetry* telemetry)
+{
+    const std::size_t L = layers_t.size();
+    if (layers_t.back().type != LayerType::Softmax) {
+        throw std::runtime_error("Training needs a softmax output layer.");
+    }
+    if (count == 0) {
+        return 0.0;
+    }
+    // The loss indexes the outputs with the labels: reject any that is not a class
+    for (std::size_t i = 0; i < count; ++i) {
+        if (labels[i] < 0 || static_cast<std::size_t>(labels[i]) >= outputSize()) {
+            throw std::runtime_error("Label " + std::to_string(labels[i]) + " is not one of the " +
+                std::to_string(outputSize()) + " classes.");
+        }
+    }
+    reserve(count);
+
+    // 1) Forward up to the logits; the softmax is fused with the loss below
+    {
+        PhaseTimer timer(telemetry, TrainPhase::Forward);
+        for (std::size_t r = 0; r < count; ++r) {
+            std::copy(inputs[r], inputs[r] + inputSize_t, act(0) + r * inputStride_t);
+        }
+        forwardLayers(count, L - 1);
+    }
+
+    double loss = 0.0;
+    std::size_t hits = 0;
+    T* grads = arena_t.data() + gradOffset_t;
+    {
+        PhaseTimer timer(telemetry, TrainPhase::Backward);
+
+        // 2) Loss, and dZ = (softmax - onehot) / count for the logits
+        const T* logits = act(L - 1);
+        const std::size_t logitStride = actStride(L - 1);
+        const std::size_t classes = layers_t.back().out;
+        std::size_t cur = 0;
+        T* delta = arena_t.data() + deltaOffset_t[cur];
+        for (std::size_t r = 0; r < count; ++r) {
+            int predicted;
+            loss += math::softmaxCrossEntropy(logits + r * logitStride, classes, labels[r], T(1) / T(count),
+                delta + r * deltaStride_t, &predicted);
+            if (predicted == labels[r]) {
+                ++hits;
+            }
+        }
+        if (correct) {
+            *correct = hits;
+        }
+
+        // 3) Backward through the other layers, delta ping-ponging between the two blocks
+        for (std::size_t l = L - 1; l-- > 0;) {
+            const Layer& layer = layers_t[l];
+            const T* dY = arena_t.data() + deltaOffset_t[cur];
+            T* dX = arena_t.data() + deltaOffset_t[1 - cur];
+            const std::size_t ds = deltaStride_t;
+            const T* x = act(l);
+            const std::size_t sx = actStride(l);
+            const T* y = act(l + 1);
+            const std::size_t sy = layer.actStride;
+
+            switch (layer.type) {
+            case LayerType::Dense: {
+                const T* W = params_t.data() + layer.wOffset;
+                T* gW = grads + layer.wOffset;
+                T* gB = grads + layer.bOffset;
+
+                // dW = dY^T X, db = column sums of dY
+                if (count == 1) {
+                    for (std::size_t i = 0; i < layer.out; ++i) {
+                        T* row = gW + i * layer.wStride;
+                        for (std::size_t j = 0; j < layer.in; ++j) {
+                            row[j] = dY[i] * x[j];
+                        }
+                    }
+                }
+                else {
+                    math::gemm(true, false, layer.out, layer.in, count,
+                        T(1), dY, ds, x, sx, T(0), gW, layer.wStride);
+                }
+                std::fill(gB, gB + layer.out, T(0));
+                for (std::size_t r = 0; r < count; ++r) {
+                    math::addBias(gB, dY + r * ds, layer.out);
+                }
+
+                // dX = dY W (not needed below the first layer)
+                if (l > 0) {
+                    if (count == 1) {
+                        std::fill(dX, dX + layer.in, T(0));
+                        for (std::size_t i = 0; i < layer.out; ++i) {
+                            math::axpy(layer.in, dY[i], W + i * layer.wStride, dX);
+                        }
+                    }
+                    else {
+                        math::gemm(false, false, count, layer.in, layer.out,
+                            T(1), dY, ds, W, layer.wStride, T(0), dX, ds);
+                    }
+                }
+                break;
+            }
+            case LayerType::Conv2D: {
+                const T* W = params_t.data() + layer.wOffset;
+                T* gW = grads + layer.wOffset;
+                T* gB = grads + layer.bOffset;
+                T* cols = arena_t.data() + colOffset_t;
+                const std::size_t positions = layer.outH * layer.outW;
+                const std::size_t colStride = math::alignedStride<T>(positions);
+
+                std::fill(gB, gB + layer.wRows, T(0));
+                for (std::size_t r = 0; r < count; ++r) {
+                    const T* dOut = dY + r * ds;
+
+                    // dW += dY cols^T, db += sum of dY over the positions
+                    math::im2col(x + r * sx, layer.inH, layer.inW, layer.inC, layer.kernel, layer.pad, cols, colStride);
+                    math::gemm(false, true, layer.wRows, layer.wCols, positions,
+                        T(1), dOut, positions, cols, colStride, r == 0 ? T(0) : T(1), gW, layer.wStride);
+                    for (std::size_t f = 0; f < layer.wRows; ++f) {
+                        const T* channel = dOut + f * positions;
+                        for (std::size_t p = 0; p < positions; ++p) {
+                            gB[f] += channel[p];
+                        }
+                    }
+
+                    // dX = col2im(W^T dY), reusing the im2col block
+                    if (l > 0) {
+                        math::gemm(true, false, layer.wCols, positions, layer.wRows,
+                            T(1), W, layer.wStride, dOut, positions, T(0), cols, colStride);
+                        T* dIn = dX + r * ds;
+                        std::fill(dIn, dIn + layer.in, T(0));
+                        math::col2im(cols, colStride, layer.inH, layer.inW, layer.inC, layer.kernel, layer.pad, dIn);
+                    }
+                }
+                break;
+            }
+            case LayerType::MaxPool:
+                if (l > 0) {
+                    for (std::size_t r = 0; r < count; ++r) {
+                        math::maxPoolBackward(x + r * sx, y + r * sy, dY + r * ds,
+                            layer.inH, layer.inW, layer.inC, layer.kernel, dX + r * ds);
+                    }
+                }
+                break;
+            case LayerType::ReLU:
+                for (std::size_t r = 0; r < count; ++r) {
+                    for (std::size_t j = 0; j < layer.out; ++j) {
+                        dX[r * ds + j] = y[r * sy + j] > T(0) ? dY[r * ds + j] : T(0);
+                    }
+                }
+                break;
+            case LayerType::Sigmoid:
+                for (std::size_t r = 0; r < count; ++r) {
+                    for (std::size_t j = 0; j < layer.out; ++j) {
+                        T s = y[r * sy + j];
+                        dX[r * ds + j] = dY[r * ds + j] * s * (T(1) - s);
+                    }
+                }
+                break;
+            default:
+                break;
+            }
+            cur = 1 - cur;
+        }
+    }
+
+    // 4) Apply the mean gradient
+    {
+        PhaseTimer timer(telemetry, TrainPhase::Update);
+        optimizer_t.apply(optimizer_t.next(), 0, params_t.size(), grads, params_t.data());
+    }
+    return loss;
+}
+
+template <typename T>
+void BasicNetwork<T>::train(const std::vector<std::vector<T>>& trainInputs, const std::vector<int>& trainLabels, const TrainConfig& config)
+{
+    if (trainInputs.size() != trainLabels.size()) {
+        throw std::runtime_error("Mismatch in trainInputs and trainLabels sizes.");
+    }
+    for (const auto& input : trainInputs) {
+        if (input.size() != inputSize_t) {
+            throw std::runtime_error("Input size mismatch.");
+        }
+    }
+
+    const std::size_t numSamples = trainInputs.size();
+    const std::size_t batchSize = std::max<std::size_t>(1, config.batchSize);
+    std::vector<std::size_t> order(numSamples);
+    for (std::size_t i = 0; i < numSamples; ++i) {
+        order[i] = i;
+    }
+    std::mt19937 rng(config.seed);
+    std::vector<const T*> batchInputs(batchSize);
+    std::vector<int> batchLabels(batchSize);
+    reserve(batchSize);
+    const std::size_t batchesPerEpoch = (numSamples + batchSize - 1) / batchSize;
+    optimizer_t.reset(config.optimizer, learningRate_t, params_t.size(),
+        batchesPerEpoch, batchesPerEpoch * std::max(0, config.epochs));
+    Telemetry* telemetry = config.telemetry;
+
+    for (int epoch = 0; epoch < config.epochs; ++epoch) {
+        if (config.shuffle) {
+            std::shuffle(order.begin(), order.end(), rng);
+        }
+        if (telemetry) {
+            telemetry->beginEpoch(epoch);
+        }
+
+        double totalLoss = 0.0;
+        for (std::size_t start = 0; start < numSamples; start += batchSize) {
+            std::size_t count = std::min(batchSize, numSamples - start);
+            {
+                PhaseTimer timer(telemetry, TrainPhase::Fetch);
+                for (std::size_t b = 0; b < count; ++b) {
+                    batchInputs[b] = trainInputs[order[start + b]].data();
+                    batchLabels[b] = trainLabels[order[start + b]];
+                }
+            }
+            std::size_t correct = 0;
+            double loss = trainBatch(batchInputs.data(), batchLabels.data(), count, &correct, telemetry);
+            totalLoss += loss;
+            if (telemetry) {
+                telemetry->addBatch(count, loss, correct);
+            }
+        }
+        if (telemetry) {
+            telemetry->endEpoch();
+        }
+
+        std::cout << "Epoch " << epoch
+            << " - avg loss = " << (totalLoss / numSamples)
+            << std::endl;
+    }
+}
+
+template <typename T>
+void BasicNetwork<T>::saveModel(const std::string& filename) const
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs) {
+        throw std::runtime_error("Could not open file for writing: " + filename);
+    }
+
+    // 0) Header and topology
+    std::uint32_t unused = 0;
+    ofs.write(kNetworkMagic, sizeof(kNetworkMagic));
+    writeRaw(ofs, &kNetworkVersion, 1, unused);
+    const std::uint32_t scalarBytes = sizeof(T);
+    writeRaw(ofs, &scalarBytes, 1, unused);
+    const std::uint64_t inputSize = inputSize_t;
+    writeRaw(ofs, &inputSize, 1, unused);
+    const std::uint32_t layerCount = static_cast<std::uint32_t>(layers_t.size());
+    writeRaw(ofs, &layerCount, 1, unused);
+    for (const Layer& layer : layers_t) {
+        const std::uint32_t type = static_cast<std::uint32_t>(layer.type);
+        const std::uint64_t units = layer.wRows;
+        const std::uint32_t kernel = static_cast<std::uint32_t>(layer.kernel);
+        const std::uint32_t pad = static_cast<std::uint32_t>(layer.pad);
+        writeRaw(ofs, &type, 1, unused);
+        writeRaw(ofs, &units, 1, unused);
+        writeRaw(ofs, &kernel, 1, unused);
+        writeRaw(ofs, &pad, 1, unused);
+    }
+
+    // 1) Dense and convolution parameters without the row padding, then their CRC
+    std::uint32_t crc = 0;
+    for (const Layer& layer : layers_t) {
+        if (layer.wRows == 0) {
+            continue;
+        }
+        for (std::size_t i = 0; i < layer.wRows; ++i) {
+            writeRaw(ofs, params_t.data() + layer.wOffset + i * layer.wStride, layer.wCols, crc);
+        }
+        writeRaw(ofs, params_t.data() + layer.bOffset, layer.wRows, crc);
+    }
+    writeRaw(ofs, &crc, 1, unused);
+
+    if (!ofs) {
+        throw std::runtime_error("Could not write model file: " + filename);
+    }
+}
+
+template <typename T>
+void BasicNetwork<T>::loadModel(const std::string& filename)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Could not open file for reading: " + filename);
+    }
+    ifs.seekg(0, std::ios::end);
+    const std::uint64_t fileSize = static_cast<std::uint64_t>(ifs.tellg());
+    ifs.seekg(0);
+
+    char magic[sizeof(kNetworkMagic)] = {};
+    ifs.read(magic, sizeof(magic));
+    const auto version = readRaw<std::uint32_t>(ifs);
+    if (!ifs || !std::equal(magic, magic + sizeof(magic), kNetworkMagic) || version == 0 || version > kNetworkVersion) {
+        throw std::runtime_error("Not a network file: " + filename);
+    }
+    const auto scalarBytes = readRaw<std::uint32_t>(ifs);
+    if (scalarBytes != sizeof(float) && scalarBytes != sizeof(double)) {
+        throw std::runtime_error("Unsupported scalar size in network file: " + filename);
+    }
+
+    // 0) Rebuild the topology stored in the file
+    const auto inputSize = readRaw<std::uint64_t>(ifs);
+    const auto layerCount = readRaw<std::uint32_t>(ifs);
+    if (!ifs || layerCount == 0 || layerCount > 1024 || inputSize > fileSize) {
+        throw std::runtime_error("Corrupt network file: " + filename);
+    }
+    std::vector<LayerSpec> specs(layerCount);
+    for (LayerSpec& spec : specs) {
+        const auto type = readRaw<std::uint32_t>(ifs);
+        spec.units = static_cast<std::size_t>(readRaw<std::uint64_t>(ifs));
+        if (version >= 2) {
+            spec.kernel = readRaw<std::uint32_t>(ifs);
+            spec.pad = readRaw<std::uint32_t>(ifs);
+        }
+        if (type > static_cast<std::uint32_t>(LayerType::MaxPool)) {
+            throw std::runtime_error("Unknown layer type in network file: " + filename);
+        }
+        // Nothing in the file can be larger than the file
+        if (spec.units > fileSize || spec.kernel > fileSize || spec.pad > fileSize) {
+            throw std::runtime_error("Corrupt network file: " + filename);
+        }
+        spec.type = static_cast<LayerType>(type);
+    }
+    if (!ifs) {
+        throw std::runtime_error("Network file is truncated: " + filename);
+    }
+
+    // The file must hold every parameter of that topology before anything is allocated for it
+    std::size_t paramCount = 0;
+    std::uint64_t storedValues = 0;
+    for (const Layer& layer : plan(static_cast<std::size_t>(inputSize), specs, paramCount)) {
+        storedValues += layer.wRows * (layer.wCols + 1);
+    }
+    if (storedValues > (fileSize - static_cast<std::uint64_t>(ifs.tellg())) / scalarBytes) {
+        throw std::runtime_error("Network file is truncated: " + filename);
+    }
+
+    // Loaded into a network of its own: a file that turns out corrupt leaves this one as it was
+    BasicNetwork loaded(static_cast<std::size_t>(inputSize), specs, static_cast<double>(learningRate_t),
+        std::max<std::size_t>(1, capacity_t));
+
+    // 1) Parameters, converted to T
+    std::vector<char> buffer;
+    std::uint32_t crc = 0;
+    for (const Layer& layer : loaded.layers_t) {
+        if (layer.wRows == 0) {
+            continue;
+        }
+        T* params = loaded.params_t.data();
+        for (std::size_t i = 0; i < layer.wRows; ++i) {
+            readValues(ifs, params + layer.wOffset + i * layer.wStride, layer.wCols, scalarBytes, buffer, crc);
+        }
+        readValues(ifs, params + layer.bOffset, layer.wRows, scalarBytes, buffer, crc);
+    }
+    const auto storedCrc = readRaw<std::uint32_t>(ifs);
+    if (!ifs) {
+        throw std::runtime_error("Network file is truncated: " + filename);
+    }
+    if (storedCrc != crc) {
+        throw std::runtime_error("Network file parameters are corrupt (CRC mismatch): " + filename);
+    }
+    *this = std::move(loaded);
+}
+
+template class BasicNetwork<float>;
+template class BasicNetwork<double>;
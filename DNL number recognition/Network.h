@@ -0,0 +1,172 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "math.h"
+#include "Model.h"
+#include "Optimizer.h"
+#include "Telemetry.h"
+
+enum class LayerType : std::uint32_t
+{
+    Dense = 0,   // y = W x + b
+    ReLU = 1,
+    Sigmoid = 2,
+    Softmax = 3, // only as the last layer; trained with cross-entropy
+    Conv2D = 4,  // `units` filters of kernel x kernel, stride 1, `pad` zeros around the input
+    MaxPool = 5, // max over kernel x kernel windows, stride kernel
+};
+
+struct LayerSpec
+{
+    LayerType type = LayerType::Dense;
+    std::size_t units = 0;  // outputs of a Dense layer, filters of a Conv2D; activations keep their input size
+    std::size_t kernel = 0; // Conv2D / MaxPool window size
+    std::size_t pad = 0;    // Conv2D only, smaller than kernel
+};
+
+/*
+
+ Parse a layer list such as "128,relu,64,relu,10,softmax": a number is a dense
+ layer with that many outputs, the names are the activations. "conv8k5" is a
+ convolution with 8 filters of 5x5 ("conv8k3p1" pads the input by 1), "pool2" a
+ 2x2 max pool: "conv8k5,relu,pool2,conv16k5,relu,pool2,10,softmax".
+
+*/
+std::vector<LayerSpec> parseLayers(const std::string& spec);
+
+// The inverse of parseLayers
+std::string describeLayers(const std::vector<LayerSpec>& layers);
+
+/*
+
+ Feed-forward network built from a stack of layers, templated on the scalar type
+ like BasicModel (see Network / FloatNetwork).
+
+ The parameters live in one 64-byte aligned buffer ([ W | b ] per dense or
+ convolution layer, padded rows). All activations, backward deltas and gradients for up to
+ batchCapacity() samples live in a second one, the workspace arena, planned when
+ the network is built: forward and training steps allocate nothing.
+ The arena makes forward() and training non-const: one network must not be
+ used from several threads at once.
+
+ Convolution and pooling layers see their input as a channels x height x width
+ image; a network input whose size is a square number is one square channel
+ (28x28 for MNIST). Dense layers flatten whatever they get.
+ A convolution runs as im2col + gemm per sample: W holds one filter per row over
+ channels x kernel x kernel taps, and the product filters x positions is already
+ the output image. Unrolling one sample at a time keeps it in cache, where the
+ unrolled images of a whole batch would not fit.
+
+*/
+template <typename T>
+class BasicNetwork
+{
+public:
+    using Scalar = T;
+
+    // The last layer must be Softmax for training. maxBatch sizes the arena; larger
+    // batches grow it.
+    BasicNetwork(std::size_t inputSize, const std::vector<LayerSpec>& layers, double lr = 0.01,
+        std::size_t maxBatch = 64);
+
+    // A network with the topology and parameters of a saved file
+    static BasicNetwork fromFile(const std::string& filename, double lr = 0.01, std::size_t maxBatch = 64);
+
+    std::size_t inputSize() const { return inputSize_t; }
+    std::size_t outputSize() const { return layers_t.back().out; }
+    std::size_t paramCount() const { return params_t.size(); }
+    std::size_t batchCapacity() const { return capacity_t; }
+    std::vector<LayerSpec> layers() const;
+
+    /*
+
+    Forward pass for inputs[0..count) (each inputSize() values). Returns count rows
+    of outputSize() values, outputStride() apart, valid until the next call.
+
+    */
+    const T* forward(const T* const* inputs, std::size_t count);
+    std::size_t outputStride() const { return layers_t.back().actStride; }
+
+    std::vector<T> forward(const std::vector<T>& input);
+    int predict(const std::vector<T>& input);
+
+    /*
+
+    One optimizer step on the batch-mean gradient of softmax cross-entropy (plain
+    SGD, or what the last train() call configured).
+    Returns the summed loss; correct, if given, receives the number of samples
+    the network classified correctly before the update.
+
+    */
+    double trainBatch(const T* const* inputs, const int* labels, std::size_t count,
+        std::size_t* correct = nullptr, Telemetry* telemetry = nullptr);
+
+    // Mini-batch training over the data set (uses epochs, batchSize, shuffle, seed,
+    // optimizer and telemetry from the config; runs on the calling thread)
+    void train(const std::vector<std::vector<T>>& trainInputs,
+        const std::vector<int>& trainLabels,
+        const TrainConfig& config);
+
+    /*
+
+    Save / load, topology included (loadModel replaces the current one):
+    "DNLN" | u32 version | u32 bytes per value | u64 inputSize | u32 layer count
+    | per layer: u32 type, u64 units, u32 kernel, u32 pad | per dense / conv layer: W rows, b
+    | u32 CRC-32 of the values
+    Version 1 files (no kernel and pad) still load.
+
+    */
+    void saveModel(const std::string& filename) const;
+    void loadModel(const std::string& filename);
+
+private:
+    struct Layer {
+        LayerType type;
+        std::size_t in, out;
+        // Image geometry (a flat layer is size x 1 x 1)
+        std::size_t inH, inW, inC, outH, outW, outC;
+        std::size_t kernel, pad;
+        // Dense / Conv2D: the wRows x wCols weights and the biases, as offsets into
+        // params_t (and the gradient block of the arena)
+        std::size_t wRows, wCols, wOffset, wStride, bOffset;
+        // This layer's output rows in the arena
+        std::size_t actOffset, actStride;
+    };
+
+    // The layers of a topology and the size of their parameter buffer, nothing allocated
+    static std::vector<Layer> plan(std::size_t inputSize, const std::vector<LayerSpec>& layers, std::size_t& paramCount);
+    void build(std::size_t inputSize, const std::vector<LayerSpec>& layers);
+    void reserve(std::size_t batchSize);
+
+    // Run layers [0, end) on the batch already copied into the input block
+    void forwardLayers(std::size_t count, std::size_t end);
+
+    const T* act(std::size_t l) const { return arena_t.data() + (l == 0 ? inputOffset_t : layers_t[l - 1].actOffset); }
+    T* act(std::size_t l) { return arena_t.data() + (l == 0 ? inputOffset_t : layers_t[l - 1].actOffset); }
+    std::size_t actStride(std::size_t l) const { return l == 0 ? inputStride_t : layers_t[l - 1].actStride; }
+
+    std::size_t inputSize_t;
+    std::vector<Layer> layers_t;
+    math::AlignedVector<T> params_t;
+
+    // Arena: [ input | output of every layer | delta A | delta B | im2col | gradients ], each
+    // block capacity_t rows but im2col, which holds one sample's unrolled image (the
+    // gradients are laid out like params_t)
+    math::AlignedVector<T> arena_t;
+    std::size_t capacity_t = 0;
+    std::size_t inputOffset_t = 0;
+    std::size_t inputStride_t = 0;
+    std::size_t deltaOffset_t[2] = {};
+    std::size_t deltaStride_t = 0;
+    std::size_t colOffset_t = 0;
+    std::size_t gradOffset_t = 0;
+
+    T learningRate_t;
+    Optimizer<T> optimizer_t;
+};
+
+using Network = BasicNetwork<double>;
+using FloatNetwork = BasicNetwork<float>;
@@ -0,0 +1,112 @@
+#include "Optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+OptimizerType parseOptimizerType(const std::string& name)
+{
+    if (name == "sgd") return OptimizerType::SGD;
+    if (name == "momentum") return OptimizerType::Momentum;
+    if (name == "nesterov") return OptimizerType::Nesterov;
+    if (name == "adam") return OptimizerType::Adam;
+    throw std::runtime_error("Unknown optimizer '" + name + "' (sgd, momentum, nesterov or adam)");
+}
+
+LRSchedule parseSchedule(const std::string& name)
+{
+    if (name == "constant") return LRSchedule::Constant;
+    if (name == "step") return LRSchedule::Step;
+    if (name == "cosine") return LRSchedule::Cosine;
+    throw std::runtime_error("Unknown learning rate schedule '" + name + "' (constant, step or cosine)");
+}
+
+template <typename T>
+void Optimizer<T>::reset(const OptimizerConfig& config, double baseRate, std::size_t paramCount,
+    std::size_t stepsPerEpoch, std::size_t totalSteps)
+{
+    config_t = config;
+    baseRate_t = baseRate;
+    rate_t = baseRate;
+    stepsPerEpoch_t = std::max<std::size_t>(1, stepsPerEpoch);
+    totalSteps_t = totalSteps;
+    step_t = 0;
+
+    // assign() keeps the capacity: a new run over the same model does not allocate
+    const bool hasFirst = config.type != OptimizerType::SGD;
+    const bool hasSecond = config.type == OptimizerType::Adam;
+    first_t.assign(hasFirst ? paramCount : 0, T(0));
+    second_t.assign(hasSecond ? paramCount : 0, T(0));
+}
+
+template <typename T>
+void Optimizer<T>::restore(std::size_t steps, const math::AlignedVector<T>& first, const math::AlignedVector<T>& second)
+{
+    if (first.size() != first_t.size() || second.size() != second_t.size()) {
+        throw std::runtime_error("Optimizer state does not match the optimizer or the model.");
+    }
+    step_t = steps;
+    std::copy(first.begin(), first.end(), first_t.begin());
+    std::copy(second.begin(), second.end(), second_t.begin());
+}
+
+template <typename T>
+typename Optimizer<T>::Step Optimizer<T>::next()
+{
+    const std::size_t t = step_t++; // steps done before this one
+
+    double factor = 1.0;
+    switch (config_t.schedule) {
+    case LRSchedule::Step: {
+        const std::size_t epoch = t / stepsPerEpoch_t;
+        factor = std::pow(config_t.stepGamma, static_cast<double>(epoch / std::max(1, config_t.stepEpochs)));
+        break;
+    }
+    case LRSchedule::Cosine: {
+        const double progress = totalSteps_t > 1
+            ? std::min(1.0, static_cast<double>(t) / static_cast<double>(totalSteps_t - 1)) : 0.0;
+        factor = config_t.minFactor + (1.0 - config_t.minFactor) * 0.5 * (1.0 + std::cos(3.14159265358979323846 * progress));
+        break;
+    }
+    default:
+        break;
+    }
+    if (t < config_t.warmupSteps) {
+        factor *= static_cast<double>(t + 1) / static_cast<double>(config_t.warmupSteps);
+    }
+    rate_t = baseRate_t * factor;
+
+    Step step{ static_cast<T>(rate_t), static_cast<T>(config_t.epsilon) };
+    if (config_t.type == OptimizerType::Adam) {
+        // rate * m_hat / (sqrt(v_hat) + eps) = rate * sqrt(c2) / c1 * m / (sqrt(v) + eps * sqrt(c2))
+        const double c1 = 1.0 - std::pow(config_t.beta1, static_cast<double>(step_t));
+        const double c2 = 1.0 - std::pow(config_t.beta2, static_cast<double>(step_t));
+        step.rate = static_cast<T>(rate_t * std::sqrt(c2) / c1);
+        step.epsilon = static_cast<T>(config_t.epsilon * std::sqrt(c2));
+    }
+    return step;
+}
+
+template <typename T>
+void Optimizer<T>::apply(const Step& step, std::size_t begin, std::size_t n, const T* grads, T* params)
+{
+    const T* g = grads + begin;
+    T* p = params + begin;
+    switch (config_t.type) {
+    case OptimizerType::SGD:
+        math::axpy(n, -step.rate, g, p);
+        break;
+    case OptimizerType::Momentum:
+    case OptimizerType::Nesterov:
+        math::momentumStep(n, step.rate, static_cast<T>(config_t.momentum),
+            config_t.type == OptimizerType::Nesterov, g, first_t.data() + begin, p);
+        break;
+    case OptimizerType::Adam:
+        math::adamStep(n, step.rate, static_cast<T>(config_t.beta1), static_cast<T>(config_t.beta2),
+            step.epsilon, g, first_t.data() + begin, second_t.data() + begin, p);
+        break;
+    }
+}
+
+template class Optimizer<float>;
+template class Optimizer<double>;
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#include "math.h"
+
+enum class OptimizerType
+{
+    SGD,      // p -= rate * g
+    Momentum, // heavy ball: v = momentum * v + g, p -= rate * v
+    Nesterov, // look-ahead momentum: p -= rate * (g + momentum * v)
+    Adam,     // per-parameter steps from running averages of g and g^2
+};
+
+enum class LRSchedule
+{
+    Constant,
+    Step,   // multiplied by stepGamma every stepEpochs epochs
+    Cosine, // half a cosine wave from the base rate down to minFactor * base rate at the last step
+};
+
+struct OptimizerConfig
+{
+    OptimizerType type = OptimizerType::SGD;
+    double momentum = 0.9; // Momentum / Nesterov
+    double beta1 = 0.9;    // Adam
+    double beta2 = 0.999;
+    double epsilon = 1e-8;
+
+    // The learning rate of a step is the model's base rate times the schedule's
+    // factor, ramped up linearly from 0 over the first warmupSteps updates
+    LRSchedule schedule = LRSchedule::Constant;
+    std::size_t warmupSteps = 0;
+    int stepEpochs = 1;
+    double stepGamma = 0.5;
+    double minFactor = 0.0;
+
+    // Plain SGD at a constant rate: what the per-sample and Hogwild trainers implement
+    bool isPlainSGD() const
+    {
+        return type == OptimizerType::SGD && schedule == LRSchedule::Constant && warmupSteps == 0;
+    }
+};
+
+// Names for command lines: "sgd", "momentum", "nesterov", "adam" / "constant", "step", "cosine"
+OptimizerType parseOptimizerType(const std::string& name);
+LRSchedule parseSchedule(const std::string& name);
+
+/*
+
+ Applies gradients to a flat parameter buffer and owns the per-parameter state
+ (velocity, or Adam's two moments) laid out like the parameters.
+
+ An update is split in two so it can run in parallel chunks: next() computes the
+ step's scalars (scheduled rate, bias corrections) once, then apply() updates any
+ range of the parameters in one fused SIMD pass over parameters, gradient and
+ state (math::momentumStep / math::adamStep).
+
+*/
+template <typename T>
+class Optimizer
+{
+public:
+    struct Step {
+        T rate;    // learning rate of this step (for Adam with the bias correction folded in)
+        T epsilon; // Adam only, bias-corrected
+    };
+
+    /*
+
+    Start a run over paramCount parameters: the state is cleared and the schedule
+    planned for totalSteps updates, stepsPerEpoch of them per epoch.
+
+    */
+    void reset(const OptimizerConfig& config, double baseRate, std::size_t paramCount,
+        std::size_t stepsPerEpoch, std::size_t totalSteps);
+
+    // Scalars for the next update; advances the step count
+    Step next();
+
+    // params[begin, begin + n) -= update(grads[begin, begin + n)). Different ranges of the
+    // same step may be applied concurrently.
+    void apply(const Step& step, std::size_t begin, std::size_t n, const T* grads, T* params);
+
+    // The per-parameter state, for checkpoints (empty when the optimizer has none)
+    const math::AlignedVector<T>& firstMoment() const { return first_t; }
+    const math::AlignedVector<T>& secondMoment() const { return second_t; }
+
+    // Continue a run after reset() with the same arguments: the step count and the state
+    // saved from the optimizer being continued
+    void restore(std::size_t steps, const math::AlignedVector<T>& first, const math::AlignedVector<T>& second);
+
+    const OptimizerConfig& config() const { return config_t; }
+    std::size_t steps() const { return step_t; }
+    // Scheduled rate of the last step (before Adam's bias correction)
+    double learningRate() const { return rate_t; }
+
+private:
+    OptimizerConfig config_t;
+    double baseRate_t = 0.0;
+    double rate_t = 0.0;
+    std::size_t stepsPerEpoch_t = 1;
+    std::size_t totalSteps_t = 0;
+    std::size_t step_t = 0;
+
+    // Momentum / Nesterov velocity, or Adam's first moment; Adam's second moment
+    math::AlignedVector<T> first_t;
+    math::AlignedVector<T> second_t;
+};
+
+extern template class Optimizer<float>;
+extern template class Optimizer<double>;
@@ -0,0 +1,185 @@
+#include "QuantizedModel.h"
+
+namespace {
+    constexpr char kQuantMagic[4] = { 'D', 'N', 'L', 'Q' };
+    constexpr std::uint32_t kQuantVersion = 1;
+    constexpr float kQMax = 127.0f;
+
+    template <typename V>
+    void writeRaw(std::ofstream& ofs, const V* data, std::size_t n) {
+        ofs.write(reinterpret_cast<const char*>(data), n * sizeof(V));
+    }
+
+    template <typename V>
+    void readRaw(std::ifstream& ifs, V* data, std::size_t n) {
+        ifs.read(reinterpret_cast<char*>(data), n * sizeof(V));
+    }
+
+    std::int8_t quantize(float v, float invScale) {
+        float q = std::round(v * invScale);
+        return static_cast<std::int8_t>(std::max(-kQMax, std::min(kQMax, q)));
+    }
+}
+
+template <typename T>
+QuantizedModel::Layer QuantizedModel::quantizeLayer(math::MatrixView<const T> W, const T* bias)
+{
+    Layer layer;
+    layer.rows = W.rows;
+    layer.cols = W.cols;
+    layer.stride = math::alignedStride<std::int8_t>(W.cols);
+    layer.weights.assign(layer.rows * layer.stride, 0);
+    layer.scales.resize(layer.rows);
+    layer.bias.assign(bias, bias + layer.rows);
+
+    for (std::size_t i = 0; i < layer.rows; ++i) {
+        const T* row = W.row(i);
+        float maxAbs = 0.0f;
+        for (std::size_t j = 0; j < layer.cols; ++j)
+            maxAbs = std::max(maxAbs, std::abs(static_cast<float>(row[j])));
+
+        // An all-zero row stays zero whatever the scale
+        float scale = maxAbs > 0.0f ? maxAbs / kQMax : 1.0f;
+        layer.scales[i] = scale;
+
+        std::int8_t* q = layer.weights.data() + i * layer.stride;
+        for (std::size_t j = 0; j < layer.cols; ++j)
+            q[j] = quantize(static_cast<float>(row[j]), 1.0f / scale);
+    }
+    return layer;
+}
+
+template <typename T>
+QuantizedModel QuantizedModel::fromModel(const BasicModel<T>& model)
+{
+    // Quantization scales are per output unit, so W1 is quantized hidden-major
+    const auto W1t = model.weights1T();
+    const std::size_t stride = math::alignedStride<T>(W1t.rows);
+    math::AlignedVector<T> w1(W1t.cols * stride);
+    for (std::size_t j = 0; j < W1t.rows; ++j)
+        for (std::size_t i = 0; i < W1t.cols; ++i)
+            w1[i * stride + j] = W1t(j, i);
+
+    QuantizedModel q;
+    q.layers_t.push_back(quantizeLayer(math::MatrixView<const T>{ w1.data(), W1t.cols, W1t.rows, stride }, model.bias1()));
+    q.layers_t.push_back(quantizeLayer(model.weights2(), model.bias2()));
+    return q;
+}
+
+void QuantizedModel::denseForward(const Layer& layer, const float* x, std::vector<std::int8_t>& qx,
+    std::vector<std::int32_t>& acc, float* out)
+{
+    float maxAbs = 0.0f;
+    for (std::size_t j = 0; j < layer.cols; ++j)
+        maxAbs = std::max(maxAbs, std::abs(x[j]));
+    float xScale = maxAbs > 0.0f ? maxAbs / kQMax : 1.0f;
+
+    qx.resize(layer.cols);
+    for (std::size_t j = 0; j < layer.cols; ++j)
+        qx[j] = quantize(x[j], 1.0f / xScale);
+
+    acc.resize(layer.rows);
+    math::matVecMultiply(layer.view(), qx.data(), acc.data());
+
+    for (std::size_t i = 0; i < layer.rows; ++i)
+        out[i] = static_cast<float>(acc[i]) * (layer.scales[i] * xScale) + layer.bias[i];
+}
+
+template <typename T>
+std::vector<float> QuantizedModel::forward(const std::vector<T>& input) const
+{
+    if (layers_t.size() != 2)
+        throw std::runtime_error("QuantizedModel is empty");
+    if (input.size() != inputSize())
+        throw std::runtime_error("Input size mismatch");
+
+    std::vector<float> x(input.begin(), input.end());
+    std::vector<std::int8_t> qx;
+    std::vector<std::int32_t> acc;
+
+    std::vector<float> hidden(layers_t[0].rows);
+    denseForward(layers_t[0], x.data(), qx, acc, hidden.data());
+    math::reluInPlace(hidden);
+
+    std::vector<float> out(layers_t[1].rows);
+    denseForward(layers_t[1], hidden.data(), qx, acc, out.data());
+    math::softmaxInPlace(out.data(), out.size());
+    return out;
+}
+
+template <typename T>
+int QuantizedModel::predict(const std::vector<T>& input) const
+{
+    auto out = forward(input);
+    return static_cast<int>(std::distance(out.begin(), std::max_element(out.begin(), out.end())));
+}
+
+void QuantizedModel::saveModel(const std::string& filename) const
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs) {
+        throw std::runtime_error("Cannot open file to save quantized model.");
+    }
+
+    ofs.write(kQuantMagic, sizeof(kQuantMagic));
+    writeRaw(ofs, &kQuantVersion, 1);
+    for (const Layer& layer : layers_t) {
+        std::uint64_t dims[2] = { layer.rows, layer.cols };
+        writeRaw(ofs, dims, 2);
+        writeRaw(ofs, layer.scales.data(), layer.rows);
+        writeRaw(ofs, layer.bias.data(), layer.rows);
+        for (std::size_t i = 0; i < layer.rows; ++i)
+            writeRaw(ofs, layer.weights.data() + i * layer.stride, layer.cols);
+    }
+}
+
+void QuantizedModel::loadModel(const std::string& filename)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Cannot open file to load quantized model.");
+    }
+    ifs.seekg(0, std::ios::end);
+    const std::uint64_t fileSize = static_cast<std::uint64_t>(ifs.tellg());
+    ifs.seekg(0);
+
+    char magic[4] = {};
+    std::uint32_t version = 0;
+    ifs.read(magic, sizeof(magic));
+    readRaw(ifs, &version, 1);
+    if (!ifs || !std::equal(magic, magic + 4, kQuantMagic) || version != kQuantVersion) {
+        throw std::runtime_error("Not a quantized model file: " + filename);
+    }
+
+    std::vector<Layer> layers(2);
+    for (Layer& layer : layers) {
+        std::uint64_t dims[2] = {};
+        readRaw(ifs, dims, 2);
+        // Nothing in the file can be larger than the file
+        if (!ifs || dims[0] > fileSize || dims[1] > fileSize
+            || (dims[1] != 0 && dims[0] > fileSize / dims[1])) {
+            throw std::runtime_error("Corrupt quantized model file: " + filename);
+        }
+        layer.rows = dims[0];
+        layer.cols = dims[1];
+        layer.stride = math::alignedStride<std::int8_t>(layer.cols);
+        layer.scales.resize(layer.rows);
+        layer.bias.resize(layer.rows);
+        layer.weights.assign(layer.rows * layer.stride, 0);
+        readRaw(ifs, layer.scales.data(), layer.rows);
+        readRaw(ifs, layer.bias.data(), layer.rows);
+        for (std::size_t i = 0; i < layer.rows; ++i)
+            readRaw(ifs, layer.weights.data() + i * layer.stride, layer.cols);
+    }
+    if (!ifs || layers[0].rows != layers[1].cols) {
+        throw std::runtime_error("Corrupt quantized model file: " + filename);
+    }
+    layers_t = std::move(layers);
+}
+
+template QuantizedModel QuantizedModel::fromModel(const BasicModel<float>&);
+template QuantizedModel QuantizedModel::fromModel(const BasicModel<double>&);
+template std::vector<float> QuantizedModel::forward(const std::vector<float>&) const;
+template std::vector<float> QuantizedModel::forward(const std::vector<double>&) const;
+template int QuantizedModel::predict(const std::vector<float>&) const;
+template int QuantizedModel::predict(const std::vector<double>&) const;
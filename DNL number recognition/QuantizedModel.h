@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "math.h"
+#include "Model.h"
+
+/*
+
+ Inference-only int8 version of a trained BasicModel.
+ Weights are quantized symmetrically per output row (w ~ scale[i] * q, q in [-127, 127]),
+ activations per vector right before each dense layer; the dot products run on
+ int8 data with int32 accumulation and are rescaled to float before bias and activation.
+ Biases stay in float.
+
+*/
+class QuantizedModel
+{
+public:
+    QuantizedModel() = default;
+
+    template <typename T>
+    static QuantizedModel fromModel(const BasicModel<T>& model);
+
+    // Softmax probabilities for a single sample (T = float or double)
+    template <typename T>
+    std::vector<float> forward(const std::vector<T>& input) const;
+
+    template <typename T>
+    int predict(const std::vector<T>& input) const;
+
+    /*
+
+    Save / load the quantized model
+    "DNLQ" | u32 version | for each layer: u64 rows | u64 cols | row scales (f32) | bias (f32) | rows of int8
+
+    */
+    void saveModel(const std::string& filename) const;
+    void loadModel(const std::string& filename);
+
+    std::size_t inputSize() const { return layers_t.empty() ? 0 : layers_t.front().cols; }
+    std::size_t outputSize() const { return layers_t.empty() ? 0 : layers_t.back().rows; }
+
+private:
+    struct Layer {
+        std::size_t rows = 0;
+        std::size_t cols = 0;
+        std::size_t stride = 0;                  // padded row length in bytes
+        math::AlignedVector<std::int8_t> weights; // rows x stride
+        std::vector<float> scales;               // one per row
+        std::vector<float> bias;
+
+        math::MatrixView<const std::int8_t> view() const { return { weights.data(), rows, cols, stride }; }
+    };
+
+    // W1 (followed by ReLU) and W2 (followed by softmax)
+    std::vector<Layer> layers_t;
+
+    template <typename T>
+    static Layer quantizeLayer(math::MatrixView<const T> W, const T* bias);
+
+    // out = W * x + b, with x quantized on the fly
+    static void denseForward(const Layer& layer, const float* x, std::vector<std::int8_t>& qx,
+        std::vector<std::int32_t>& acc, float* out);
+};
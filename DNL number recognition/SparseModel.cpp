@@ -0,0 +1,218 @@
+#include "SparseModel.h"
+
+#include <type_traits>
+
+namespace {
+    constexpr char kSparseMagic[4] = { 'D', 'N', 'L', 'B' };
+    constexpr std::uint32_t kSparseVersion = 1;
+
+    template <typename V>
+    void writeRaw(std::ofstream& ofs, const V* data, std::size_t n) {
+        ofs.write(reinterpret_cast<const char*>(data), n * sizeof(V));
+    }
+
+    template <typename V>
+    void readRaw(std::ifstream& ifs, V* data, std::size_t n) {
+        ifs.read(reinterpret_cast<char*>(data), n * sizeof(V));
+    }
+}
+
+template <typename Weight>
+SparseModel::Layer SparseModel::packLayer(std::size_t rows, std::size_t cols, std::size_t R, std::size_t C,
+    Weight weight, const float* bias)
+{
+    Layer layer;
+    layer.rows = rows;
+    layer.cols = cols;
+    layer.blockRows = R;
+    layer.blockCols = C;
+    layer.bias.assign(bias, bias + rows);
+
+    // Weights outside the matrix (edge blocks) read as zero
+    auto at = [&](std::size_t i, std::size_t j) -> float {
+        return i < rows && j < cols ? weight(i, j) : 0.0f;
+    };
+
+    std::vector<float> block(R * C);
+    layer.colStart.push_back(0);
+    for (std::size_t j0 = 0; j0 < cols; j0 += C) {
+        for (std::size_t i0 = 0; i0 < rows; i0 += R) {
+            bool nonzero = false;
+            for (std::size_t c = 0; c < C; ++c) {
+                for (std::size_t r = 0; r < R; ++r) {
+                    block[c * R + r] = at(i0 + r, j0 + c);
+                    nonzero = nonzero || block[c * R + r] != 0.0f;
+                }
+            }
+            if (nonzero) {
+                layer.blockRow.push_back(static_cast<std::uint32_t>(i0));
+                layer.values.insert(layer.values.end(), block.begin(), block.end());
+            }
+        }
+        layer.colStart.push_back(static_cast<std::uint32_t>(layer.blockRow.size()));
+    }
+    return layer;
+}
+
+template <typename T>
+SparseModel SparseModel::fromModel(const BasicModel<T>& model, std::size_t blockRows, std::size_t blockCols)
+{
+    if (blockRows == 0 || blockCols == 0) {
+        throw std::runtime_error("Sparse blocks must not be empty.");
+    }
+    const auto W1t = model.weights1T();
+    const auto W2 = model.weights2();
+    std::vector<float> b1(model.bias1(), model.bias1() + model.hiddenSize());
+    std::vector<float> b2(model.bias2(), model.bias2() + model.outputSize());
+
+    SparseModel s;
+    s.layers_t.push_back(packLayer(model.hiddenSize(), model.inputSize(), blockRows, blockCols,
+        [&](std::size_t i, std::size_t j) { return static_cast<float>(W1t(j, i)); }, b1.data()));
+    s.layers_t.push_back(packLayer(model.outputSize(), model.hiddenSize(), blockRows, blockCols,
+        [&](std::size_t i, std::size_t j) { return static_cast<float>(W2(i, j)); }, b2.data()));
+    return s;
+}
+
+template <typename T>
+const float* SparseModel::infer(const std::vector<T>& input) const
+{
+    if (layers_t.size() != 2)
+        throw std::runtime_error("SparseModel is empty");
+    if (input.size() != inputSize())
+        throw std::runtime_error("Input size mismatch");
+
+    thread_local Workspace ws;
+    const Layer& l1 = layers_t[0];
+    const Layer& l2 = layers_t[1];
+    ws.hidden.resize(l1.view().paddedRows());
+    ws.probs.resize(l2.view().paddedRows());
+
+    // hidden = ReLU(W1 * x + b1), over the nonzero pixels only
+    if constexpr (std::is_same_v<T, float>) {
+        math::sparsify(input.data(), input.size(), ws.input);
+    }
+    else {
+        ws.x.assign(input.begin(), input.end());
+        math::sparsify(ws.x.data(), ws.x.size(), ws.input);
+    }
+    math::bscMatVec(l1.view(), ws.input, ws.hidden.data());
+    math::addBias(ws.hidden.data(), l1.bias.data(), l1.rows);
+    math::reluInPlace(ws.hidden.data(), l1.rows);
+
+    // probs = softmax(W2 * hidden + b2), over the active hidden units only
+    math::sparsify(ws.hidden.data(), l1.rows, ws.input);
+    math::bscMatVec(l2.view(), ws.input, ws.probs.data());
+    math::addBias(ws.probs.data(), l2.bias.data(), l2.rows);
+    math::softmaxInPlace(ws.probs.data(), l2.rows);
+    return ws.probs.data();
+}
+
+template <typename T>
+std::vector<float> SparseModel::forward(const std::vector<T>& input) const
+{
+    const float* probs = infer(input);
+    return std::vector<float>(probs, probs + outputSize());
+}
+
+template <typename T>
+int SparseModel::predict(const std::vector<T>& input) const
+{
+    const float* probs = infer(input);
+    return static_cast<int>(std::max_element(probs, probs + outputSize()) - probs);
+}
+
+std::size_t SparseModel::bytes() const
+{
+    std::size_t n = 0;
+    for (const Layer& layer : layers_t) {
+        n += layer.values.size() * sizeof(float) + layer.bias.size() * sizeof(float)
+            + (layer.colStart.size() + layer.blockRow.size()) * sizeof(std::uint32_t);
+    }
+    return n;
+}
+
+void SparseModel::saveModel(const std::string& filename) const
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs) {
+        throw std::runtime_error("Cannot open file to save sparse model.");
+    }
+
+    ofs.write(kSparseMagic, sizeof(kSparseMagic));
+    writeRaw(ofs, &kSparseVersion, 1);
+    for (const Layer& layer : layers_t) {
+        std::uint64_t dims[5] = { layer.rows, layer.cols, layer.blockRows, layer.blockCols, layer.blockRow.size() };
+        writeRaw(ofs, dims, 5);
+        writeRaw(ofs, layer.bias.data(), layer.rows);
+        writeRaw(ofs, layer.colStart.data(), layer.colStart.size());
+        writeRaw(ofs, layer.blockRow.data(), layer.blockRow.size());
+        writeRaw(ofs, layer.values.data(), layer.values.size());
+    }
+}
+
+void SparseModel::loadModel(const std::string& filename)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Cannot open file to load sparse model.");
+    }
+    ifs.seekg(0, std::ios::end);
+    const std::uint64_t fileSize = static_cast<std::uint64_t>(ifs.tellg());
+    ifs.seekg(0);
+
+    char magic[4] = {};
+    std::uint32_t version = 0;
+    ifs.read(magic, sizeof(magic));
+    readRaw(ifs, &version, 1);
+    if (!ifs || !std::equal(magic, magic + 4, kSparseMagic) || version != kSparseVersion) {
+        throw std::runtime_error("Not a sparse model file: " + filename);
+    }
+
+    std::vector<Layer> layers(2);
+    for (Layer& layer : layers) {
+        std::uint64_t dims[5] = {};
+        readRaw(ifs, dims, 5);
+        // Nothing in the file can be larger than the file
+        if (!ifs || dims[2] == 0 || dims[3] == 0 || dims[0] > fileSize || dims[1] > fileSize
+            || dims[2] > fileSize || dims[3] > fileSize || dims[2] * dims[3] > fileSize
+            || dims[4] > fileSize / (dims[2] * dims[3])) {
+            throw std::runtime_error("Corrupt sparse model file: " + filename);
+        }
+        layer.rows = dims[0];
+        layer.cols = dims[1];
+        layer.blockRows = dims[2];
+        layer.blockCols = dims[3];
+        layer.bias.resize(layer.rows);
+        layer.colStart.resize(layer.view().blockCols() + 1);
+        layer.blockRow.resize(dims[4]);
+        layer.values.resize(layer.blockRow.size() * layer.blockRows * layer.blockCols);
+        readRaw(ifs, layer.bias.data(), layer.bias.size());
+        readRaw(ifs, layer.colStart.data(), layer.colStart.size());
+        readRaw(ifs, layer.blockRow.data(), layer.blockRow.size());
+        readRaw(ifs, layer.values.data(), layer.values.size());
+        if (!ifs) {
+            throw std::runtime_error("Corrupt sparse model file: " + filename);
+        }
+
+        // The kernel trusts the indices: every block column and block must lie inside the layer
+        bool valid = layer.colStart.front() == 0 && layer.colStart.back() == layer.blockRow.size();
+        for (std::size_t q = 1; valid && q < layer.colStart.size(); ++q)
+            valid = layer.colStart[q - 1] <= layer.colStart[q];
+        for (std::size_t k = 0; valid && k < layer.blockRow.size(); ++k)
+            valid = layer.blockRow[k] % layer.blockRows == 0 && layer.blockRow[k] < layer.rows;
+        if (!valid) {
+            throw std::runtime_error("Corrupt sparse model file: " + filename);
+        }
+    }
+    if (layers[0].rows != layers[1].cols) {
+        throw std::runtime_error("Corrupt sparse model file: " + filename);
+    }
+    layers_t = std::move(layers);
+}
+
+template SparseModel SparseModel::fromModel(const BasicModel<float>&, std::size_t, std::size_t);
+template SparseModel SparseModel::fromModel(const BasicModel<double>&, std::size_t, std::size_t);
+template std::vector<float> SparseModel::forward(const std::vector<float>&) const;
+template std::vector<float> SparseModel::forward(const std::vector<double>&) const;
+template int SparseModel::predict(const std::vector<float>&) const;
+template int SparseModel::predict(const std::vector<double>&) const;
@@ -0,0 +1,92 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "math.h"
+#include "Model.h"
+
+/*
+
+ Inference-only float version of a pruned BasicModel.
+ Each dense layer keeps only the blocks of weights that pruning left nonzero, block-sparse
+ and compressed by input (see math::BscView): a block covers R outputs x C inputs and
+ stores the R weights of each of its inputs together. A layer's input is first reduced
+ to its nonzeros (most MNIST pixels and about half of the ReLU outputs are zero), then
+ each nonzero input adds its stored runs of R weights to the outputs, R at a time in SIMD
+ registers. The work is proportional to nonzero inputs x stored weights, and the weights
+ read are only the stored ones. 1 x 1 blocks are plain CSC. Biases stay dense.
+
+*/
+class SparseModel
+{
+public:
+    SparseModel() = default;
+
+    // Pack the nonzero blocks of R x C (outputs x inputs) of both layers
+    template <typename T>
+    static SparseModel fromModel(const BasicModel<T>& model, std::size_t blockRows = 1, std::size_t blockCols = 1);
+
+    // Softmax probabilities for a single sample (T = float or double)
+    template <typename T>
+    std::vector<float> forward(const std::vector<T>& input) const;
+
+    // Uses a workspace private to the calling thread: no allocation after the first call
+    template <typename T>
+    int predict(const std::vector<T>& input) const;
+
+    /*
+
+    Save / load the sparse model
+    "DNLB" | u32 version | for each layer: u64 rows | u64 cols | u64 block rows R | u64 block cols C
+    | u64 blocks | bias (f32, rows) | block column starts (u32, cols / C rounded up + 1)
+    | first row of each block (u32, blocks) | block values (f32, blocks x C x R)
+
+    */
+    void saveModel(const std::string& filename) const;
+    void loadModel(const std::string& filename);
+
+    std::size_t inputSize() const { return layers_t.empty() ? 0 : layers_t.front().cols; }
+    std::size_t outputSize() const { return layers_t.empty() ? 0 : layers_t.back().rows; }
+
+    // Stored weights of layer i (padding inside blocks included)
+    std::size_t storedWeights(std::size_t layer) const { return layers_t.at(layer).values.size(); }
+
+    // Bytes of weights, indices and biases
+    std::size_t bytes() const;
+
+private:
+    struct Layer {
+        std::size_t rows = 0;
+        std::size_t cols = 0;
+        std::size_t blockRows = 1;                // R
+        std::size_t blockCols = 1;                // C
+        std::vector<std::uint32_t> colStart;      // first block of every block column, then the block count
+        std::vector<std::uint32_t> blockRow;      // first output of each block
+        math::AlignedVector<float> values;        // blocks x C x R
+        std::vector<float> bias;
+
+        math::BscView<float> view() const {
+            return { values.data(), colStart.data(), blockRow.data(), rows, cols, blockRows, blockCols };
+        }
+    };
+
+    struct Workspace {
+        std::vector<float> x;                     // double inputs, converted
+        math::SparseVector<float> input;
+        std::vector<float> hidden;
+        std::vector<float> probs;
+    };
+
+    // W1 (followed by ReLU) and W2 (followed by softmax)
+    std::vector<Layer> layers_t;
+
+    // weight(i, j) is output i's weight of input j
+    template <typename Weight>
+    static Layer packLayer(std::size_t rows, std::size_t cols, std::size_t R, std::size_t C,
+        Weight weight, const float* bias);
+
+    // Softmax probabilities in the calling thread's workspace, valid until its next call
+    template <typename T>
+    const float* infer(const std::vector<T>& input) const;
+};
@@ -0,0 +1,120 @@
+#include "Telemetry.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+    const char* const kPhaseNames[] = { "fetch", "augment", "forward", "backward", "update" };
+
+    double seconds(Telemetry::Clock::duration d) {
+        return std::chrono::duration<double>(d).count();
+    }
+}
+
+Telemetry::Telemetry(std::ostream& out, std::size_t reportEvery)
+    : out_t(out), reportEvery_t(reportEvery)
+{
+    window_t.start = Clock::now();
+}
+
+Telemetry::Telemetry(const std::string& path, std::size_t reportEvery)
+    : file_t(path, std::ios::app), out_t(file_t), reportEvery_t(reportEvery)
+{
+    if (!file_t) {
+        throw std::runtime_error("Cannot open telemetry file: " + path);
+    }
+    window_t.start = Clock::now();
+}
+
+void Telemetry::Counters::merge(const Counters& other)
+{
+    for (std::size_t p = 0; p < time.size(); ++p) {
+        time[p] += other.time[p];
+    }
+    batches += other.batches;
+    samples += other.samples;
+    correct += other.correct;
+    loss += other.loss;
+}
+
+void Telemetry::beginEpoch(int epoch)
+{
+    epoch_t = epoch;
+    epochBatches_t = 0;
+    window_t = Counters();
+    window_t.start = Clock::now();
+    epochCounters_t = window_t;
+}
+
+void Telemetry::endEpoch()
+{
+    epochCounters_t.merge(window_t);
+    write("epoch", epochCounters_t);
+    window_t = Counters();
+    window_t.start = Clock::now();
+}
+
+void Telemetry::addBatch(std::size_t samples, double loss, std::size_t correct)
+{
+    window_t.batches += 1;
+    window_t.samples += samples;
+    window_t.loss += loss;
+    window_t.correct += correct;
+    ++epochBatches_t;
+
+    if (reportEvery_t > 0 && window_t.batches >= reportEvery_t) {
+        write("batch", window_t);
+        epochCounters_t.merge(window_t);
+        window_t = Counters();
+        window_t.start = Clock::now();
+    }
+}
+
+void Telemetry::write(const char* event, const Counters& c)
+{
+    const double elapsed = seconds(Clock::now() - c.start);
+    const double samples = static_cast<double>(c.samples);
+
+    out_t << "{\"event\":\"" << event << "\",\"epoch\":" << epoch_t
+        << ",\"batch\":" << epochBatches_t
+        << ",\"samples\":" << c.samples
+        << ",\"seconds\":" << elapsed
+        << ",\"samples_per_s\":" << (elapsed > 0.0 ? samples / elapsed : 0.0)
+        << ",\"loss\":" << (c.samples ? c.loss / samples : 0.0)
+        << ",\"accuracy\":" << (c.samples ? c.correct / samples : 0.0)
+        << ",\"phase_s\":{";
+    for (std::size_t p = 0; p < c.time.size(); ++p) {
+        out_t << (p ? "," : "") << "\"" << kPhaseNames[p] << "\":" << seconds(c.time[p]);
+    }
+    out_t << "},\"peak_rss_bytes\":" << peakResidentBytes() << "}\n";
+    out_t.flush();
+}
+
+std::size_t Telemetry::peakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<std::size_t>(usage.ru_maxrss);        // bytes
+#else
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <ostream>
+#include <string>
+
+// Where a training step spends its time
+enum class TrainPhase
+{
+    Fetch,    // getting the next batch: gathering samples, or waiting for the augmentation stream
+    Augment,  // building augmented batches (on the stream's producer threads, overlapped with training)
+    Forward,
+    Backward, // gradients; per-sample SGD applies its update here too
+    Update,   // summing worker gradients and updating the parameters
+};
+
+/*
+
+ Training instrumentation, written as JSON lines.
+
+ Every `reportEvery` batches a "batch" record describes the batches since the
+ previous record; at the end of every epoch an "epoch" record covers the whole
+ epoch. Both hold samples/s, mean loss, training accuracy, the seconds spent in
+ each TrainPhase and the peak resident memory of the process:
+
+   {"event":"batch","epoch":0,"batch":200,"samples":6400,"seconds":0.71,
+    "samples_per_s":9014,"loss":0.52,"accuracy":0.86,
+    "phase_s":{"fetch":0.01,"augment":0.33,"forward":0.21,"backward":0.38,"update":0.09},
+    "peak_rss_bytes":104857600}
+
+ With data-parallel workers, forward and backward are the slowest worker's times,
+ so fetch + forward + backward + update is the wall time of the step. Augment is
+ producer thread time: it only slows training down when fetch (the wait for the
+ next batch) grows too.
+
+ Training takes a Telemetry* in TrainConfig; with none, no clock is read.
+
+*/
+class Telemetry
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Records go to `out`, which must outlive the Telemetry
+    explicit Telemetry(std::ostream& out, std::size_t reportEvery = 100);
+    // Records are appended to the file at `path`
+    explicit Telemetry(const std::string& path, std::size_t reportEvery = 100);
+
+    Telemetry(const Telemetry&) = delete;
+    Telemetry& operator=(const Telemetry&) = delete;
+
+    void beginEpoch(int epoch);
+    void endEpoch();
+
+    void addTime(TrainPhase phase, Clock::duration time) {
+        window_t.time[static_cast<std::size_t>(phase)] += time;
+    }
+
+    // One finished batch: summed loss and number of correct predictions
+    void addBatch(std::size_t samples, double loss, std::size_t correct);
+
+    // Peak resident set size of this process so far, in bytes (0 if unknown)
+    static std::size_t peakResidentBytes();
+
+private:
+    struct Counters {
+        std::array<Clock::duration, 5> time{};
+        std::size_t batches = 0;
+        std::size_t samples = 0;
+        std::size_t correct = 0;
+        double loss = 0.0;
+        Clock::time_point start;
+
+        void merge(const Counters& other);
+    };
+
+    void write(const char* event, const Counters& counters);
+
+    std::ofstream file_t;
+    std::ostream& out_t;
+    std::size_t reportEvery_t;
+    int epoch_t = 0;
+    std::size_t epochBatches_t = 0;
+    Counters window_t; // since the last batch record
+    Counters epochCounters_t; // earlier windows of this epoch
+};
+
+/*
+
+ Adds the time from construction to destruction to a phase of the telemetry.
+ Does nothing, not even read the clock, when the telemetry is null.
+
+*/
+class PhaseTimer
+{
+public:
+    PhaseTimer(Telemetry* telemetry, TrainPhase phase)
+        : telemetry_t(telemetry), phase_t(phase)
+    {
+        if (telemetry_t) {
+            start_t = Telemetry::Clock::now();
+        }
+    }
+
+    ~PhaseTimer() {
+        if (telemetry_t) {
+            telemetry_t->addTime(phase_t, Telemetry::Clock::now() - start_t);
+        }
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    Telemetry* telemetry_t;
+    TrainPhase phase_t;
+    Telemetry::Clock::time_point start_t;
+};
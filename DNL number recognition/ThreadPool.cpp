@@ -0,0 +1,112 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(std::size_t threads)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (std::size_t i = 1; i < threads; ++i) {
+        workers_t.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_t);
+        stop_t = true;
+    }
+    wake_t.notify_all();
+    for (auto& worker : workers_t) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(std::size_t count, TaskRef task)
+{
+    if (count == 0) {
+        return;
+    }
+    if (workers_t.empty() || count == 1) {
+        for (std::size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit(submit_t);
+    {
+        std::lock_guard<std::mutex> lock(mutex_t);
+        task_t = &task;
+        count_t = count;
+        next_t.store(0, std::memory_order_relaxed);
+        error_t = nullptr;
+        ++generation_t;
+    }
+    wake_t.notify_all();
+
+    runTasks(task, count);
+
+    // Every index is claimed once runTasks returns; wait for the workers still
+    // running theirs, then retire the job so late wakers don't pick it up.
+    std::unique_lock<std::mutex> lock(mutex_t);
+    idle_t.wait(lock, [this] { return active_t == 0; });
+    task_t = nullptr;
+    if (error_t) {
+        std::exception_ptr error = error_t;
+        error_t = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    std::uint64_t seen = 0;
+    for (;;) {
+        const TaskRef* task = nullptr;
+        std::size_t count = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_t);
+            wake_t.wait(lock, [&] { return stop_t || generation_t != seen; });
+            if (stop_t) {
+                return;
+            }
+            seen = generation_t;
+            if (task_t == nullptr) {
+                continue; // woke up after the job was already finished
+            }
+            task = task_t;
+            count = count_t;
+            ++active_t;
+        }
+
+        runTasks(*task, count);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_t);
+            --active_t;
+        }
+        idle_t.notify_one();
+    }
+}
+
+void ThreadPool::runTasks(TaskRef task, std::size_t count)
+{
+    for (;;) {
+        std::size_t i = next_t.fetch_add(1, std::memory_order_relaxed);
+        if (i >= count) {
+            return;
+        }
+        try {
+            task(i);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_t);
+            if (!error_t) {
+                error_t = std::current_exception();
+            }
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Non-owning reference to a callable taking an index. Unlike std::function it
+// never allocates, whatever the callable captures; it must outlive the call.
+class TaskRef
+{
+public:
+    template <typename F>
+    TaskRef(F& task)
+        : object_t(const_cast<void*>(static_cast<const void*>(&task))), call_t(&invoke<F>) {}
+
+    void operator()(std::size_t i) const { call_t(object_t, i); }
+
+private:
+    template <typename F>
+    static void invoke(void* object, std::size_t i) { (*static_cast<F*>(object))(i); }
+
+    void* object_t;
+    void (*call_t)(void*, std::size_t);
+};
+
+/*
+
+ Fixed set of worker threads for fork-join loops.
+ The thread calling parallelFor() works too, so a pool of size N starts N - 1 threads.
+
+*/
+class ThreadPool
+{
+public:
+    // threads == 0 uses std::thread::hardware_concurrency()
+    explicit ThreadPool(std::size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t size() const { return workers_t.size() + 1; }
+
+    /*
+
+    Run task(i) for every i in [0, count) and wait until all of them finished.
+    Indices are handed out dynamically, so task(i) must not depend on which
+    thread runs it. The first exception thrown by a task is rethrown here.
+    Calls from several threads are run one after another; a task must not
+    call parallelFor on the same pool. Submitting a job does not allocate.
+
+    */
+    template <typename F>
+    void parallelFor(std::size_t count, F&& task) {
+        run(count, TaskRef(task));
+    }
+
+private:
+    void run(std::size_t count, TaskRef task);
+    void workerLoop();
+    void runTasks(TaskRef task, std::size_t count);
+
+    std::vector<std::thread> workers_t;
+
+    std::mutex submit_t; // held by the thread whose job is running
+    std::mutex mutex_t;
+    std::condition_variable wake_t;
+    std::condition_variable idle_t;
+
+    // Current job, guarded by mutex_t (next_t is claimed lock-free)
+    const TaskRef* task_t = nullptr;
+    std::size_t count_t = 0;
+    std::atomic<std::size_t> next_t{ 0 };
+    std::uint64_t generation_t = 0;
+    std::size_t active_t = 0; // workers currently inside the job
+    std::exception_ptr error_t;
+    bool stop_t = false;
+};
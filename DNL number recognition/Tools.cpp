@@ -0,0 +1,704 @@
+#include "Tools.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "DataReader.h"
+#include "InferenceServer.h"
+#include "Model.h"
+#include "QuantizedModel.h"
+#include "SparseModel.h"
+#include "ThreadPool.h"
+#include "Validation.h"
+
+namespace {
+    const std::string kTestImagesFile = "dataset/t10k-images-idx3-ubyte/t10k-images-idx3-ubyte";
+    const std::string kTestLabelsFile = "dataset/t10k-labels-idx1-ubyte/t10k-labels-idx1-ubyte";
+    const std::string kTrainImagesFile = "dataset/train-images.idx3-ubyte";
+    const std::string kTrainLabelsFile = "dataset/train-labels.idx1-ubyte";
+
+    void printUsage() {
+        std::cout << "Usage:\n"
+            << "  quantize <model> [output]\n"
+            << "  prune <model> [--out <file>] [--sparsity <w1>] [--sparsity2 <w2>] [--block <R>x<C>]\n"
+            << "        [--steps <n>] [--fine-tune <epochs>] [--lr <rate>] [--threads <n>]\n"
+            << "  classify <images> [--model <file>] [--out <file>] [--labels <idx>]\n"
+            << "           [--batch <n>] [--threads <n>] [--double]\n"
+            << "  serve [--model <file>] [--listen tcp:<port> | unix:<path>] [--max-batch <n>]\n"
+            << "        [--max-delay-us <n>] [--threads <n>] [--double]\n"
+            << "  query <images> [--connect <endpoint>] [--labels <idx>] [--connections <n>] [--count <n>]\n"
+            << "  train [--out <model>] [--epochs <n>] [--copies <n>] [--threads <n>] [--seed <n>]\n"
+            << "        [--checkpoint <file>] [--checkpoint-every <n>] [--resume]\n"
+            << "        [--hold-out <n>] [--validate-every <n>] [--patience <n>]\n";
+    }
+
+    int quantize(int argc, char* argv[]) {
+        if (argc < 3) {
+            printUsage();
+            return 1;
+        }
+        std::string modelFile = argv[2];
+        std::string outFile = argc > 3 ? argv[3]
+            : std::filesystem::path(modelFile).replace_extension(".q8").string();
+
+        Model net = Model::fromFile(modelFile);
+        QuantizedModel qnet = QuantizedModel::fromModel(net);
+
+        auto [testImages, testLabels] =
+            DataReader::readMNISTImagesAndLabels(kTestImagesFile, kTestLabelsFile);
+
+        using Clock = std::chrono::steady_clock;
+        int floatCorrect = 0, quantCorrect = 0, agree = 0;
+        Clock::duration floatTime{}, quantTime{};
+        for (std::size_t i = 0; i < testImages.size(); ++i) {
+            auto t0 = Clock::now();
+            int f = net.predict(testImages[i]);
+            auto t1 = Clock::now();
+            int q = qnet.predict(testImages[i]);
+            auto t2 = Clock::now();
+            floatTime += t1 - t0;
+            quantTime += t2 - t1;
+
+            floatCorrect += f == testLabels[i];
+            quantCorrect += q == testLabels[i];
+            agree += f == q;
+        }
+
+        auto usPerSample = [&](Clock::duration d) {
+            return std::chrono::duration<double, std::micro>(d).count() / testImages.size();
+        };
+        double n = static_cast<double>(testImages.size());
+        std::cout << "Kernels: " << math::simdLevel() << "\n"
+            << "Float top-1 accuracy: " << 100.0 * floatCorrect / n << "% ("
+            << usPerSample(floatTime) << " us/sample)\n"
+            << "Int8  top-1 accuracy: " << 100.0 * quantCorrect / n << "% ("
+            << usPerSample(quantTime) << " us/sample)\n"
+            << "Agreement: " << 100.0 * agree / n << "%\n";
+
+        qnet.saveModel(outFile);
+        std::cout << "Saved quantized model to: " << outFile << std::endl;
+        return 0;
+    }
+
+    // Top-1 accuracy and mean latency of single-sample predictions over the test set
+    template <typename Predict>
+    std::pair<double, double> scorePredictions(const std::vector<std::vector<double>>& images,
+        const std::vector<int>& labels, Predict predict)
+    {
+        using Clock = std::chrono::steady_clock;
+        std::size_t correct = 0;
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < images.size(); ++i) {
+            correct += predict(images[i]) == labels[i];
+        }
+        const double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+        return { 100.0 * correct / images.size(), us / images.size() };
+    }
+
+    // Prune a trained model step by step (fine-tuning after each step) into a SparseModel,
+    // reporting accuracy, sparsity, size and latency on the t10k set at every step
+    int prune(int argc, char* argv[]) {
+        if (argc < 3) {
+            printUsage();
+            return 1;
+        }
+        std::string modelFile = argv[2];
+        std::string outFile = std::filesystem::path(modelFile).replace_extension(".sparse").string();
+        PruneConfig target;
+        std::size_t steps = 4;
+        int fineTune = 1;
+        double lr = 0.02;
+        std::size_t threads = 0;
+        for (int i = 3; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--out") outFile = value();
+            else if (arg == "--sparsity") target.sparsity1 = std::stod(value());
+            else if (arg == "--sparsity2") target.sparsity2 = std::stod(value());
+            else if (arg == "--block") {
+                const std::string block = value();
+                const std::size_t x = block.find('x');
+                if (x == std::string::npos) {
+                    throw std::runtime_error("--block needs <rows>x<cols>, e.g. 16x1");
+                }
+                target.blockRows = std::stoul(block.substr(0, x));
+                target.blockCols = std::stoul(block.substr(x + 1));
+            }
+            else if (arg == "--steps") steps = std::max<std::size_t>(1, std::stoul(value()));
+            else if (arg == "--fine-tune") fineTune = std::stoi(value());
+            else if (arg == "--lr") lr = std::stod(value());
+            else if (arg == "--threads") threads = std::stoul(value());
+            else throw std::runtime_error("Unexpected argument: " + arg);
+        }
+
+        Model net = Model::fromFile(modelFile, false, lr);
+        FloatModel dense = FloatModel::fromFile(modelFile);
+        auto [testImages, testLabels] =
+            DataReader::readMNISTImagesAndLabels(kTestImagesFile, kTestLabelsFile);
+        std::vector<std::vector<double>> trainImages;
+        std::vector<int> trainLabels;
+        if (fineTune > 0) {
+            std::tie(trainImages, trainLabels) =
+                DataReader::readMNISTImagesAndLabels(kTrainImagesFile, kTrainLabelsFile);
+        }
+
+        TrainConfig tune;
+        tune.epochs = fineTune;
+        tune.batchSize = 32;
+        tune.threads = threads;
+        tune.optimizer.type = OptimizerType::Nesterov;
+        tune.optimizer.schedule = LRSchedule::Cosine;
+
+        auto row = [](const std::string& name, double s1, double s2, double kb, std::pair<double, double> score) {
+            std::printf("%-10s %8.1f%% %8.1f%% %10.1f %9.2f%% %10.2f\n", name.c_str(), s1, s2, kb, score.first, score.second);
+            std::fflush(stdout);
+        };
+        std::cout << "Kernels: " << math::simdLevel() << ", blocks " << target.blockRows << "x" << target.blockCols << "\n";
+        std::printf("%-10s %9s %9s %10s %10s %10s\n", "", "W1 zero", "W2 zero", "KB", "top-1", "us/sample");
+        const std::size_t denseValues = (dense.inputSize() + 1) * dense.hiddenSize() + (dense.hiddenSize() + 1) * dense.outputSize();
+        row("dense", 0.0, 0.0, denseValues * sizeof(float) / 1024.0,
+            scorePredictions(testImages, testLabels, [&](const std::vector<double>& image) {
+                std::vector<float> x(image.begin(), image.end());
+                return dense.predict(x);
+            }));
+
+        // Gradual pruning: the sparsity rises on a cubic curve, steep first and flat
+        // at the end, so the last steps remove little and fine-tuning can recover
+        SparseModel sparse;
+        for (std::size_t step = 1; step <= steps; ++step) {
+            const double f = 1.0 - std::pow(1.0 - static_cast<double>(step) / steps, 3.0);
+            PruneConfig config = target;
+            config.sparsity1 *= f;
+            config.sparsity2 *= f;
+            net.prune(config);
+            if (fineTune > 0) {
+                net.train(trainImages, trainLabels, tune);
+            }
+
+            sparse = SparseModel::fromModel(net, target.blockRows, target.blockCols);
+            auto zeros = [](math::MatrixView<const double> W) {
+                std::size_t n = 0;
+                for (std::size_t i = 0; i < W.rows; ++i) {
+                    n += std::count(W.row(i), W.row(i) + W.cols, 0.0);
+                }
+                return 100.0 * n / (W.rows * W.cols);
+            };
+            // float inputs, as the dense row: the conversion is part of both timings
+            row("step " + std::to_string(step), zeros(net.weights1T()), zeros(net.weights2()), sparse.bytes() / 1024.0,
+                scorePredictions(testImages, testLabels, [&](const std::vector<double>& image) {
+                    std::vector<float> x(image.begin(), image.end());
+                    return sparse.predict(x);
+                }));
+        }
+
+        sparse.saveModel(outFile);
+        std::cout << "Saved sparse model to: " << outFile << std::endl;
+        return 0;
+    }
+
+    // Images to classify: an IDX image file, or the PGM / raw files of a directory in name order
+    class ImageSource {
+    public:
+        ImageSource(const std::string& path, std::size_t rows, std::size_t cols)
+            : rows_t(rows), cols_t(cols)
+        {
+            if (!std::filesystem::is_directory(path)) {
+                idx_t = DataReader::IdxFile(path, 2051);
+                if (idx_t.itemSize() != rows * cols) {
+                    throw std::runtime_error(path + " holds " + std::to_string(idx_t.itemSize()) +
+                        "-pixel images, the model expects " + std::to_string(rows * cols));
+                }
+                return;
+            }
+            for (const auto& entry : std::filesystem::directory_iterator(path)) {
+                const std::string extension = entry.path().extension().string();
+                if (entry.is_regular_file() && (extension == ".pgm" || extension == ".raw")) {
+                    files_t.push_back(entry.path());
+                }
+            }
+            std::sort(files_t.begin(), files_t.end());
+            if (files_t.empty()) {
+                throw std::runtime_error("No .pgm or .raw images in " + path);
+            }
+        }
+
+        std::size_t size() const { return files_t.empty() ? idx_t.count() : files_t.size(); }
+        std::string name(std::size_t i) const { return files_t.empty() ? std::to_string(i) : files_t[i].filename().string(); }
+
+        // Image i scaled to [0..1]; scratch receives the raw pixels of a file
+        template <typename T>
+        void load(std::size_t i, T* dst, std::vector<std::uint8_t>& scratch) const {
+            if (files_t.empty()) {
+                DataReader::normalize(idx_t.item(i), rows_t * cols_t, dst);
+                return;
+            }
+            DataReader::readGrayImage(files_t[i].string(), rows_t, cols_t, scratch);
+            DataReader::normalize(scratch.data(), scratch.size(), dst);
+        }
+
+    private:
+        std::size_t rows_t, cols_t;
+        DataReader::IdxFile idx_t;
+        std::vector<std::filesystem::path> files_t;
+    };
+
+    struct ClassifyOptions {
+        std::string images;
+        std::string model = "models/default.model";
+        std::string out;    // binary results; empty = text on stdout
+        std::string labels; // optional IDX labels, for accuracy
+        std::size_t batch = 256;
+        std::size_t threads = 0;
+        bool precise = false; // run in double instead of float
+    };
+
+    /*
+
+    Classify every image in parallel batches. Text output is one line per image,
+    "<name> <label> <p0> ... <p9>"; the binary output file is
+    "DNLP" | u32 version | u32 classes | u64 count | per image: i32 label, f32 probabilities.
+    The summary goes to stderr so the results can be piped.
+
+    */
+    template <typename T>
+    int classifyWith(const ClassifyOptions& options) {
+        using Clock = std::chrono::steady_clock;
+
+        BasicModel<T> model = BasicModel<T>::fromFile(options.model);
+        const std::size_t inputs = model.inputSize();
+        const std::size_t classes = model.outputSize();
+        const auto side = static_cast<std::size_t>(std::lround(std::sqrt(static_cast<double>(inputs))));
+        if (side * side != inputs) {
+            throw std::runtime_error("The model's input is not a square image.");
+        }
+
+        ImageSource source(options.images, side, side);
+        DataReader::IdxFile labelFile;
+        if (!options.labels.empty()) {
+            labelFile = DataReader::IdxFile(options.labels, 2049);
+            if (labelFile.count() != source.size()) {
+                throw std::runtime_error("Mismatch: number of images != number of labels.");
+            }
+        }
+
+        std::ofstream binary;
+        if (!options.out.empty()) {
+            binary.open(options.out, std::ios::binary);
+            if (!binary) {
+                throw std::runtime_error("Could not open file for writing: " + options.out);
+            }
+            const std::uint32_t version = 1, classCount = static_cast<std::uint32_t>(classes);
+            const std::uint64_t count = source.size();
+            binary.write("DNLP", 4);
+            binary.write(reinterpret_cast<const char*>(&version), sizeof(version));
+            binary.write(reinterpret_cast<const char*>(&classCount), sizeof(classCount));
+            binary.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        }
+
+        ThreadPool pool(options.threads);
+        const std::size_t batchSize = std::max<std::size_t>(1, options.batch);
+        std::vector<std::vector<T>> batch(std::min(batchSize, source.size()), std::vector<T>(inputs));
+        std::vector<std::vector<std::uint8_t>> scratch(pool.size());
+        std::vector<T> probs;
+        std::vector<float> record(classes + 1);
+        std::string text;
+        std::vector<double> latencies; // per batch, load + inference, in ms
+        std::size_t correct = 0;
+        Clock::duration inferTime{};
+
+        const auto start = Clock::now();
+        for (std::size_t first = 0; first < source.size(); first += batchSize) {
+            const std::size_t count = std::min(batchSize, source.size() - first);
+            const auto t0 = Clock::now();
+
+            // Load (and for directories, decode) the batch on the pool, one slice per thread
+            const std::size_t slice = (count + pool.size() - 1) / pool.size();
+            pool.parallelFor((count + slice - 1) / slice, [&](std::size_t s) {
+                for (std::size_t i = s * slice; i < std::min(count, (s + 1) * slice); ++i) {
+                    source.load(first + i, batch[i].data(), scratch[s]);
+                }
+            });
+            const auto t1 = Clock::now();
+            std::vector<int> labels = model.predictBatch(std::span(batch.data(), count), pool, &probs);
+            const auto t2 = Clock::now();
+            inferTime += t2 - t1;
+            latencies.push_back(std::chrono::duration<double, std::milli>(t2 - t0).count());
+
+            text.clear();
+            for (std::size_t i = 0; i < count; ++i) {
+                const T* p = probs.data() + i * classes;
+                if (!options.labels.empty()) {
+                    correct += labels[i] == labelFile.data()[first + i];
+                }
+                if (binary.is_open()) {
+                    const std::int32_t label = labels[i];
+                    std::copy(p, p + classes, record.begin());
+                    binary.write(reinterpret_cast<const char*>(&label), sizeof(label));
+                    binary.write(reinterpret_cast<const char*>(record.data()), classes * sizeof(float));
+                    continue;
+                }
+                text += source.name(first + i);
+                text += ' ';
+                text += std::to_string(labels[i]);
+                char number[16];
+                for (std::size_t c = 0; c < classes; ++c) {
+                    std::snprintf(number, sizeof(number), " %.4f", static_cast<double>(p[c]));
+                    text += number;
+                }
+                text += '\n';
+            }
+            if (!binary.is_open()) {
+                std::fwrite(text.data(), 1, text.size(), stdout);
+            }
+        }
+        std::fflush(stdout);
+        if (binary.is_open() && !binary) {
+            throw std::runtime_error("Could not write " + options.out);
+        }
+        if (latencies.empty()) {
+            std::cerr << "Classified 0 images with " << options.model << "\n";
+            return 0;
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double q) {
+            return latencies[std::min(latencies.size() - 1, static_cast<std::size_t>(q * latencies.size()))];
+        };
+        const double n = static_cast<double>(source.size());
+        std::cerr << "Classified " << source.size() << " images with " << options.model
+            << " (" << (sizeof(T) == 4 ? "float" : "double") << ", " << math::simdLevel() << ", "
+            << pool.size() << " threads, batches of " << batchSize << ")\n"
+            << "Throughput: " << n / seconds << " images/s overall, "
+            << n / std::chrono::duration<double>(inferTime).count() << " images/s inference\n"
+            << "Batch latency (load + inference): p50 " << percentile(0.5) << " ms, p90 " << percentile(0.9)
+            << " ms, p99 " << percentile(0.99) << " ms, max " << latencies.back() << " ms\n";
+        if (!options.labels.empty()) {
+            std::cerr << "Top-1 accuracy: " << 100.0 * correct / n << "%\n";
+        }
+        return 0;
+    }
+
+    // A bare model name is looked up in models/
+    std::string findModel(const std::string& model) {
+        const std::filesystem::path inModels = "models" / std::filesystem::path(model);
+        return !std::filesystem::exists(model) && std::filesystem::exists(inModels) ? inModels.string() : model;
+    }
+
+    // Keep a model resident and answer requests until the process is killed
+    template <typename T>
+    int serveWith(const std::string& modelFile, const std::string& endpoint, const BatchingConfig& config) {
+        BasicModel<T> model = BasicModel<T>::fromFile(modelFile);
+        MicroBatcher<T> batcher(model, config);
+        InferenceServer<T> server(batcher, endpoint);
+        std::cerr << "Serving " << modelFile << " (" << (sizeof(T) == 4 ? "float" : "double") << ", "
+            << math::simdLevel() << ") on " << endpoint << ": batches of up to " << config.maxBatch
+            << ", at most " << config.maxDelay.count() << " us queueing" << std::endl;
+
+        // Statistics every 10 seconds while there is traffic. The reporter reads batcher and
+        // server, so it is stopped and joined however serve() ends, before they go away.
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool done = false;
+        std::thread reporter([&] {
+            std::uint64_t reported = 0;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!wake.wait_for(lock, std::chrono::seconds(10), [&] { return done; })) {
+                const auto stats = batcher.stats();
+                if (stats.requests != reported) {
+                    reported = stats.requests;
+                    std::cerr << server.statsJson() << std::endl;
+                }
+            }
+        });
+        auto stopReporter = [&] {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done = true;
+            }
+            wake.notify_one();
+            reporter.join();
+        };
+        try {
+            server.serve();
+        }
+        catch (...) {
+            stopReporter();
+            throw;
+        }
+        stopReporter();
+        return 0;
+    }
+
+    int serve(int argc, char* argv[]) {
+        std::string model = "models/default.model";
+        std::string endpoint = "tcp:7878";
+        BatchingConfig config;
+        bool precise = false;
+        for (int i = 2; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--model") model = value();
+            else if (arg == "--listen") endpoint = value();
+            else if (arg == "--max-batch") config.maxBatch = std::stoul(value());
+            else if (arg == "--max-delay-us") config.maxDelay = std::chrono::microseconds(std::stoul(value()));
+            else if (arg == "--threads") config.threads = std::stoul(value());
+            else if (arg == "--double") precise = true;
+            else throw std::runtime_error("Unexpected argument: " + arg);
+        }
+        model = findModel(model);
+        return precise ? serveWith<double>(model, endpoint, config) : serveWith<float>(model, endpoint, config);
+    }
+
+    // Send the images of an IDX file to a server over several connections at once
+    int query(int argc, char* argv[]) {
+        std::string images, labels;
+        std::string endpoint = "tcp:7878";
+        std::size_t connections = 8;
+        std::size_t limit = 0;
+        for (int i = 2; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--connect") endpoint = value();
+            else if (arg == "--labels") labels = value();
+            else if (arg == "--connections") connections = std::max<std::size_t>(1, std::stoul(value()));
+            else if (arg == "--count") limit = std::stoul(value());
+            else if (images.empty() && arg.rfind("--", 0) != 0) images = arg;
+            else throw std::runtime_error("Unexpected argument: " + arg);
+        }
+        if (images.empty()) {
+            printUsage();
+            return 1;
+        }
+
+        using Clock = std::chrono::steady_clock;
+        DataReader::IdxFile imageFile(images, 2051);
+        DataReader::IdxFile labelFile;
+        if (!labels.empty()) {
+            labelFile = DataReader::IdxFile(labels, 2049);
+        }
+        const std::size_t count = limit ? std::min(limit, imageFile.count()) : imageFile.count();
+        if (!labels.empty() && labelFile.count() < count) {
+            throw std::runtime_error("Mismatch: fewer labels than images to send.");
+        }
+
+        // Connect everyone first, so the timing covers requests only
+        std::vector<std::unique_ptr<InferenceClient>> clients;
+        for (std::size_t c = 0; c < connections; ++c) {
+            clients.push_back(std::make_unique<InferenceClient>(endpoint));
+            if (clients.back()->inputSize() != imageFile.itemSize()) {
+                throw std::runtime_error("The server expects " + std::to_string(clients.back()->inputSize()) + "-pixel images");
+            }
+        }
+
+        std::vector<double> latencies(count); // microseconds
+        std::vector<int> predicted(count);
+        std::vector<std::thread> threads;
+        const auto start = Clock::now();
+        for (std::size_t c = 0; c < connections; ++c) {
+            threads.emplace_back([&, c] {
+                for (std::size_t i = c; i < count; i += connections) {
+                    const auto t0 = Clock::now();
+                    predicted[i] = clients[c]->classify(imageFile.item(i));
+                    latencies[i] = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (count == 0) {
+            std::cout << "0 requests over " << connections << " connections\n"
+                << "Server: " << clients[0]->stats() << std::endl;
+            return 0;
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double q) {
+            return latencies[std::min(latencies.size() - 1, static_cast<std::size_t>(q * latencies.size()))];
+        };
+        std::cout << count << " requests over " << connections << " connections: "
+            << count / seconds << " requests/s\n"
+            << "Client latency: p50 " << percentile(0.5) << " us, p99 " << percentile(0.99)
+            << " us, max " << latencies.back() << " us\n";
+        if (!labels.empty()) {
+            std::size_t correct = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                correct += predicted[i] == labelFile.data()[i];
+            }
+            std::cout << "Top-1 accuracy: " << 100.0 * correct / count << "%\n";
+        }
+        std::cout << "Server: " << clients[0]->stats() << std::endl;
+        return 0;
+    }
+
+    // Train the default 784-128-10 model on the augmented training set, with checkpoints
+    int train(int argc, char* argv[]) {
+        std::string out = "models/default.model";
+        AugmentConfig augment;
+        augment.batchSize = 32;
+        augment.copies = 10;
+        augment.seed = std::random_device{}();
+        TrainConfig config;
+        config.epochs = 4;
+        config.threads = 0;
+        config.optimizer.type = OptimizerType::Nesterov;
+        config.optimizer.schedule = LRSchedule::Cosine;
+        config.optimizer.warmupSteps = 500;
+        config.checkpointFile = "models/training.ckpt";
+        std::size_t heldOut = 5000;
+        ValidationConfig validation;
+        validation.every = 2000;
+        validation.patience = 4;
+        for (int i = 2; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--out") out = value();
+            else if (arg == "--epochs") config.epochs = std::stoi(value());
+            else if (arg == "--copies") augment.copies = std::stoul(value());
+            else if (arg == "--threads") config.threads = std::stoul(value());
+            else if (arg == "--seed") augment.seed = static_cast<unsigned int>(std::stoul(value()));
+            else if (arg == "--checkpoint") config.checkpointFile = value();
+            else if (arg == "--checkpoint-every") config.checkpointEvery = std::stoul(value());
+            else if (arg == "--resume") config.resume = true;
+            else if (arg == "--hold-out") heldOut = std::stoul(value());
+            else if (arg == "--validate-every") validation.every = std::stoul(value());
+            else if (arg == "--patience") validation.patience = std::stoul(value());
+            else throw std::runtime_error("Unexpected argument: " + arg);
+        }
+
+        // The stream continues where the checkpoint stopped: its seed, from its next batch
+        CheckpointPosition position;
+        if (config.resume && readCheckpointPosition(config.checkpointFile, position)) {
+            augment.seed = position.streamSeed;
+            augment.firstBatch = position.batch;
+        }
+        else if (config.resume) {
+            std::cout << "No checkpoint at " << config.checkpointFile << ", starting from scratch" << std::endl;
+        }
+
+        auto [trainImages, trainLabels] =
+            DataReader::readMNISTImagesAndLabels(kTrainImagesFile, kTrainLabelsFile);
+
+        // The last --hold-out training images validate weight snapshots during training
+        heldOut = std::min(heldOut, trainImages.size() - 1);
+        std::vector<std::vector<double>> validationImages(
+            std::make_move_iterator(trainImages.end() - heldOut), std::make_move_iterator(trainImages.end()));
+        std::vector<int> validationLabels(trainLabels.end() - heldOut, trainLabels.end());
+        trainImages.resize(trainImages.size() - heldOut);
+        trainLabels.resize(trainLabels.size() - heldOut);
+        AugmentStream<double> stream(trainImages, trainLabels, augment);
+
+        Model net(784, 128, 10, 0.1);
+        if (heldOut > 0) {
+            Validator<double> validator(validationImages, validationLabels, validation);
+            net.train(stream, config, &validator);
+        }
+        else {
+            net.train(stream, config);
+        }
+
+        auto [testImages, testLabels] =
+            DataReader::readMNISTImagesAndLabels(kTestImagesFile, kTestLabelsFile);
+        ThreadPool pool;
+        std::vector<int> preds = net.predictBatch(testImages, pool);
+        std::size_t correct = 0;
+        for (std::size_t i = 0; i < testImages.size(); ++i) {
+            correct += preds[i] == testLabels[i];
+        }
+        std::cout << "Test accuracy: " << 100.0 * correct / testImages.size() << "%" << std::endl;
+
+        net.saveModel(out);
+        std::cout << "Saved model to: " << out << std::endl;
+        return 0;
+    }
+
+    int classify(int argc, char* argv[]) {
+        ClassifyOptions options;
+        for (int i = 2; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--model") options.model = value();
+            else if (arg == "--out") options.out = value();
+            else if (arg == "--labels") options.labels = value();
+            else if (arg == "--batch") options.batch = std::stoul(value());
+            else if (arg == "--threads") options.threads = std::stoul(value());
+            else if (arg == "--double") options.precise = true;
+            else if (options.images.empty() && arg.rfind("--", 0) != 0) options.images = arg;
+            else throw std::runtime_error("Unexpected argument: " + arg);
+        }
+        if (options.images.empty()) {
+            printUsage();
+            return 1;
+        }
+        options.model = findModel(options.model);
+        return options.precise ? classifyWith<double>(options) : classifyWith<float>(options);
+    }
+}
+
+namespace tools {
+    int run(int argc, char* argv[]) {
+        std::string command = argc > 1 ? argv[1] : "";
+        try {
+            if (command == "quantize")
+                return quantize(argc, argv);
+            if (command == "prune")
+                return prune(argc, argv);
+            if (command == "classify")
+                return classify(argc, argv);
+            if (command == "serve")
+                return serve(argc, argv);
+            if (command == "query")
+                return query(argc, argv);
+            if (command == "train")
+                return train(argc, argv);
+        }
+        catch (const std::exception& ex) {
+            std::cerr << "Error: " << ex.what() << std::endl;
+            return 1;
+        }
+        printUsage();
+        return 1;
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+/*
+
+ Command line tools, run instead of the GUI when the program gets arguments
+ (CMake also builds them without the GUI, as dnl_cli):
+
+   quantize <model> [output]   int8-quantize a trained 784-128-10 model, compare its
+                               top-1 accuracy with the float model on the t10k set and
+                               save it (default: <model> with extension .q8)
+
+   prune <model> [--out <file>] [--sparsity <w1>] [--sparsity2 <w2>] [--block <R>x<C>]
+         [--steps <n>] [--fine-tune <epochs>] [--lr <rate>] [--threads <n>]
+                               magnitude-prune a trained model to --sparsity (0.9) of W1 and
+                               --sparsity2 (0) of W2 zeros, removing blocks of R outputs x C inputs
+                               (1x1; 16x1 suits the SIMD kernels), in --steps (4) rising steps with
+                               --fine-tune (1) epochs of mini-batch training at --lr (0.02) after
+                               each. Prints sparsity, size, t10k accuracy and latency per step
+                               against the dense float model and saves the block-sparse result
+                               (default: <model> with extension .sparse, see SparseModel)
+
+   classify <images> [--model <file>] [--out <file>] [--labels <idx>] [--batch <n>] [--threads <n>] [--double]
+                               classify an IDX image file or a directory of 28x28 .pgm / .raw
+                               images in parallel batches (model default: models/default.model,
+                               run in float unless --double). Prints "<name> <label> <p0> ... <p9>"
+                               per image, or writes them to a binary --out file; throughput and
+                               batch latency percentiles (and accuracy, given --labels) go to stderr
+
+   serve [--model <file>] [--listen tcp:<port> | unix:<path>] [--max-batch <n>] [--max-delay-us <n>]
+         [--threads <n>] [--double]
+                               keep a model loaded and answer classification requests on a local
+                               socket (default tcp:7878, loopback only), coalescing concurrent
+                               requests into micro-batches of up to --max-batch (32) that wait at
+                               most --max-delay-us (500) for company (see InferenceServer)
+   query <images> [--connect <endpoint>] [--labels <idx>] [--connections <n>] [--count <n>]
+                               send the images of an IDX file to a server over several connections
+                               and report requests/s, latency percentiles and the server's statistics
+
+   train [--out <file>] [--epochs <n>] [--copies <n>] [--threads <n>] [--seed <n>]
+         [--checkpoint <file>] [--checkpoint-every <n>] [--resume]
+         [--hold-out <n>] [--validate-every <n>] [--patience <n>]
+                               train the 784-128-10 model on the augmented training set as the GUI
+                               does and save it (default models/default.model). Every --checkpoint-every
+                               (1000) batches and every epoch the run is checkpointed in the background
+                               (default models/training.ckpt); --resume continues bit for bit from the
+                               checkpoint, given the same --epochs and --threads
+                               The last --hold-out (5000) training images are not trained on: every
+                               --validate-every (2000) batches a weight snapshot is validated on them on
+                               another thread, training stops after --patience (4) validations without
+                               improvement (0 = never) and the best snapshot is the one saved
+
+*/
+namespace tools {
+    // Returns the process exit code
+    int run(int argc, char* argv[]);
+}
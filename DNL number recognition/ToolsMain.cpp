@@ -0,0 +1,7 @@
+// Entry point of dnl_cli: the command line tools without the GUI (see Tools.h)
+#include "Tools.h"
+
+int main(int argc, char* argv[])
+{
+    return tools::run(argc, argv);
+}
@@ -0,0 +1,191 @@
+#include "Validation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+template <typename T>
+Validator<T>::Validator(const std::vector<std::vector<T>>& images, const std::vector<int>& labels,
+    const ValidationConfig& config)
+    : images_t(images), labels_t(labels), config_t(config), pool_t(config.threads),
+    snapshots_t{ BasicModel<T>(0, 0, 0), BasicModel<T>(0, 0, 0) }, // shaped by the first submit()
+    bestModel_t(0, 0, 0)
+{
+    if (images.size() != labels.size()) {
+        throw std::runtime_error("Mismatch in images and labels sizes.");
+    }
+    if (images.empty()) {
+        throw std::runtime_error("Validation needs at least one image.");
+    }
+    thread_t = std::thread(&Validator::run, this);
+}
+
+template <typename T>
+Validator<T>::~Validator()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_t);
+        quit_t = true;
+    }
+    wake_t.notify_one();
+    thread_t.join();
+}
+
+template <typename T>
+void Validator<T>::submit(const BasicModel<T>& model, int epoch, std::uint64_t batch)
+{
+    int filling;
+    {
+        std::lock_guard<std::mutex> lock(mutex_t);
+        if (error_t) {
+            std::rethrow_exception(std::exchange(error_t, nullptr));
+        }
+        if (pending_t >= 0) {
+            ++skipped_t;
+            pending_t = -1;
+        }
+        filling = evaluating_t == 0 ? 1 : 0;
+    }
+
+    // Neither waiting nor being evaluated, so the validator thread does not touch it
+    snapshots_t[filling].copyParams(model);
+    points_t[filling] = Point{ epoch, batch, 0.0, 0.0 };
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_t);
+        pending_t = filling;
+    }
+    wake_t.notify_one();
+}
+
+template <typename T>
+void Validator<T>::finish()
+{
+    std::unique_lock<std::mutex> lock(mutex_t);
+    idle_t.wait(lock, [&] { return pending_t < 0 && evaluating_t < 0; });
+    if (error_t) {
+        std::rethrow_exception(std::exchange(error_t, nullptr));
+    }
+}
+
+template <typename T>
+bool Validator<T>::idle() const
+{
+    std::lock_guard<std::mutex> lock(mutex_t);
+    return pending_t < 0 && evaluating_t < 0;
+}
+
+template <typename T>
+std::vector<typename Validator<T>::Point> Validator<T>::history() const
+{
+    std::lock_guard<std::mutex> lock(mutex_t);
+    return history_t;
+}
+
+template <typename T>
+std::size_t Validator<T>::skipped() const
+{
+    std::lock_guard<std::mutex> lock(mutex_t);
+    return skipped_t;
+}
+
+template <typename T>
+void Validator<T>::restore(const std::vector<Point>& history, const BasicModel<T>* bestModel, const Point& best,
+    std::size_t stale)
+{
+    std::lock_guard<std::mutex> lock(mutex_t);
+    if (pending_t >= 0 || evaluating_t >= 0 || !history_t.empty()) {
+        throw std::runtime_error("A validator can only be restored before its first snapshot.");
+    }
+    history_t = history;
+    hasBest_t = bestModel != nullptr;
+    if (bestModel) {
+        best_t = best;
+        bestModel_t.copyParams(*bestModel);
+    }
+    stale_t = stale;
+    stop_t.store(config_t.patience && stale_t >= config_t.patience, std::memory_order_relaxed);
+}
+
+template <typename T>
+typename Validator<T>::Point Validator<T>::evaluate(const BasicModel<T>& model)
+{
+    const std::size_t outputs = model.outputSize();
+    std::vector<int> labels = model.predictBatch(images_t, pool_t, &probs_t);
+
+    std::size_t correct = 0;
+    double loss = 0.0;
+    for (std::size_t i = 0; i < images_t.size(); ++i) {
+        correct += labels[i] == labels_t[i];
+        const double p = static_cast<double>(probs_t[i * outputs + static_cast<std::size_t>(labels_t[i])]);
+        loss -= std::log(std::max(p, 1e-12));
+    }
+
+    Point point;
+    point.accuracy = static_cast<double>(correct) / images_t.size();
+    point.loss = loss / images_t.size();
+    return point;
+}
+
+template <typename T>
+void Validator<T>::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_t);
+    for (;;) {
+        wake_t.wait(lock, [&] { return quit_t || pending_t >= 0; });
+        if (pending_t < 0) {
+            return;
+        }
+        evaluating_t = std::exchange(pending_t, -1);
+        lock.unlock();
+
+        const BasicModel<T>& snapshot = snapshots_t[evaluating_t];
+        Point point = points_t[evaluating_t];
+        std::exception_ptr error;
+        try {
+            const Point result = evaluate(snapshot);
+            point.accuracy = result.accuracy;
+            point.loss = result.loss;
+
+            const bool improved = !hasBest_t || point.accuracy > best_t.accuracy + config_t.minDelta;
+            if (improved) {
+                hasBest_t = true;
+                best_t = point;
+                bestModel_t.copyParams(snapshot);
+                stale_t = 0;
+                if (!config_t.bestModelFile.empty()) {
+                    snapshot.saveModel(config_t.bestModelFile);
+                }
+            }
+            else if (config_t.patience && ++stale_t >= config_t.patience) {
+                stop_t.store(true, std::memory_order_relaxed);
+            }
+
+            // One write, so the line does not interleave with the trainer's output
+            std::ostringstream line;
+            line << "Validation after batch " << point.batch << " (epoch " << point.epoch << "): accuracy "
+                << 100.0 * point.accuracy << "%, loss " << point.loss
+                << (improved ? " (best)" : "") << "\n";
+            std::cout << line.str() << std::flush;
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        if (error) {
+            error_t = error;
+        }
+        else {
+            history_t.push_back(point);
+        }
+        evaluating_t = -1;
+        idle_t.notify_all();
+    }
+}
+
+template class Validator<float>;
+template class Validator<double>;
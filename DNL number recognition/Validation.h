@@ -0,0 +1,134 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Model.h"
+#include "ThreadPool.h"
+
+struct ValidationConfig
+{
+    // Validate every `every` batches and at the end of every epoch (0 = epoch ends only)
+    std::size_t every = 1000;
+
+    // Threads of the evaluation, besides the validator's own (0 = all hardware threads).
+    // They compete with training for the cores, so keep this small.
+    std::size_t threads = 1;
+
+    // Stop training after this many validations in a row without a new best accuracy
+    // (0 = never stop early). An improvement must be larger than minDelta (0..1).
+    std::size_t patience = 0;
+    double minDelta = 0.0;
+
+    // At the end of training, put the weights of the best validation back into the model
+    bool restoreBest = true;
+
+    // Saved on the validation thread whenever a new best accuracy is reached (empty = not saved)
+    std::string bestModelFile;
+};
+
+/*
+
+ Evaluates weight snapshots on a held-out set while training goes on.
+ The trainer copies its parameters into one of two snapshot models (submit(),
+ a memcpy of the weights) and continues; the validator thread classifies the
+ validation set with the snapshot and records accuracy and loss. If a snapshot
+ arrives while the previous one is still waiting, the waiting one is skipped,
+ so training does not wait for validation.
+
+ Tracks the best snapshot (for ValidationConfig::restoreBest / bestModelFile) and
+ raises shouldStop() once `patience` validations brought no improvement.
+ Pass it to BasicModel::train(stream, config, &validator). The images are kept
+ by reference and must outlive the validator. Training checkpoints carry its
+ state (see TrainingCheckpoint), so a resumed run keeps the best snapshot and
+ patience count from before the interruption. A checkpoint is completed once
+ idle(): the trainer only waits for that if validation falls behind.
+
+*/
+template <typename T>
+class Validator
+{
+public:
+    using Point = ValidationPoint;
+
+    Validator(const std::vector<std::vector<T>>& images, const std::vector<int>& labels,
+        const ValidationConfig& config = {});
+    ~Validator();
+
+    Validator(const Validator&) = delete;
+    Validator& operator=(const Validator&) = delete;
+
+    // Trainer: queue a snapshot of model's weights after `batch` batches of `epoch`
+    void submit(const BasicModel<T>& model, int epoch, std::uint64_t batch);
+
+    // Set once patience ran out; read by the trainer after every batch
+    bool shouldStop() const { return stop_t.load(std::memory_order_relaxed); }
+
+    // Wait until every queued snapshot has been evaluated; rethrows evaluation errors
+    void finish();
+
+    // Whether every queued snapshot has been evaluated, without waiting
+    bool idle() const;
+
+    // Validation curve so far, in submit order
+    std::vector<Point> history() const;
+
+    // The best validation and its weights (call after finish(); false / empty before the first)
+    bool hasBest() const { return hasBest_t; }
+    const Point& best() const { return best_t; }
+    const BasicModel<T>& bestModel() const { return bestModel_t; }
+
+    // Validations since the best one (call after finish())
+    std::size_t stale() const { return stale_t; }
+
+    // Snapshots replaced before they were evaluated
+    std::size_t skipped() const;
+
+    // Continue the curve, best snapshot and patience count of an interrupted run, before
+    // the first submit() (bestModel = nullptr: no best yet)
+    void restore(const std::vector<Point>& history, const BasicModel<T>* bestModel, const Point& best,
+        std::size_t stale);
+
+    const ValidationConfig& config() const { return config_t; }
+
+private:
+    void run();
+    Point evaluate(const BasicModel<T>& model);
+
+    const std::vector<std::vector<T>>& images_t;
+    const std::vector<int>& labels_t;
+    ValidationConfig config_t;
+    ThreadPool pool_t;
+
+    // Two snapshots: one being evaluated, one being filled or waiting
+    BasicModel<T> snapshots_t[2];
+    Point points_t[2];
+
+    mutable std::mutex mutex_t;
+    std::condition_variable wake_t;
+    std::condition_variable idle_t;
+    int pending_t = -1;    // snapshot waiting to be evaluated
+    int evaluating_t = -1; // snapshot being evaluated
+    std::size_t skipped_t = 0;
+    std::vector<Point> history_t;
+    std::exception_ptr error_t;
+    bool quit_t = false;
+
+    // Validator thread only (until finish())
+    bool hasBest_t = false;
+    Point best_t;
+    BasicModel<T> bestModel_t;
+    std::size_t stale_t = 0;
+    std::vector<T> probs_t;
+
+    std::atomic<bool> stop_t{ false };
+    std::thread thread_t;
+};
+
+extern template class Validator<float>;
+extern template class Validator<double>;
@@ -0,0 +1,120 @@
+#include "kernels.h"
+
+#include <cmath>
+
+#if defined(MATH_KERNELS_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#include "kernels_impl.h"
+
+namespace math::kernels {
+	namespace {
+		// Portable fallback: a "register" of one scalar.
+		template <typename Scalar>
+		struct ScalarOps {
+			using T = Scalar;
+			using V = Scalar;
+			static constexpr std::size_t W = 1;
+
+			static V zero() { return V(0); }
+			static V set1(T s) { return s; }
+			static V load(const T* p) { return *p; }
+			static V loadu(const T* p) { return *p; }
+			static void store(T* p, V v) { *p = v; }
+			static V loadBytes(const std::uint8_t* p) { return V(*p); }
+			static V add(V a, V b) { return a + b; }
+			static V sub(V a, V b) { return a - b; }
+			static V mul(V a, V b) { return a * b; }
+			static V div(V a, V b) { return a / b; }
+			static V sqrt(V a) { return std::sqrt(a); }
+			static V fmadd(V a, V b, V c) { return a * b + c; }
+			static V max(V a, V b) { return a > b ? a : b; }
+			static T hsum(V v) { return v; }
+
+			static void warpRow(const T* src, std::size_t rows, std::size_t cols,
+				float x0, float y0, float dx, float dy, std::size_t n, bool bilinear, T fill, T* dst)
+			{
+				impl::warpRowScalar(src, rows, cols, x0, y0, dx, dy, 0, n, bilinear, fill, dst);
+			}
+		};
+
+		void matVecI8(const std::int8_t* M, std::size_t rows, std::size_t cols, std::size_t stride,
+			const std::int8_t* v, std::int32_t* out)
+		{
+			for (std::size_t i = 0; i < rows; ++i) {
+				const std::int8_t* r = M + i * stride;
+				std::int32_t acc = 0;
+				for (std::size_t j = 0; j < cols; ++j)
+					acc += std::int32_t(r[j]) * std::int32_t(v[j]);
+				out[i] = acc;
+			}
+		}
+
+		constexpr KernelSet kGeneric{
+			"generic",
+			impl::makeTable<ScalarOps<float>>(),
+			impl::makeTable<ScalarOps<double>>(),
+			&matVecI8,
+		};
+
+		struct CpuFeatures {
+			bool avx2 = false;
+			bool avx512 = false;
+		};
+
+		CpuFeatures detectCpu()
+		{
+			CpuFeatures f;
+#if defined(MATH_KERNELS_X86) && defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			const int maxLeaf = info[0];
+			if (maxLeaf < 7)
+				return f;
+
+			__cpuid(info, 1);
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool fma = (info[2] & (1 << 12)) != 0;
+			if (!osxsave)
+				return f;
+
+			// The OS must save the YMM (and for AVX-512 also the opmask/ZMM) state.
+			const unsigned long long xcr0 = _xgetbv(0);
+			const bool ymmEnabled = (xcr0 & 0x6) == 0x6;
+			const bool zmmEnabled = (xcr0 & 0xE6) == 0xE6;
+
+			__cpuidex(info, 7, 0);
+			f.avx2 = ymmEnabled && fma && (info[1] & (1 << 5)) != 0;
+			f.avx512 = zmmEnabled && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+#elif defined(MATH_KERNELS_X86) && defined(__GNUC__)
+			__builtin_cpu_init();
+			f.avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+			f.avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+			return f;
+		}
+
+		const KernelSet& select()
+		{
+			const CpuFeatures cpu = detectCpu();
+			if (cpu.avx512 && avx512())
+				return *avx512();
+			if (cpu.avx2 && avx2())
+				return *avx2();
+			return generic();
+		}
+	}
+
+	const KernelSet& generic()
+	{
+		return kGeneric;
+	}
+
+	const KernelSet& active()
+	{
+		static const KernelSet& set = select();
+		return set;
+	}
+}
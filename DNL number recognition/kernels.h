@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MATH_KERNELS_X86 1
+#endif
+
+/*
+
+ Low-level vector kernels behind the math namespace.
+ Each instruction set gets its own translation unit (kernels_avx2.cpp, kernels_avx512.cpp)
+ built from the same templates in kernels_impl.h; active() picks the widest one the CPU
+ supports the first time it is called.
+
+*/
+namespace math::kernels {
+	// Cache blocking of gemm: a KC x NC panel of B and an MC x KC block of A are packed
+	// into contiguous scratch so the micro-kernel streams them from L2 / L1.
+	constexpr std::size_t kGemmMC = 128;
+	constexpr std::size_t kGemmKC = 256;
+	constexpr std::size_t kGemmNC = 512;
+	constexpr std::size_t kGemmPackSize = kGemmMC * kGemmKC + kGemmKC * kGemmNC;
+
+	// Kernels for one scalar type
+	template <typename T>
+	struct Table {
+		// out[i] = dot(M row i, v); rows start every `stride` elements and are 64-byte aligned
+		void (*matVec)(const T* M, std::size_t rows, std::size_t cols, std::size_t stride,
+			const T* v, T* out);
+		// out[i] += bias[i]
+		void (*addBias)(T* out, const T* bias, std::size_t n);
+		// v[i] = max(v[i], 0)
+		void (*relu)(T* v, std::size_t n);
+		// y[i] += alpha * x[i]
+		void (*axpy)(std::size_t n, T alpha, const T* x, T* y);
+		// out[j] = sum_k value[k] * M[index[k] * stride + j] for j < cols: x^T M for a sparse x
+		// given by its nnz nonzeros; rows start every `stride` elements and are 64-byte aligned
+		void (*sparseVecMat)(const T* M, std::size_t cols, std::size_t stride,
+			const std::uint32_t* index, const T* value, std::size_t nnz, T* out);
+		// out[0..rows) = M * x for a block-sparse M compressed by block column and a sparse x given
+		// by its nnz nonzeros. Block column q (inputs q*C .. q*C + C - 1) holds blocks colStart[q] ..
+		// colStart[q + 1] - 1; block k covers outputs blockRow[k] .. + R - 1 and is stored as C runs
+		// of R weights, one per input. rows covers every block (the outputs rounded up to R).
+		void (*bscMatVec)(const T* values, const std::uint32_t* colStart, const std::uint32_t* blockRow,
+			std::size_t rows, std::size_t R, std::size_t C,
+			const std::uint32_t* index, const T* value, std::size_t nnz, T* out);
+		// v = mu * v + g, p -= rate * v (Nesterov: p -= rate * (g + mu * v))
+		void (*momentumStep)(std::size_t n, T rate, T mu, bool nesterov, const T* g, T* v, T* p);
+		// Adam moments and update, p -= rate * m / (sqrt(v) + eps) with bias-corrected rate and eps
+		void (*adamStep)(std::size_t n, T rate, T beta1, T beta2, T eps, const T* g, T* m, T* v, T* p);
+		// dst[i] = src[i] * scale
+		void (*scaleBytes)(const std::uint8_t* src, std::size_t n, T scale, T* dst);
+		// One output row of an image warp: dst[j] = src sampled at (col, row) = (x0 + j*dx, y0 + j*dy)
+		// for j < n, nearest-neighbour or bilinear, fill where the sample falls outside the image
+		void (*warpRow)(const T* src, std::size_t rows, std::size_t cols,
+			float x0, float y0, float dx, float dy, std::size_t n, bool bilinear, T fill, T* dst);
+		// C = alpha * op(A) * op(B) + beta * C, all row-major, op(X) = X^T when transX is set.
+		// op(A) is M x K, op(B) is K x N; pack is 64-byte aligned scratch of kGemmPackSize elements.
+		void (*gemm)(bool transA, bool transB, std::size_t M, std::size_t N, std::size_t K,
+			T alpha, const T* A, std::size_t lda, const T* B, std::size_t ldb,
+			T beta, T* C, std::size_t ldc, T* pack);
+	};
+
+	// Everything one instruction set provides
+	struct KernelSet {
+		const char* name;
+		Table<float> f32;
+		Table<double> f64;
+
+		// out[i] = dot(M row i, v) on int8 values with int32 accumulation
+		// (quantized inference); rows start every `stride` bytes
+		void (*matVecI8)(const std::int8_t* M, std::size_t rows, std::size_t cols, std::size_t stride,
+			const std::int8_t* v, std::int32_t* out);
+	};
+
+	const KernelSet& generic();
+	// nullptr when the instruction set was not compiled in (non-x86 targets)
+	const KernelSet* avx2();
+	const KernelSet* avx512();
+
+	const KernelSet& active();
+
+	template <typename T>
+	const Table<T>& table(const KernelSet& set = active())
+	{
+		static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>, "kernels exist for float and double");
+		if constexpr (std::is_same_v<T, float>)
+			return set.f32;
+		else
+			return set.f64;
+	}
+}
@@ -0,0 +1,271 @@
+#include "kernels.h"
+
+#if defined(MATH_KERNELS_X86)
+#include <immintrin.h>
+
+// Everything below is compiled for AVX2 + FMA; it is only reached through the table
+// returned by avx2(), which active() hands out after checking the CPU.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+#include "kernels_impl.h"
+
+namespace math::kernels {
+	namespace {
+		// Image warp: 8 output pixels per step, coordinates and bilinear weights in float.
+		// Gathers take the pixels under `mask` and leave fill in the other lanes.
+		__m256 gatherPixels(const float* src, __m256i idx, __m256i mask, float fill)
+		{
+			return _mm256_mask_i32gather_ps(_mm256_set1_ps(fill), src, idx, _mm256_castsi256_ps(mask), 4);
+		}
+
+		__m256 gatherPixels(const double* src, __m256i idx, __m256i mask, double fill)
+		{
+			const __m256d f = _mm256_set1_pd(fill);
+			__m256i maskLo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(mask));
+			__m256i maskHi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(mask, 1));
+			__m256d lo = _mm256_mask_i32gather_pd(f, src, _mm256_castsi256_si128(idx), _mm256_castsi256_pd(maskLo), 8);
+			__m256d hi = _mm256_mask_i32gather_pd(f, src, _mm256_extracti128_si256(idx, 1), _mm256_castsi256_pd(maskHi), 8);
+			return _mm256_set_m128(_mm256_cvtpd_ps(hi), _mm256_cvtpd_ps(lo));
+		}
+
+		void storePixels(float* dst, __m256 v) { _mm256_storeu_ps(dst, v); }
+		void storePixels(double* dst, __m256 v)
+		{
+			_mm256_storeu_pd(dst, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+			_mm256_storeu_pd(dst + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+		}
+
+		// Nearest samples are copied exactly, without a round trip through float
+		void gatherStore(const float* src, __m256i idx, __m256i mask, float fill, float* dst)
+		{
+			storePixels(dst, gatherPixels(src, idx, mask, fill));
+		}
+
+		void gatherStore(const double* src, __m256i idx, __m256i mask, double fill, double* dst)
+		{
+			const __m256d f = _mm256_set1_pd(fill);
+			__m256i maskLo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(mask));
+			__m256i maskHi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(mask, 1));
+			_mm256_storeu_pd(dst, _mm256_mask_i32gather_pd(f, src, _mm256_castsi256_si128(idx), _mm256_castsi256_pd(maskLo), 8));
+			_mm256_storeu_pd(dst + 4, _mm256_mask_i32gather_pd(f, src, _mm256_extracti128_si256(idx, 1), _mm256_castsi256_pd(maskHi), 8));
+		}
+
+		template <typename T>
+		void warpRow(const T* src, std::size_t rows, std::size_t cols,
+			float x0, float y0, float dx, float dy, std::size_t n, bool bilinear, T fill, T* dst)
+		{
+			const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+			const __m256 vx0 = _mm256_set1_ps(x0), vy0 = _mm256_set1_ps(y0);
+			const __m256 vdx = _mm256_set1_ps(dx), vdy = _mm256_set1_ps(dy);
+			const __m256 fcols = _mm256_set1_ps(float(cols)), frows = _mm256_set1_ps(float(rows));
+			const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+			const __m256 minusOneF = _mm256_set1_ps(-1.0f);
+			const __m256i icols = _mm256_set1_epi32(int(cols));
+			const __m256i lastCol = _mm256_set1_epi32(int(cols) - 1), lastRow = _mm256_set1_epi32(int(rows) - 1);
+			const __m256i ione = _mm256_set1_epi32(1), minusOne = _mm256_set1_epi32(-1);
+			// A partial last vector is computed into tmp; the lanes past n sample harmless coordinates
+			T tmp[8];
+
+			for (std::size_t j = 0; j < n; j += 8) {
+				T* out = j + 8 <= n ? dst + j : tmp;
+				__m256 jj = _mm256_add_ps(_mm256_set1_ps(float(j)), lane);
+				__m256 x = _mm256_add_ps(vx0, _mm256_mul_ps(jj, vdx));
+				__m256 y = _mm256_add_ps(vy0, _mm256_mul_ps(jj, vdy));
+
+				if (!bilinear) {
+					x = _mm256_add_ps(x, half);
+					y = _mm256_add_ps(y, half);
+					__m256 inside = _mm256_and_ps(
+						_mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ), _mm256_cmp_ps(x, fcols, _CMP_LT_OQ)),
+						_mm256_and_ps(_mm256_cmp_ps(y, zero, _CMP_GE_OQ), _mm256_cmp_ps(y, frows, _CMP_LT_OQ)));
+					__m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(y), icols), _mm256_cvttps_epi32(x));
+					gatherStore(src, idx, _mm256_castps_si256(inside), fill, out);
+					if (out == tmp)
+						for (std::size_t k = 0; j + k < n; ++k)
+							dst[j + k] = tmp[k];
+					continue;
+				}
+
+				__m256i inside = _mm256_castps_si256(_mm256_and_ps(
+					_mm256_and_ps(_mm256_cmp_ps(x, minusOneF, _CMP_GT_OQ), _mm256_cmp_ps(x, fcols, _CMP_LT_OQ)),
+					_mm256_and_ps(_mm256_cmp_ps(y, minusOneF, _CMP_GT_OQ), _mm256_cmp_ps(y, frows, _CMP_LT_OQ))));
+				__m256i ix = _mm256_sub_epi32(_mm256_cvttps_epi32(_mm256_add_ps(x, one)), ione);
+				__m256i iy = _mm256_sub_epi32(_mm256_cvttps_epi32(_mm256_add_ps(y, one)), ione);
+				__m256 ax = _mm256_sub_ps(x, _mm256_cvtepi32_ps(ix));
+				__m256 ay = _mm256_sub_ps(y, _mm256_cvtepi32_ps(iy));
+
+				__m256i col0 = _mm256_cmpgt_epi32(ix, minusOne), col1 = _mm256_cmpgt_epi32(lastCol, ix);
+				__m256i row0 = _mm256_and_si256(inside, _mm256_cmpgt_epi32(iy, minusOne));
+				__m256i row1 = _mm256_and_si256(inside, _mm256_cmpgt_epi32(lastRow, iy));
+				__m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(iy, icols), ix);
+				__m256i idxDown = _mm256_add_epi32(idx, icols);
+
+				__m256 v00 = gatherPixels(src, idx, _mm256_and_si256(row0, col0), fill);
+				__m256 v01 = gatherPixels(src, _mm256_add_epi32(idx, ione), _mm256_and_si256(row0, col1), fill);
+				__m256 v10 = gatherPixels(src, idxDown, _mm256_and_si256(row1, col0), fill);
+				__m256 v11 = gatherPixels(src, _mm256_add_epi32(idxDown, ione), _mm256_and_si256(row1, col1), fill);
+
+				__m256 top = _mm256_add_ps(v00, _mm256_mul_ps(ax, _mm256_sub_ps(v01, v00)));
+				__m256 bottom = _mm256_add_ps(v10, _mm256_mul_ps(ax, _mm256_sub_ps(v11, v10)));
+				storePixels(out, _mm256_add_ps(top, _mm256_mul_ps(ay, _mm256_sub_ps(bottom, top))));
+				if (out == tmp)
+					for (std::size_t k = 0; j + k < n; ++k)
+						dst[j + k] = tmp[k];
+			}
+		}
+
+		struct Avx2Double {
+			using T = double;
+			using V = __m256d;
+			static constexpr std::size_t W = 4;
+
+			static V zero() { return _mm256_setzero_pd(); }
+			static V set1(T s) { return _mm256_set1_pd(s); }
+			static V load(const T* p) { return _mm256_load_pd(p); }
+			static V loadu(const T* p) { return _mm256_loadu_pd(p); }
+			static void store(T* p, V v) { _mm256_storeu_pd(p, v); }
+			static constexpr auto warpRow = &kernels::warpRow<T>;
+			static V loadBytes(const std::uint8_t* p) { return _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_loadu_si32(p))); }
+			static V add(V a, V b) { return _mm256_add_pd(a, b); }
+			static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+			static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+			static V div(V a, V b) { return _mm256_div_pd(a, b); }
+			static V sqrt(V a) { return _mm256_sqrt_pd(a); }
+			static V fmadd(V a, V b, V c) { return _mm256_fmadd_pd(a, b, c); }
+			static V max(V a, V b) { return _mm256_max_pd(a, b); }
+			static T hsum(V v) {
+				__m128d lo = _mm256_castpd256_pd128(v);
+				__m128d hi = _mm256_extractf128_pd(v, 1);
+				lo = _mm_add_pd(lo, hi);
+				__m128d swapped = _mm_unpackhi_pd(lo, lo);
+				return _mm_cvtsd_f64(_mm_add_sd(lo, swapped));
+			}
+		};
+
+		struct Avx2Float {
+			using T = float;
+			using V = __m256;
+			static constexpr std::size_t W = 8;
+
+			static V zero() { return _mm256_setzero_ps(); }
+			static V set1(T s) { return _mm256_set1_ps(s); }
+			static V load(const T* p) { return _mm256_load_ps(p); }
+			static V loadu(const T* p) { return _mm256_loadu_ps(p); }
+			static void store(T* p, V v) { _mm256_storeu_ps(p, v); }
+			static constexpr auto warpRow = &kernels::warpRow<T>;
+			static V loadBytes(const std::uint8_t* p) {
+				return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+			}
+			static V add(V a, V b) { return _mm256_add_ps(a, b); }
+			static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+			static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+			static V div(V a, V b) { return _mm256_div_ps(a, b); }
+			static V sqrt(V a) { return _mm256_sqrt_ps(a); }
+			static V fmadd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+			static V max(V a, V b) { return _mm256_max_ps(a, b); }
+			static T hsum(V v) {
+				__m128 lo = _mm256_castps256_ps128(v);
+				__m128 hi = _mm256_extractf128_ps(v, 1);
+				lo = _mm_add_ps(lo, hi);
+				lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+				lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 0x55));
+				return _mm_cvtss_f32(lo);
+			}
+		};
+
+		std::int32_t hsumI32(__m256i v)
+		{
+			__m128i lo = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+			lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, 0x4E));
+			lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, 0xB1));
+			return _mm_cvtsi128_si32(lo);
+		}
+
+		// 16 int8 -> int16, then pmaddwd: pairs of products summed into int32 lanes
+		__m256i dotStepI8(const std::int8_t* a, __m256i b, __m256i acc)
+		{
+			__m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)));
+			return _mm256_add_epi32(acc, _mm256_madd_epi16(va, b));
+		}
+
+		void matVecI8(const std::int8_t* M, std::size_t rows, std::size_t cols, std::size_t stride,
+			const std::int8_t* v, std::int32_t* out)
+		{
+			const std::size_t vecCols = cols - cols % 16;
+			std::size_t i = 0;
+			for (; i + 4 <= rows; i += 4) {
+				const std::int8_t* r0 = M + (i + 0) * stride;
+				const std::int8_t* r1 = M + (i + 1) * stride;
+				const std::int8_t* r2 = M + (i + 2) * stride;
+				const std::int8_t* r3 = M + (i + 3) * stride;
+				__m256i a0 = _mm256_setzero_si256(), a1 = a0, a2 = a0, a3 = a0;
+				for (std::size_t j = 0; j < vecCols; j += 16) {
+					__m256i x = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + j)));
+					a0 = dotStepI8(r0 + j, x, a0);
+					a1 = dotStepI8(r1 + j, x, a1);
+					a2 = dotStepI8(r2 + j, x, a2);
+					a3 = dotStepI8(r3 + j, x, a3);
+				}
+				std::int32_t s0 = hsumI32(a0), s1 = hsumI32(a1), s2 = hsumI32(a2), s3 = hsumI32(a3);
+				for (std::size_t j = vecCols; j < cols; ++j) {
+					s0 += std::int32_t(r0[j]) * v[j];
+					s1 += std::int32_t(r1[j]) * v[j];
+					s2 += std::int32_t(r2[j]) * v[j];
+					s3 += std::int32_t(r3[j]) * v[j];
+				}
+				out[i + 0] = s0;
+				out[i + 1] = s1;
+				out[i + 2] = s2;
+				out[i + 3] = s3;
+			}
+			for (; i < rows; ++i) {
+				const std::int8_t* r = M + i * stride;
+				__m256i a = _mm256_setzero_si256();
+				for (std::size_t j = 0; j < vecCols; j += 16)
+					a = dotStepI8(r + j, _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + j))), a);
+				std::int32_t s = hsumI32(a);
+				for (std::size_t j = vecCols; j < cols; ++j)
+					s += std::int32_t(r[j]) * v[j];
+				out[i] = s;
+			}
+		}
+	}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+namespace math::kernels {
+	namespace {
+		constexpr KernelSet kAvx2{
+			"avx2",
+			impl::makeTable<Avx2Float>(),
+			impl::makeTable<Avx2Double>(),
+			&matVecI8,
+		};
+	}
+
+	const KernelSet* avx2()
+	{
+		return &kAvx2;
+	}
+}
+
+#else
+
+namespace math::kernels {
+	const KernelSet* avx2()
+	{
+		return nullptr;
+	}
+}
+
+#endif
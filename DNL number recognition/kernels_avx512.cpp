@@ -0,0 +1,253 @@
+#include "kernels.h"
+
+#if defined(MATH_KERNELS_X86)
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC 12's avx512fintrin.h trips -Wmaybe-uninitialized on its own `__Y = __Y` placeholders
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+
+// Everything below is compiled for AVX-512F + BW; it is only reached through the table
+// returned by avx512(), which active() hands out after checking the CPU.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f,avx512bw"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+#endif
+
+#include "kernels_impl.h"
+
+namespace math::kernels {
+	namespace {
+		// Image warp: 16 output pixels per step, coordinates and bilinear weights in float.
+		// Gathers take the pixels under `mask` and leave fill in the other lanes.
+		__m512 gatherPixels(const float* src, __m512i idx, __mmask16 mask, float fill)
+		{
+			return _mm512_mask_i32gather_ps(_mm512_set1_ps(fill), mask, idx, src, 4);
+		}
+
+		__m512 gatherPixels(const double* src, __m512i idx, __mmask16 mask, double fill)
+		{
+			const __m512d f = _mm512_set1_pd(fill);
+			__m512d lo = _mm512_mask_i32gather_pd(f, __mmask8(mask), _mm512_castsi512_si256(idx), src, 8);
+			__m512d hi = _mm512_mask_i32gather_pd(f, __mmask8(mask >> 8), _mm512_extracti64x4_epi64(idx, 1), src, 8);
+			__m512d both = _mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(lo))),
+				_mm256_castps_pd(_mm512_cvtpd_ps(hi)), 1);
+			return _mm512_castpd_ps(both);
+		}
+
+		void storePixels(float* dst, __m512 v) { _mm512_storeu_ps(dst, v); }
+		void storePixels(double* dst, __m512 v)
+		{
+			_mm512_storeu_pd(dst, _mm512_cvtps_pd(_mm512_castps512_ps256(v)));
+			_mm512_storeu_pd(dst + 8, _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1))));
+		}
+
+		// Nearest samples are copied exactly, without a round trip through float
+		void gatherStore(const float* src, __m512i idx, __mmask16 mask, float fill, float* dst)
+		{
+			storePixels(dst, gatherPixels(src, idx, mask, fill));
+		}
+
+		void gatherStore(const double* src, __m512i idx, __mmask16 mask, double fill, double* dst)
+		{
+			const __m512d f = _mm512_set1_pd(fill);
+			_mm512_storeu_pd(dst, _mm512_mask_i32gather_pd(f, __mmask8(mask), _mm512_castsi512_si256(idx), src, 8));
+			_mm512_storeu_pd(dst + 8, _mm512_mask_i32gather_pd(f, __mmask8(mask >> 8), _mm512_extracti64x4_epi64(idx, 1), src, 8));
+		}
+
+		template <typename T>
+		void warpRow(const T* src, std::size_t rows, std::size_t cols,
+			float x0, float y0, float dx, float dy, std::size_t n, bool bilinear, T fill, T* dst)
+		{
+			const __m512 lane = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+			const __m512 vx0 = _mm512_set1_ps(x0), vy0 = _mm512_set1_ps(y0);
+			const __m512 vdx = _mm512_set1_ps(dx), vdy = _mm512_set1_ps(dy);
+			const __m512 fcols = _mm512_set1_ps(float(cols)), frows = _mm512_set1_ps(float(rows));
+			const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f), half = _mm512_set1_ps(0.5f);
+			const __m512 minusOneF = _mm512_set1_ps(-1.0f);
+			const __m512i icols = _mm512_set1_epi32(int(cols));
+			const __m512i lastCol = _mm512_set1_epi32(int(cols) - 1), lastRow = _mm512_set1_epi32(int(rows) - 1);
+			const __m512i ione = _mm512_set1_epi32(1), minusOne = _mm512_set1_epi32(-1);
+			// A partial last vector is computed into tmp; the lanes past n sample harmless coordinates
+			T tmp[16];
+
+			for (std::size_t j = 0; j < n; j += 16) {
+				T* out = j + 16 <= n ? dst + j : tmp;
+				__m512 jj = _mm512_add_ps(_mm512_set1_ps(float(j)), lane);
+				__m512 x = _mm512_add_ps(vx0, _mm512_mul_ps(jj, vdx));
+				__m512 y = _mm512_add_ps(vy0, _mm512_mul_ps(jj, vdy));
+
+				if (!bilinear) {
+					x = _mm512_add_ps(x, half);
+					y = _mm512_add_ps(y, half);
+					__mmask16 inside = _mm512_cmp_ps_mask(x, zero, _CMP_GE_OQ) & _mm512_cmp_ps_mask(x, fcols, _CMP_LT_OQ)
+						& _mm512_cmp_ps_mask(y, zero, _CMP_GE_OQ) & _mm512_cmp_ps_mask(y, frows, _CMP_LT_OQ);
+					__m512i idx = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_cvttps_epi32(y), icols), _mm512_cvttps_epi32(x));
+					gatherStore(src, idx, inside, fill, out);
+					if (out == tmp)
+						for (std::size_t k = 0; j + k < n; ++k)
+							dst[j + k] = tmp[k];
+					continue;
+				}
+
+				__mmask16 inside = _mm512_cmp_ps_mask(x, minusOneF, _CMP_GT_OQ) & _mm512_cmp_ps_mask(x, fcols, _CMP_LT_OQ)
+					& _mm512_cmp_ps_mask(y, minusOneF, _CMP_GT_OQ) & _mm512_cmp_ps_mask(y, frows, _CMP_LT_OQ);
+				__m512i ix = _mm512_sub_epi32(_mm512_cvttps_epi32(_mm512_add_ps(x, one)), ione);
+				__m512i iy = _mm512_sub_epi32(_mm512_cvttps_epi32(_mm512_add_ps(y, one)), ione);
+				__m512 ax = _mm512_sub_ps(x, _mm512_cvtepi32_ps(ix));
+				__m512 ay = _mm512_sub_ps(y, _mm512_cvtepi32_ps(iy));
+
+				__mmask16 col0 = _mm512_cmpgt_epi32_mask(ix, minusOne), col1 = _mm512_cmpgt_epi32_mask(lastCol, ix);
+				__mmask16 row0 = inside & _mm512_cmpgt_epi32_mask(iy, minusOne);
+				__mmask16 row1 = inside & _mm512_cmpgt_epi32_mask(lastRow, iy);
+				__m512i idx = _mm512_add_epi32(_mm512_mullo_epi32(iy, icols), ix);
+				__m512i idxDown = _mm512_add_epi32(idx, icols);
+
+				__m512 v00 = gatherPixels(src, idx, row0 & col0, fill);
+				__m512 v01 = gatherPixels(src, _mm512_add_epi32(idx, ione), row0 & col1, fill);
+				__m512 v10 = gatherPixels(src, idxDown, row1 & col0, fill);
+				__m512 v11 = gatherPixels(src, _mm512_add_epi32(idxDown, ione), row1 & col1, fill);
+
+				__m512 top = _mm512_add_ps(v00, _mm512_mul_ps(ax, _mm512_sub_ps(v01, v00)));
+				__m512 bottom = _mm512_add_ps(v10, _mm512_mul_ps(ax, _mm512_sub_ps(v11, v10)));
+				storePixels(out, _mm512_add_ps(top, _mm512_mul_ps(ay, _mm512_sub_ps(bottom, top))));
+				if (out == tmp)
+					for (std::size_t k = 0; j + k < n; ++k)
+						dst[j + k] = tmp[k];
+			}
+		}
+
+		struct Avx512Double {
+			using T = double;
+			using V = __m512d;
+			static constexpr std::size_t W = 8;
+
+			static V zero() { return _mm512_setzero_pd(); }
+			static V set1(T s) { return _mm512_set1_pd(s); }
+			static V load(const T* p) { return _mm512_load_pd(p); }
+			static V loadu(const T* p) { return _mm512_loadu_pd(p); }
+			static void store(T* p, V v) { _mm512_storeu_pd(p, v); }
+			static constexpr auto warpRow = &kernels::warpRow<T>;
+			static V loadBytes(const std::uint8_t* p) {
+				return _mm512_cvtepi32_pd(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+			}
+			static V add(V a, V b) { return _mm512_add_pd(a, b); }
+			static V sub(V a, V b) { return _mm512_sub_pd(a, b); }
+			static V mul(V a, V b) { return _mm512_mul_pd(a, b); }
+			static V div(V a, V b) { return _mm512_div_pd(a, b); }
+			static V sqrt(V a) { return _mm512_sqrt_pd(a); }
+			static V fmadd(V a, V b, V c) { return _mm512_fmadd_pd(a, b, c); }
+			static V max(V a, V b) { return _mm512_max_pd(a, b); }
+			static T hsum(V v) { return _mm512_reduce_add_pd(v); }
+		};
+
+		struct Avx512Float {
+			using T = float;
+			using V = __m512;
+			static constexpr std::size_t W = 16;
+
+			static V zero() { return _mm512_setzero_ps(); }
+			static V set1(T s) { return _mm512_set1_ps(s); }
+			static V load(const T* p) { return _mm512_load_ps(p); }
+			static V loadu(const T* p) { return _mm512_loadu_ps(p); }
+			static void store(T* p, V v) { _mm512_storeu_ps(p, v); }
+			static constexpr auto warpRow = &kernels::warpRow<T>;
+			static V loadBytes(const std::uint8_t* p) {
+				return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))));
+			}
+			static V add(V a, V b) { return _mm512_add_ps(a, b); }
+			static V sub(V a, V b) { return _mm512_sub_ps(a, b); }
+			static V mul(V a, V b) { return _mm512_mul_ps(a, b); }
+			static V div(V a, V b) { return _mm512_div_ps(a, b); }
+			static V sqrt(V a) { return _mm512_sqrt_ps(a); }
+			static V fmadd(V a, V b, V c) { return _mm512_fmadd_ps(a, b, c); }
+			static V max(V a, V b) { return _mm512_max_ps(a, b); }
+			static T hsum(V v) { return _mm512_reduce_add_ps(v); }
+		};
+
+		// 32 int8 -> int16, then pmaddwd: pairs of products summed into int32 lanes
+		__m512i dotStepI8(const std::int8_t* a, __m512i b, __m512i acc)
+		{
+			__m512i va = _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)));
+			return _mm512_add_epi32(acc, _mm512_madd_epi16(va, b));
+		}
+
+		void matVecI8(const std::int8_t* M, std::size_t rows, std::size_t cols, std::size_t stride,
+			const std::int8_t* v, std::int32_t* out)
+		{
+			const std::size_t vecCols = cols - cols % 32;
+			std::size_t i = 0;
+			for (; i + 4 <= rows; i += 4) {
+				const std::int8_t* r0 = M + (i + 0) * stride;
+				const std::int8_t* r1 = M + (i + 1) * stride;
+				const std::int8_t* r2 = M + (i + 2) * stride;
+				const std::int8_t* r3 = M + (i + 3) * stride;
+				__m512i a0 = _mm512_setzero_si512(), a1 = a0, a2 = a0, a3 = a0;
+				for (std::size_t j = 0; j < vecCols; j += 32) {
+					__m512i x = _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + j)));
+					a0 = dotStepI8(r0 + j, x, a0);
+					a1 = dotStepI8(r1 + j, x, a1);
+					a2 = dotStepI8(r2 + j, x, a2);
+					a3 = dotStepI8(r3 + j, x, a3);
+				}
+				std::int32_t s0 = _mm512_reduce_add_epi32(a0), s1 = _mm512_reduce_add_epi32(a1);
+				std::int32_t s2 = _mm512_reduce_add_epi32(a2), s3 = _mm512_reduce_add_epi32(a3);
+				for (std::size_t j = vecCols; j < cols; ++j) {
+					s0 += std::int32_t(r0[j]) * v[j];
+					s1 += std::int32_t(r1[j]) * v[j];
+					s2 += std::int32_t(r2[j]) * v[j];
+					s3 += std::int32_t(r3[j]) * v[j];
+				}
+				out[i + 0] = s0;
+				out[i + 1] = s1;
+				out[i + 2] = s2;
+				out[i + 3] = s3;
+			}
+			for (; i < rows; ++i) {
+				const std::int8_t* r = M + i * stride;
+				__m512i a = _mm512_setzero_si512();
+				for (std::size_t j = 0; j < vecCols; j += 32)
+					a = dotStepI8(r + j, _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + j))), a);
+				std::int32_t s = _mm512_reduce_add_epi32(a);
+				for (std::size_t j = vecCols; j < cols; ++j)
+					s += std::int32_t(r[j]) * v[j];
+				out[i] = s;
+			}
+		}
+	}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+namespace math::kernels {
+	namespace {
+		constexpr KernelSet kAvx512{
+			"avx512",
+			impl::makeTable<Avx512Float>(),
+			impl::makeTable<Avx512Double>(),
+			&matVecI8,
+		};
+	}
+
+	const KernelSet* avx512()
+	{
+		return &kAvx512;
+	}
+}
+
+#else
+
+namespace math::kernels {
+	const KernelSet* avx512()
+	{
+		return nullptr;
+	}
+}
+
+#endif
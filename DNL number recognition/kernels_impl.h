@@ -0,0 +1,559 @@
+#pragma once
+#include <cstddef>
+
+/*
+
+ Kernel bodies shared by every instruction set.
+ Included by one translation unit per ISA *after* it has switched the compiler to that
+ target, so everything here gets compiled for it. Do not include standard headers below
+ this point in those files: inline library code compiled with AVX enabled could be picked
+ by the linker for the generic build as well.
+
+ `Ops` describes one SIMD register:
+   T        scalar type
+   V        register type
+   W        lanes per register
+   zero(), set1(s), load(p) (aligned), loadu(p), store(p, v) (unaligned),
+   loadBytes(p) (W unsigned bytes widened to T),
+   add(a, b), sub(a, b), mul(a, b), div(a, b), fmadd(a, b, c) = a*b + c, max(a, b),
+   sqrt(v), hsum(v)
+ and the image warp row kernel, which needs gathers rather than register arithmetic:
+   warpRow (see Table; warpRowScalar below handles what the vector loop leaves over)
+
+*/
+namespace math::kernels::impl {
+
+	template <class Ops>
+	void matVec(const typename Ops::T* M, std::size_t rows, std::size_t cols, std::size_t stride,
+		const typename Ops::T* v, typename Ops::T* out)
+	{
+		using T = typename Ops::T;
+		using V = typename Ops::V;
+		constexpr std::size_t W = Ops::W;
+		const std::size_t vecCols = cols - cols % W;
+
+		// Four rows at a time so every load of v feeds four FMAs.
+		std::size_t i = 0;
+		for (; i + 4 <= rows; i += 4) {
+			const T* r0 = M + (i + 0) * stride;
+			const T* r1 = M + (i + 1) * stride;
+			const T* r2 = M + (i + 2) * stride;
+			const T* r3 = M + (i + 3) * stride;
+
+			V a0 = Ops::zero(), a1 = Ops::zero(), a2 = Ops::zero(), a3 = Ops::zero();
+			for (std::size_t j = 0; j < vecCols; j += W) {
+				V x = Ops::loadu(v + j);
+				a0 = Ops::fmadd(Ops::load(r0 + j), x, a0);
+				a1 = Ops::fmadd(Ops::load(r1 + j), x, a1);
+				a2 = Ops::fmadd(Ops::load(r2 + j), x, a2);
+				a3 = Ops::fmadd(Ops::load(r3 + j), x, a3);
+			}
+
+			T s0 = Ops::hsum(a0), s1 = Ops::hsum(a1), s2 = Ops::hsum(a2), s3 = Ops::hsum(a3);
+			for (std::size_t j = vecCols; j < cols; ++j) {
+				s0 += r0[j] * v[j];
+				s1 += r1[j] * v[j];
+				s2 += r2[j] * v[j];
+				s3 += r3[j] * v[j];
+			}
+			out[i + 0] = s0;
+			out[i + 1] = s1;
+			out[i + 2] = s2;
+			out[i + 3] = s3;
+		}
+
+		for (; i < rows; ++i) {
+			const T* r = M + i * stride;
+			V a = Ops::zero();
+			for (std::size_t j = 0; j < vecCols; j += W)
+				a = Ops::fmadd(Ops::load(r + j), Ops::loadu(v + j), a);
+
+			T s = Ops::hsum(a);
+			for (std::size_t j = vecCols; j < cols; ++j)
+				s += r[j] * v[j];
+			out[i] = s;
+		}
+	}
+
+	template <class Ops>
+	void addBias(typename Ops::T* out, const typename Ops::T* bias, std::size_t n)
+	{
+		constexpr std::size_t W = Ops::W;
+		std::size_t i = 0;
+		for (; i + W <= n; i += W)
+			Ops::store(out + i, Ops::add(Ops::loadu(out + i), Ops::loadu(bias + i)));
+		for (; i < n; ++i)
+			out[i] += bias[i];
+	}
+
+	template <class Ops>
+	void relu(typename Ops::T* v, std::size_t n)
+	{
+		using T = typename Ops::T;
+		constexpr std::size_t W = Ops::W;
+		const auto zero = Ops::zero();
+		std::size_t i = 0;
+		for (; i + W <= n; i += W)
+			Ops::store(v + i, Ops::max(Ops::loadu(v + i), zero));
+		for (; i < n; ++i)
+			if (v[i] < T(0))
+				v[i] = T(0);
+	}
+
+	template <class Ops>
+	void axpy(std::size_t n, typename Ops::T alpha, const typename Ops::T* x, typename Ops::T* y)
+	{
+		constexpr std::size_t W = Ops::W;
+		const auto a = Ops::set1(alpha);
+		std::size_t i = 0;
+		for (; i + W <= n; i += W)
+			Ops::store(y + i, Ops::fmadd(a, Ops::loadu(x + i), Ops::loadu(y + i)));
+		for (; i < n; ++i)
+			y[i] += alpha * x[i];
+	}
+
+	template <class Ops>
+	void sparseVecMat(const typename Ops::T* M, std::size_t cols, std::size_t stride,
+		const std::uint32_t* index, const typename Ops::T* value, std::size_t nnz, typename Ops::T* out)
+	{
+		using T = typename Ops::T;
+		using V = typename Ops::V;
+		constexpr std::size_t W = Ops::W;
+
+		// Four registers of outputs at a time, accumulated over every nonzero before they
+		// are stored: each selected row is read once per block, out is written once.
+		// Rows are aligned and j is a multiple of W, so the row loads are aligned.
+		std::size_t j = 0;
+		for (; j + 4 * W <= cols; j += 4 * W) {
+			V a0 = Ops::zero(), a1 = Ops::zero(), a2 = Ops::zero(), a3 = Ops::zero();
+			for (std::size_t k = 0; k < nnz; ++k) {
+				const T* r = M + std::size_t(index[k]) * stride + j;
+				const V x = Ops::set1(value[k]);
+				a0 = Ops::fmadd(x, Ops::load(r), a0);
+				a1 = Ops::fmadd(x, Ops::load(r + W), a1);
+				a2 = Ops::fmadd(x, Ops::load(r + 2 * W), a2);
+				a3 = Ops::fmadd(x, Ops::load(r + 3 * W), a3);
+			}
+			Ops::store(out + j, a0);
+			Ops::store(out + j + W, a1);
+			Ops::store(out + j + 2 * W, a2);
+			Ops::store(out + j + 3 * W, a3);
+		}
+		for (; j + W <= cols; j += W) {
+			V a = Ops::zero();
+			for (std::size_t k = 0; k < nnz; ++k)
+				a = Ops::fmadd(Ops::set1(value[k]), Ops::load(M + std::size_t(index[k]) * stride + j), a);
+			Ops::store(out + j, a);
+		}
+		for (; j < cols; ++j) {
+			T s = T(0);
+			for (std::size_t k = 0; k < nnz; ++k)
+				s += value[k] * M[std::size_t(index[k]) * stride + j];
+			out[j] = s;
+		}
+	}
+
+	template <class Ops>
+	void bscMatVec(const typename Ops::T* values, const std::uint32_t* colStart, const std::uint32_t* blockRow,
+		std::size_t rows, std::size_t R, std::size_t C,
+		const std::uint32_t* index, const typename Ops::T* value, std::size_t nnz, typename Ops::T* out)
+	{
+		using T = typename Ops::T;
+		constexpr std::size_t W = Ops::W;
+		const std::size_t blockSize = R * C;
+
+		for (std::size_t i = 0; i < rows; ++i)
+			out[i] = T(0);
+
+		// Only the nonzero inputs are visited, each adding its run of R weights in every
+		// stored block of its column to the R outputs the block covers (kept in L1).
+		// CSC (1 x 1 blocks) is a plain scatter, without the block arithmetic.
+		if (R == 1 && C == 1) {
+			for (std::size_t n = 0; n < nnz; ++n) {
+				const T xs = value[n];
+				for (std::size_t k = colStart[index[n]]; k < colStart[index[n] + 1]; ++k)
+					out[blockRow[k]] += xs * values[k];
+			}
+			return;
+		}
+		for (std::size_t n = 0; n < nnz; ++n) {
+			const std::size_t q = C == 1 ? index[n] : index[n] / C;
+			const std::size_t c = index[n] - q * C;
+			const T xs = value[n];
+			const auto xv = Ops::set1(xs);
+			for (std::size_t k = colStart[q]; k < colStart[q + 1]; ++k) {
+				const T* b = values + k * blockSize + c * R;
+				T* o = out + blockRow[k];
+				std::size_t j = 0;
+				for (; j + W <= R; j += W)
+					Ops::store(o + j, Ops::fmadd(xv, Ops::loadu(b + j), Ops::loadu(o + j)));
+				for (; j < R; ++j)
+					o[j] += xs * b[j];
+			}
+		}
+	}
+
+	/*
+
+	 Optimizer updates, each one fused pass over the parameters and their state.
+	 The last n % W elements go through one vector step on a zero-padded copy.
+
+	*/
+	namespace optimizerDetail {
+		template <class Ops>
+		void momentum(const typename Ops::T* g, typename Ops::T* v, typename Ops::T* p,
+			typename Ops::V rate, typename Ops::V mu, bool nesterov)
+		{
+			const auto grad = Ops::loadu(g);
+			const auto vel = Ops::fmadd(mu, Ops::loadu(v), grad);
+			Ops::store(v, vel);
+			// Nesterov steps along the gradient plus the look-ahead velocity
+			const auto dir = nesterov ? Ops::fmadd(mu, vel, grad) : vel;
+			Ops::store(p, Ops::sub(Ops::loadu(p), Ops::mul(rate, dir)));
+		}
+
+		template <class Ops>
+		void adam(const typename Ops::T* g, typename Ops::T* m, typename Ops::T* v, typename Ops::T* p,
+			typename Ops::V rate, typename Ops::V b1, typename Ops::V c1, typename Ops::V b2,
+			typename Ops::V c2, typename Ops::V eps)
+		{
+			const auto grad = Ops::loadu(g);
+			const auto mean = Ops::fmadd(b1, Ops::loadu(m), Ops::mul(c1, grad));
+			const auto var = Ops::fmadd(b2, Ops::loadu(v), Ops::mul(c2, Ops::mul(grad, grad)));
+			Ops::store(m, mean);
+			Ops::store(v, var);
+			const auto step = Ops::div(Ops::mul(rate, mean), Ops::add(Ops::sqrt(var), eps));
+			Ops::store(p, Ops::sub(Ops::loadu(p), step));
+		}
+	}
+
+	// v = mu * v + g, then p -= rate * v (Nesterov: p -= rate * (g + mu * v))
+	template <class Ops>
+	void momentumStep(std::size_t n, typename Ops::T rate, typename Ops::T mu, bool nesterov,
+		const typename Ops::T* g, typename Ops::T* v, typename Ops::T* p)
+	{
+		using T = typename Ops::T;
+		constexpr std::size_t W = Ops::W;
+		const auto vr = Ops::set1(rate), vmu = Ops::set1(mu);
+		std::size_t i = 0;
+		for (; i + W <= n; i += W)
+			optimizerDetail::momentum<Ops>(g + i, v + i, p + i, vr, vmu, nesterov);
+		if (i < n) {
+			alignas(64) T tg[W] = {}, tv[W] = {}, tp[W] = {};
+			for (std::size_t k = 0; i + k < n; ++k) {
+				tg[k] = g[i + k];
+				tv[k] = v[i + k];
+				tp[k] = p[i + k];
+			}
+			optimizerDetail::momentum<Ops>(tg, tv, tp, vr, vmu, nesterov);
+			for (std::size_t k = 0; i + k < n; ++k) {
+				v[i + k] = tv[k];
+				p[i + k] = tp[k];
+			}
+		}
+	}
+
+	// m = beta1 m + (1 - beta1) g, v = beta2 v + (1 - beta2) g^2, p -= rate * m / (sqrt(v) + eps),
+	// with the bias corrections already folded into rate and eps by the caller
+	template <class Ops>
+	void adamStep(std::size_t n, typename Ops::T rate, typename Ops::T beta1, typename Ops::T beta2,
+		typename Ops::T eps, const typename Ops::T* g, typename Ops::T* m, typename Ops::T* v,
+		typename Ops::T* p)
+	{
+		using T = typename Ops::T;
+		constexpr std::size_t W = Ops::W;
+		const auto vr = Ops::set1(rate), ve = Ops::set1(eps);
+		const auto b1 = Ops::set1(beta1), c1 = Ops::set1(T(1) - beta1);
+		const auto b2 = Ops::set1(beta2), c2 = Ops::set1(T(1) - beta2);
+		std::size_t i = 0;
+		for (; i + W <= n; i += W)
+			optimizerDetail::adam<Ops>(g + i, m + i, v + i, p + i, vr, b1, c1, b2, c2, ve);
+		if (i < n) {
+			alignas(64) T tg[W] = {}, tm[W] = {}, tv[W] = {}, tp[W] = {};
+			for (std::size_t k = 0; i + k < n; ++k) {
+				tg[k] = g[i + k];
+				tm[k] = m[i + k];
+				tv[k] = v[i + k];
+				tp[k] = p[i + k];
+			}
+			optimizerDetail::adam<Ops>(tg, tm, tv, tp, vr, b1, c1, b2, c2, ve);
+			for (std::size_t k = 0; i + k < n; ++k) {
+				m[i + k] = tm[k];
+				v[i + k] = tv[k];
+				p[i + k] = tp[k];
+			}
+		}
+	}
+
+	template <class Ops>
+	void scaleBytes(const std::uint8_t* src, std::size_t n, typename Ops::T scale, typename Ops::T* dst)
+	{
+		using T = typename Ops::T;
+		constexpr std::size_t W = Ops::W;
+		const auto s = Ops::set1(scale);
+		std::size_t i = 0;
+		for (; i + W <= n; i += W)
+			Ops::store(dst + i, Ops::mul(Ops::loadBytes(src + i), s));
+		for (; i < n; ++i)
+			dst[i] = T(src[i]) * scale;
+	}
+
+	// Pixels [begin, n) of warpRow. Coordinates are tested against the image before they
+	// are converted to int, so absurd transforms just produce fill.
+	template <typename T>
+	void warpRowScalar(const T* src, std::size_t rows, std::size_t cols,
+		float x0, float y0, float dx, float dy, std::size_t begin, std::size_t n, bool bilinear, T fill, T* dst)
+	{
+		const float fcols = float(cols), frows = float(rows);
+		const int lastCol = int(cols) - 1, lastRow = int(rows) - 1;
+		for (std::size_t j = begin; j < n; ++j) {
+			float x = x0 + float(j) * dx;
+			float y = y0 + float(j) * dy;
+
+			if (!bilinear) {
+				// round half up: trunc(x + 0.5) once x + 0.5 >= 0
+				x += 0.5f;
+				y += 0.5f;
+				dst[j] = (x >= 0.0f && x < fcols && y >= 0.0f && y < frows)
+					? src[std::size_t(int(y)) * cols + std::size_t(int(x))] : fill;
+				continue;
+			}
+
+			if (!(x > -1.0f && x < fcols && y > -1.0f && y < frows)) {
+				dst[j] = fill;
+				continue;
+			}
+			// floor(v) = trunc(v + 1) - 1 for v > -1
+			const int ix = int(x + 1.0f) - 1, iy = int(y + 1.0f) - 1;
+			const float ax = x - float(ix), ay = y - float(iy);
+			auto at = [&](int r, int c) {
+				return (r >= 0 && r <= lastRow && c >= 0 && c <= lastCol)
+					? float(src[std::size_t(r) * cols + std::size_t(c)]) : float(fill);
+			};
+			const float v00 = at(iy, ix), v01 = at(iy, ix + 1);
+			const float v10 = at(iy + 1, ix), v11 = at(iy + 1, ix + 1);
+			const float top = v00 + ax * (v01 - v00);
+			const float bottom = v10 + ax * (v11 - v10);
+			dst[j] = T(top + ay * (bottom - top));
+		}
+	}
+
+	namespace gemmDetail {
+		constexpr std::size_t MR = 4;
+
+		// Up to this many rows of C, a packed B panel would be read by so few register tiles
+		// that packing it costs more than it saves: full-width panels of a row-major B are
+		// then read in place (small-M products such as convolutions with few filters).
+		constexpr std::size_t kDirectBRows = 4 * MR;
+
+		// Register tile width: two vectors per row
+		template <class Ops>
+		constexpr std::size_t nr() { return 2 * Ops::W; }
+
+		// Copy op(A)[i0:i0+mc, k0:k0+kc] as MR-row panels: panel p holds, for each k, MR values.
+		template <typename T>
+		void packA(bool transA, const T* A, std::size_t lda, std::size_t i0, std::size_t k0,
+			std::size_t mc, std::size_t kc, T* out)
+		{
+			for (std::size_t ip = 0; ip < mc; ip += MR) {
+				const std::size_t m = (mc - ip < MR) ? mc - ip : MR;
+				if (transA) {
+					for (std::size_t k = 0; k < kc; ++k) {
+						const T* src = A + (k0 + k) * lda + i0 + ip;
+						for (std::size_t r = 0; r < MR; ++r)
+							out[k * MR + r] = r < m ? src[r] : T(0);
+					}
+				}
+				else {
+					// MR rows of A side by side: read each one contiguously
+					for (std::size_t r = 0; r < MR; ++r) {
+						const T* src = A + (i0 + ip + r) * lda + k0;
+						for (std::size_t k = 0; k < kc; ++k)
+							out[k * MR + r] = r < m ? src[k] : T(0);
+					}
+				}
+				out += kc * MR;
+			}
+		}
+
+		// Copy op(B)[k0:k0+kc, j0:j0+nc] as NR-column panels: panel p holds, for each k, NR values.
+		template <typename T, std::size_t NR>
+		void packB(bool transB, const T* B, std::size_t ldb, std::size_t k0, std::size_t j0,
+			std::size_t kc, std::size_t nc, T* out)
+		{
+			for (std::size_t jp = 0; jp < nc; jp += NR) {
+				const std::size_t n = (nc - jp < NR) ? nc - jp : NR;
+				if (!transB) {
+					for (std::size_t k = 0; k < kc; ++k) {
+						const T* src = B + (k0 + k) * ldb + j0 + jp;
+						for (std::size_t c = 0; c < n; ++c)
+							out[k * NR + c] = src[c];
+						for (std::size_t c = n; c < NR; ++c)
+							out[k * NR + c] = T(0);
+					}
+				}
+				else {
+					// op(B) columns are rows of B: read each one contiguously
+					for (std::size_t c = 0; c < n; ++c) {
+						const T* src = B + (j0 + jp + c) * ldb + k0;
+						for (std::size_t k = 0; k < kc; ++k)
+							out[k * NR + c] = src[k];
+					}
+					for (std::size_t k = 0; k < kc; ++k)
+						for (std::size_t c = n; c < NR; ++c)
+							out[k * NR + c] = T(0);
+				}
+				out += kc * NR;
+			}
+		}
+
+		// C[0:m, 0:n] += alpha * Apanel * Bpanel over kc, with the whole MR x NR tile in registers.
+		// The B panel's rows of NR values are ldbp apart (NR when packed).
+		// The 4 x 2 register tile is spelled out so it stays in registers at -O2 / MSVC /O2 too.
+		template <class Ops>
+		void microKernel(std::size_t kc, typename Ops::T alpha, const typename Ops::T* Ap,
+			const typename Ops::T* Bp, std::size_t ldbp, typename Ops::T* C, std::size_t ldc,
+			std::size_t m, std::size_t n)
+		{
+			using T = typename Ops::T;
+			using V = typename Ops::V;
+			constexpr std::size_t W = Ops::W;
+			constexpr std::size_t NR = nr<Ops>();
+			static_assert(MR == 4, "microKernel is unrolled for a 4 x 2 register tile");
+
+			V c00 = Ops::zero(), c01 = Ops::zero();
+			V c10 = Ops::zero(), c11 = Ops::zero();
+			V c20 = Ops::zero(), c21 = Ops::zero();
+			V c30 = Ops::zero(), c31 = Ops::zero();
+
+			for (std::size_t k = 0; k < kc; ++k) {
+				const V b0 = Ops::loadu(Bp);
+				const V b1 = Ops::loadu(Bp + W);
+				V a = Ops::set1(Ap[0]);
+				c00 = Ops::fmadd(a, b0, c00);
+				c01 = Ops::fmadd(a, b1, c01);
+				a = Ops::set1(Ap[1]);
+				c10 = Ops::fmadd(a, b0, c10);
+				c11 = Ops::fmadd(a, b1, c11);
+				a = Ops::set1(Ap[2]);
+				c20 = Ops::fmadd(a, b0, c20);
+				c21 = Ops::fmadd(a, b1, c21);
+				a = Ops::set1(Ap[3]);
+				c30 = Ops::fmadd(a, b0, c30);
+				c31 = Ops::fmadd(a, b1, c31);
+				Ap += MR;
+				Bp += ldbp;
+			}
+
+			const V va = Ops::set1(alpha);
+			if (m == MR && n == NR) {
+				T* c = C;
+				Ops::store(c, Ops::fmadd(va, c00, Ops::loadu(c)));
+				Ops::store(c + W, Ops::fmadd(va, c01, Ops::loadu(c + W)));
+				c += ldc;
+				Ops::store(c, Ops::fmadd(va, c10, Ops::loadu(c)));
+				Ops::store(c + W, Ops::fmadd(va, c11, Ops::loadu(c + W)));
+				c += ldc;
+				Ops::store(c, Ops::fmadd(va, c20, Ops::loadu(c)));
+				Ops::store(c + W, Ops::fmadd(va, c21, Ops::loadu(c + W)));
+				c += ldc;
+				Ops::store(c, Ops::fmadd(va, c30, Ops::loadu(c)));
+				Ops::store(c + W, Ops::fmadd(va, c31, Ops::loadu(c + W)));
+				return;
+			}
+
+			// Edge tile: spill and add only the valid part
+			alignas(64) T tile[MR][NR];
+			Ops::store(&tile[0][0], c00);
+			Ops::store(&tile[0][W], c01);
+			Ops::store(&tile[1][0], c10);
+			Ops::store(&tile[1][W], c11);
+			Ops::store(&tile[2][0], c20);
+			Ops::store(&tile[2][W], c21);
+			Ops::store(&tile[3][0], c30);
+			Ops::store(&tile[3][W], c31);
+			for (std::size_t r = 0; r < m; ++r)
+				for (std::size_t c = 0; c < n; ++c)
+					C[r * ldc + c] += alpha * tile[r][c];
+		}
+	}
+
+	template <class Ops>
+	void gemm(bool transA, bool transB, std::size_t M, std::size_t N, std::size_t K,
+		typename Ops::T alpha, const typename Ops::T* A, std::size_t lda,
+		const typename Ops::T* B, std::size_t ldb,
+		typename Ops::T beta, typename Ops::T* C, std::size_t ldc, typename Ops::T* pack)
+	{
+		using T = typename Ops::T;
+		using namespace gemmDetail;
+		constexpr std::size_t NR = nr<Ops>();
+		static_assert(kGemmMC % MR == 0 && kGemmNC % NR == 0, "gemm blocks must hold whole tiles");
+
+		// C = beta * C first, the blocked loops below only accumulate
+		for (std::size_t i = 0; i < M; ++i) {
+			T* c = C + i * ldc;
+			if (beta == T(0)) {
+				for (std::size_t j = 0; j < N; ++j)
+					c[j] = T(0);
+			}
+			else if (beta != T(1)) {
+				for (std::size_t j = 0; j < N; ++j)
+					c[j] *= beta;
+			}
+		}
+		if (K == 0 || alpha == T(0))
+			return;
+
+		T* packedA = pack;
+		T* packedB = pack + kGemmMC * kGemmKC;
+		const bool directB = !transB && M <= kDirectBRows;
+
+		for (std::size_t jc = 0; jc < N; jc += kGemmNC) {
+			const std::size_t nc = (N - jc < kGemmNC) ? N - jc : kGemmNC;
+			for (std::size_t pc = 0; pc < K; pc += kGemmKC) {
+				const std::size_t kc = (K - pc < kGemmKC) ? K - pc : kGemmKC;
+				// With directB only a trailing partial panel is packed (zero-padded to NR)
+				const std::size_t packedFrom = directB ? nc - nc % NR : 0;
+				if (packedFrom < nc)
+					packB<T, NR>(transB, B, ldb, pc, jc + packedFrom, kc, nc - packedFrom, packedB + packedFrom * kc);
+
+				for (std::size_t ic = 0; ic < M; ic += kGemmMC) {
+					const std::size_t mc = (M - ic < kGemmMC) ? M - ic : kGemmMC;
+					packA(transA, A, lda, ic, pc, mc, kc, packedA);
+
+					for (std::size_t jr = 0; jr < nc; jr += NR) {
+						const std::size_t n = (nc - jr < NR) ? nc - jr : NR;
+						const bool direct = jr < packedFrom;
+						const T* Bp = direct ? B + pc * ldb + jc + jr : packedB + jr * kc;
+						const std::size_t ldbp = direct ? ldb : NR;
+						for (std::size_t ir = 0; ir < mc; ir += MR) {
+							const std::size_t m = (mc - ir < MR) ? mc - ir : MR;
+							microKernel<Ops>(kc, alpha, packedA + ir * kc, Bp, ldbp,
+								C + (ic + ir) * ldc + jc + jr, ldc, m, n);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// constexpr so that the tables are constant-initialized: building one must not run any
+	// code compiled for an instruction set the CPU may not have.
+	template <class Ops>
+	constexpr Table<typename Ops::T> makeTable()
+	{
+		return Table<typename Ops::T>{
+			&matVec<Ops>,
+			&addBias<Ops>,
+			&relu<Ops>,
+			&axpy<Ops>,
+			&sparseVecMat<Ops>,
+			&bscMatVec<Ops>,
+			&momentumStep<Ops>,
+			&adamStep<Ops>,
+			&scaleBytes<Ops>,
+			Ops::warpRow,
+			&gemm<Ops>,
+		};
+	}
+}
@@ -1,60 +1,268 @@
 #include "math.h"
+#include "kernels.h"
 #include <cmath>
 #include <algorithm>
 
 namespace math {
 
-	std::vector<double> matVecMultiply(const std::vector<std::vector<double>>& M, const std::vector<double>& v) {
-		const auto rows = M.size();
-		const auto cols = (rows > 0) ? M[0].size() : 0;
-
-		std::vector<double> res(rows, 0.0);
-		for (std::size_t i = 0; i < rows; i++)
-			for (std::size_t j = 0; j < cols; j++)
-				res[i] += M[i][j] * v[j];
+	const char* simdLevel() {
+		return kernels::active().name;
+	}
 
+	template <typename T>
+	std::vector<Scalar<T>> matVecMultiply(MatrixView<T> M, const std::vector<Scalar<T>>& v) {
+		std::vector<Scalar<T>> res(M.rows);
+		matVecMultiply(M, v.data(), res.data());
 		return res;
 	}
 
-	void addBias(std::vector<double>& output, const std::vector<double>& bias) {
-		for (std::size_t i = 0; i < output.size(); i++)
-			output[i] += bias[i];
+	template <typename T>
+	void matVecMultiply(MatrixView<T> M, const Scalar<T>* v, Scalar<T>* out) {
+		kernels::table<Scalar<T>>().matVec(M.data, M.rows, M.cols, M.stride, v, out);
+	}
+
+	template <typename T>
+	void addBias(std::vector<T>& output, const std::vector<T>& bias) {
+		addBias(output.data(), bias.data(), output.size());
+	}
+
+	template <typename T>
+	void addBias(T* output, const T* bias, std::size_t n) {
+		kernels::table<T>().addBias(output, bias, n);
+	}
+
+	template <typename T>
+	void reluInPlace(std::vector<T>& v) {
+		reluInPlace(v.data(), v.size());
+	}
+
+	template <typename T>
+	void reluInPlace(T* v, std::size_t n) {
+		kernels::table<T>().relu(v, n);
+	}
+
+	template <typename T>
+	void axpy(std::size_t n, T alpha, const T* x, T* y) {
+		kernels::table<T>().axpy(n, alpha, x, y);
+	}
+
+	template <typename T>
+	void sparsify(const T* x, std::size_t n, SparseVector<T>& out) {
+		// Branch-free: every entry is written, only the nonzeros advance the count
+		// (about one pixel in five is nonzero, in no predictable order)
+		out.index.resize(n);
+		out.value.resize(n);
+		out.size = n;
+		std::size_t count = 0;
+		for (std::size_t i = 0; i < n; ++i) {
+			out.index[count] = static_cast<std::uint32_t>(i);
+			out.value[count] = x[i];
+			count += x[i] != T(0);
+		}
+		out.index.resize(count);
+		out.value.resize(count);
+	}
+
+	template <typename T>
+	void sparseVecMat(const SparseVector<Scalar<T>>& x, MatrixView<T> M, Scalar<T>* out) {
+		kernels::table<Scalar<T>>().sparseVecMat(M.data, M.cols, M.stride,
+			x.index.data(), x.value.data(), x.nonzeros(), out);
+	}
+
+	template <typename T>
+	void bscMatVec(const BscView<T>& M, const SparseVector<T>& x, T* out) {
+		kernels::table<T>().bscMatVec(M.values, M.colStart, M.blockRow, M.paddedRows(), M.R, M.C,
+			x.index.data(), x.value.data(), x.nonzeros(), out);
+	}
+
+	template <typename T>
+	void momentumStep(std::size_t n, T rate, T mu, bool nesterov, const T* g, T* v, T* p) {
+		kernels::table<T>().momentumStep(n, rate, mu, nesterov, g, v, p);
+	}
+
+	template <typename T>
+	void adamStep(std::size_t n, T rate, T beta1, T beta2, T eps, const T* g, T* m, T* v, T* p) {
+		kernels::table<T>().adamStep(n, rate, beta1, beta2, eps, g, m, v, p);
+	}
+
+	template <typename T>
+	void scaleBytes(const std::uint8_t* src, std::size_t n, T scale, T* dst) {
+		kernels::table<T>().scaleBytes(src, n, scale, dst);
+	}
+
+	template <typename T>
+	void warpRow(const T* src, std::size_t rows, std::size_t cols,
+		float x0, float y0, float dx, float dy, std::size_t n, bool bilinear, T fill, T* dst) {
+		kernels::table<T>().warpRow(src, rows, cols, x0, y0, dx, dy, n, bilinear, fill, dst);
+	}
+
+	void matVecMultiply(MatrixView<const std::int8_t> M, const std::int8_t* v, std::int32_t* out) {
+		kernels::active().matVecI8(M.data, M.rows, M.cols, M.stride, v, out);
+	}
+
+	template <typename T>
+	void gemm(bool transA, bool transB, std::size_t M, std::size_t N, std::size_t K,
+		T alpha, const T* A, std::size_t lda, const T* B, std::size_t ldb,
+		T beta, T* C, std::size_t ldc) {
+		// packing scratch, one per thread so concurrent callers don't share it
+		thread_local AlignedVector<T> pack(kernels::kGemmPackSize);
+		kernels::table<T>().gemm(transA, transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc, pack.data());
 	}
 
-	void reluInPlace(std::vector<double>& v) {
-		for (auto& val : v)
-			if (val < 0.0)
-				val = 0.0;
+	template <typename T>
+	void im2col(const T* image, std::size_t height, std::size_t width, std::size_t channels,
+		std::size_t kernel, std::size_t pad, T* cols, std::size_t colStride) {
+		const std::size_t outH = height + 2 * pad - kernel + 1;
+		const std::size_t outW = width + 2 * pad - kernel + 1;
+
+		for (std::size_t c = 0; c < channels; ++c) {
+			for (std::size_t ky = 0; ky < kernel; ++ky) {
+				for (std::size_t kx = 0; kx < kernel; ++kx) {
+					T* row = cols + ((c * kernel + ky) * kernel + kx) * colStride;
+					// output columns whose input column ox + kx - pad is inside the image (none when
+					// the tap lies right of the image, e.g. a wide kernel over a narrow map)
+					const std::size_t x0 = pad > kx ? std::min(pad - kx, outW) : 0;
+					const std::size_t x1 = kx >= width + pad ? x0 : std::max(x0, std::min(outW, width + pad - kx));
+					for (std::size_t oy = 0; oy < outH; ++oy) {
+						T* dst = row + oy * outW;
+						const std::size_t iy = oy + ky; // + pad
+						if (iy < pad || iy >= height + pad) {
+							std::fill(dst, dst + outW, T(0));
+							continue;
+						}
+						// rows are short: plain loops beat copy / fill calls
+						const T* src = image + (c * height + iy - pad) * width;
+						for (std::size_t ox = 0; ox < x0; ++ox)
+							dst[ox] = T(0);
+						for (std::size_t ox = x0; ox < x1; ++ox)
+							dst[ox] = src[ox + kx - pad];
+						for (std::size_t ox = x1; ox < outW; ++ox)
+							dst[ox] = T(0);
+					}
+				}
+			}
+		}
 	}
 
-	std::vector<double> relu(const std::vector<double>& v) {
-		std::vector<double> res(v.size());
+	template <typename T>
+	void col2im(const T* cols, std::size_t colStride, std::size_t height, std::size_t width,
+		std::size_t channels, std::size_t kernel, std::size_t pad, T* image) {
+		const std::size_t outH = height + 2 * pad - kernel + 1;
+		const std::size_t outW = width + 2 * pad - kernel + 1;
+
+		for (std::size_t c = 0; c < channels; ++c) {
+			for (std::size_t ky = 0; ky < kernel; ++ky) {
+				for (std::size_t kx = 0; kx < kernel; ++kx) {
+					const T* row = cols + ((c * kernel + ky) * kernel + kx) * colStride;
+					const std::size_t x0 = pad > kx ? std::min(pad - kx, outW) : 0;
+					const std::size_t x1 = kx >= width + pad ? x0 : std::max(x0, std::min(outW, width + pad - kx));
+					for (std::size_t oy = 0; oy < outH; ++oy) {
+						const std::size_t iy = oy + ky;
+						if (iy < pad || iy >= height + pad)
+							continue;
+						const T* src = row + oy * outW;
+						T* dst = image + (c * height + iy - pad) * width;
+						for (std::size_t ox = x0; ox < x1; ++ox)
+							dst[ox + kx - pad] += src[ox];
+					}
+				}
+			}
+		}
+	}
+
+	template <typename T>
+	void maxPool(const T* image, std::size_t height, std::size_t width, std::size_t channels,
+		std::size_t kernel, T* out) {
+		const std::size_t outH = height / kernel, outW = width / kernel;
+		for (std::size_t c = 0; c < channels; ++c) {
+			for (std::size_t oy = 0; oy < outH; ++oy) {
+				T* o = out + (c * outH + oy) * outW;
+				const T* first = image + (c * height + oy * kernel) * width;
+				if (kernel == 2) {
+					// the usual case, as independent maxima the compiler can vectorize
+					const T* next = first + width;
+					for (std::size_t ox = 0; ox < outW; ++ox) {
+						const T top = std::max(first[2 * ox], first[2 * ox + 1]);
+						const T bottom = std::max(next[2 * ox], next[2 * ox + 1]);
+						o[ox] = std::max(top, bottom);
+					}
+					continue;
+				}
+				for (std::size_t ox = 0; ox < outW; ++ox) {
+					const T* window = first + ox * kernel;
+					T m = window[0];
+					for (std::size_t ky = 0; ky < kernel; ++ky) {
+						for (std::size_t kx = 0; kx < kernel; ++kx)
+							m = window[ky * width + kx] > m ? window[ky * width + kx] : m;
+					}
+					o[ox] = m;
+				}
+			}
+		}
+	}
+
+	template <typename T>
+	void maxPoolBackward(const T* image, const T* out, const T* dOut, std::size_t height,
+		std::size_t width, std::size_t channels, std::size_t kernel, T* dImage) {
+		const std::size_t outH = height / kernel, outW = width / kernel;
+		std::fill(dImage, dImage + channels * height * width, T(0));
+		for (std::size_t c = 0; c < channels; ++c) {
+			for (std::size_t oy = 0; oy < outH; ++oy) {
+				for (std::size_t ox = 0; ox < outW; ++ox) {
+					const std::size_t o = (c * outH + oy) * outW + ox;
+					const std::size_t first = (c * height + oy * kernel) * width + ox * kernel;
+					bool routed = false;
+					for (std::size_t ky = 0; ky < kernel && !routed; ++ky) {
+						for (std::size_t kx = 0; kx < kernel && !routed; ++kx) {
+							const std::size_t i = first + ky * width + kx;
+							if (image[i] == out[o]) {
+								dImage[i] = dOut[o];
+								routed = true;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	template <typename T>
+	std::vector<T> relu(const std::vector<T>& v) {
+		std::vector<T> res(v.size());
 
 		for (std::size_t i = 0; i < v.size(); i++)
-			res[i] = (v[i] < 0.0) ? 0.0 : v[i];
+			res[i] = (v[i] < T(0)) ? T(0) : v[i];
 
 		return res;
 	}
 
-	std::vector<double> sigmoid(const std::vector<double>& v) {
-		std::vector<double> res(v.size());
+	template <typename T>
+	std::vector<T> sigmoid(const std::vector<T>& v) {
+		std::vector<T> res(v.size());
 
 		for (std::size_t i = 0; i < v.size(); i++)
-			res[i] = 1.0 / (1.0 + std::exp(-v[i]));
+			res[i] = T(1) / (T(1) + std::exp(-v[i]));
 
 		return res;
 	}
 
-	void sigmoidInPlace(std::vector<double>& v) {
-		for (auto& val : v)
-			val = 1.0 / (1.0 + std::exp(-val));
+	template <typename T>
+	void sigmoidInPlace(std::vector<T>& v) {
+		sigmoidInPlace(v.data(), v.size());
+	}
+
+	template <typename T>
+	void sigmoidInPlace(T* v, std::size_t n) {
+		for (std::size_t i = 0; i < n; ++i)
+			v[i] = T(1) / (T(1) + std::exp(-v[i]));
 	}
 
-	std::vector<double> softmax(const std::vector<double>& logits) {
-		std::vector<double> result(logits.size());
-		double maxVal = *std::max_element(logits.begin(), logits.end());
+	template <typename T>
+	std::vector<T> softmax(const std::vector<T>& logits) {
+		std::vector<T> result(logits.size());
+		T maxVal = *std::max_element(logits.begin(), logits.end());
 
-		double sumExp = 0.0;
+		T sumExp = 0;
 		for (auto val : logits)
 			sumExp += std::exp(val - maxVal);
 
@@ -64,21 +272,102 @@ namespace math {
 		return result;
 	}
 
-	double crossEntropy(const std::vector<double>& prediction, const std::vector<double>& target) {
-		double loss = 0.0;
+	template <typename T>
+	void softmaxInPlace(T* logits, std::size_t n) {
+		T maxVal = *std::max_element(logits, logits + n);
+
+		T sumExp = 0;
+		for (std::size_t i = 0; i < n; ++i) {
+			logits[i] = std::exp(logits[i] - maxVal);
+			sumExp += logits[i];
+		}
+
+		for (std::size_t i = 0; i < n; ++i)
+			logits[i] /= sumExp;
+	}
+
+	template <typename T>
+	T softmaxCrossEntropy(const T* logits, std::size_t n, int label, T gradScale, T* grad, int* predicted) {
+		std::size_t best = 0;
+		for (std::size_t i = 1; i < n; ++i) {
+			if (logits[i] > logits[best])
+				best = i;
+		}
+		const T maxVal = logits[best];
+		const T labelLogit = logits[label]; // grad may overwrite the logits
+
+		T sumExp = 0;
+		for (std::size_t i = 0; i < n; ++i) {
+			grad[i] = std::exp(logits[i] - maxVal);
+			sumExp += grad[i];
+		}
+
+		const T scale = gradScale / sumExp;
+		for (std::size_t i = 0; i < n; ++i)
+			grad[i] *= scale;
+		grad[label] -= gradScale;
+
+		if (predicted)
+			*predicted = static_cast<int>(best);
+		// log(sum exp(z - max)) - (z[label] - max), without forming a probability that could underflow
+		return std::log(sumExp) - (labelLogit - maxVal);
+	}
+
+	template <typename T>
+	T crossEntropy(const std::vector<T>& prediction, const std::vector<T>& target) {
+		T loss = 0;
 		for (std::size_t i = 0; i < prediction.size(); ++i) {
-			double p = std::max(prediction[i], 1e-15); // prevent log(0)
+			T p = std::max(prediction[i], T(1e-15)); // prevent log(0)
 			loss -= target[i] * std::log(p);
 		}
 		return loss;
 	}
 
-	double meanSquaredError(const std::vector<double>& prediction, const std::vector<double>& target) {
-		double sum = 0.0;
+	template <typename T>
+	T meanSquaredError(const std::vector<T>& prediction, const std::vector<T>& target) {
+		T sum = 0;
 		for (std::size_t i = 0; i < prediction.size(); ++i) {
-			double diff = prediction[i] - target[i];
+			T diff = prediction[i] - target[i];
 			sum += diff * diff;
 		}
 		return sum / prediction.size();
 	}
+
+#define MATH_INSTANTIATE_VIEW(V) \
+	template std::vector<Scalar<V>> matVecMultiply(MatrixView<V>, const std::vector<Scalar<V>>&); \
+	template void matVecMultiply(MatrixView<V>, const Scalar<V>*, Scalar<V>*); \
+	template void sparseVecMat(const SparseVector<Scalar<V>>&, MatrixView<V>, Scalar<V>*);
+
+#define MATH_INSTANTIATE(T) \
+	MATH_INSTANTIATE_VIEW(T) \
+	MATH_INSTANTIATE_VIEW(const T) \
+	template void addBias(std::vector<T>&, const std::vector<T>&); \
+	template void addBias(T*, const T*, std::size_t); \
+	template void reluInPlace(std::vector<T>&); \
+	template void reluInPlace(T*, std::size_t); \
+	template void axpy(std::size_t, T, const T*, T*); \
+	template void bscMatVec(const BscView<T>&, const SparseVector<T>&, T*); \
+	template void sparsify(const T*, std::size_t, SparseVector<T>&); \
+	template void momentumStep(std::size_t, T, T, bool, const T*, T*, T*); \
+	template void adamStep(std::size_t, T, T, T, T, const T*, T*, T*, T*); \
+	template void scaleBytes(const std::uint8_t*, std::size_t, T, T*); \
+	template void warpRow(const T*, std::size_t, std::size_t, float, float, float, float, std::size_t, bool, T, T*); \
+	template void gemm(bool, bool, std::size_t, std::size_t, std::size_t, T, const T*, std::size_t, \
+		const T*, std::size_t, T, T*, std::size_t); \
+	template void im2col(const T*, std::size_t, std::size_t, std::size_t, std::size_t, std::size_t, T*, std::size_t); \
+	template void col2im(const T*, std::size_t, std::size_t, std::size_t, std::size_t, std::size_t, std::size_t, T*); \
+	template void maxPool(const T*, std::size_t, std::size_t, std::size_t, std::size_t, T*); \
+	template void maxPoolBackward(const T*, const T*, const T*, std::size_t, std::size_t, std::size_t, std::size_t, T*); \
+	template std::vector<T> relu(const std::vector<T>&); \
+	template std::vector<T> sigmoid(const std::vector<T>&); \
+	template void sigmoidInPlace(std::vector<T>&); \
+	template void sigmoidInPlace(T*, std::size_t); \
+	template std::vector<T> softmax(const std::vector<T>&); \
+	template void softmaxInPlace(T*, std::size_t); \
+	template T softmaxCrossEntropy(const T*, std::size_t, int, T, T*, int*); \
+	template T crossEntropy(const std::vector<T>&, const std::vector<T>&); \
+	template T meanSquaredError(const std::vector<T>&, const std::vector<T>&);
+
+	MATH_INSTANTIATE(float)
+	MATH_INSTANTIATE(double)
 }
@@ -1,14 +1,229 @@
 #pragma once
 #include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
 
 namespace math {
-	std::vector<double> matVecMultiply(const std::vector<std::vector<double>>& M, const std::vector<double>& v);
-	void addBias(std::vector<double>& output, const std::vector<double>& bias);
-	void reluInPlace(std::vector<double>& v);
-	std::vector<double> relu(const std::vector<double>& v);
-	std::vector<double> sigmoid(const std::vector<double>& v);
-	void sigmoidInPlace(std::vector<double>& v);
-	std::vector<double> softmax(const std::vector<double>& logits);
-	double crossEntropy(const std::vector<double>& prediction, const std::vector<double>& target);
-	double meanSquaredError(const std::vector<double>& prediction, const std::vector<double>& target);
+	// Every weight buffer (and every weight row) starts on a cache-line boundary,
+	// which is also the width of one AVX-512 register.
+	constexpr std::size_t kAlignment = 64;
+
+	template <typename T>
+	struct AlignedAllocator {
+		using value_type = T;
+
+		AlignedAllocator() noexcept = default;
+		template <typename U>
+		AlignedAllocator(const AlignedAllocator<U>&) noexcept {}
+
+		T* allocate(std::size_t n) {
+			return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(kAlignment)));
+		}
+		void deallocate(T* p, std::size_t) noexcept {
+			::operator delete(p, std::align_val_t(kAlignment));
+		}
+
+		template <typename U>
+		bool operator==(const AlignedAllocator<U>&) const noexcept { return true; }
+		template <typename U>
+		bool operator!=(const AlignedAllocator<U>&) const noexcept { return false; }
+	};
+
+	template <typename T>
+	using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+	// Number of elements a row of `cols` values is padded to so the next row stays aligned.
+	template <typename T>
+	constexpr std::size_t alignedStride(std::size_t cols) {
+		constexpr std::size_t perLine = kAlignment / sizeof(T);
+		return (cols + perLine - 1) / perLine * perLine;
+	}
+
+	/*
+
+	 Non-owning row-major view over a flat buffer.
+	 stride is the distance between two rows in elements (>= cols).
+
+	*/
+	template <typename T>
+	struct MatrixView {
+		T* data = nullptr;
+		std::size_t rows = 0;
+		std::size_t cols = 0;
+		std::size_t stride = 0;
+
+		T* row(std::size_t i) const { return data + i * stride; }
+		T& operator()(std::size_t i, std::size_t j) const { return data[i * stride + j]; }
+		operator MatrixView<const T>() const { return { data, rows, cols, stride }; }
+	};
+
+	template <typename T>
+	using Scalar = std::remove_const_t<T>;
+
+	// Name of the instruction set picked at runtime for the kernels below ("avx512", "avx2" or "generic").
+	const char* simdLevel();
+
+	// Everything below is implemented for T = float and T = double.
+	// Functions taking a MatrixView accept views of const and non-const data.
+
+	template <typename T>
+	std::vector<Scalar<T>> matVecMultiply(MatrixView<T> M, const std::vector<Scalar<T>>& v);
+	template <typename T>
+	void matVecMultiply(MatrixView<T> M, const Scalar<T>* v, Scalar<T>* out);
+	template <typename T>
+	void addBias(std::vector<T>& output, const std::vector<T>& bias);
+	template <typename T>
+	void addBias(T* output, const T* bias, std::size_t n);
+	template <typename T>
+	void reluInPlace(std::vector<T>& v);
+	template <typename T>
+	void reluInPlace(T* v, std::size_t n);
+	// y += alpha * x
+	template <typename T>
+	void axpy(std::size_t n, T alpha, const T* x, T* y);
+
+	/*
+
+	 The nonzero entries of a dense vector of `size` values, as parallel index / value
+	 arrays. Most MNIST pixels are exactly zero, so a layer fed with one only needs the
+	 weights of the few inputs that are not.
+
+	*/
+	template <typename T>
+	struct SparseVector {
+		std::vector<std::uint32_t> index;
+		std::vector<T> value;
+		std::size_t size = 0;
+
+		std::size_t nonzeros() const { return index.size(); }
+	};
+
+	// Collect the nonzeros of x[0..n) into out (keeps out's capacity: no allocation once it fits)
+	template <typename T>
+	void sparsify(const T* x, std::size_t n, SparseVector<T>& out);
+
+	// out = x^T * M for a sparse x of M.rows entries: the sum of the rows of M selected by
+	// x's nonzeros, scaled by them (out has M.cols values). Rows must be 64-byte aligned.
+	template <typename T>
+	void sparseVecMat(const SparseVector<Scalar<T>>& x, MatrixView<T> M, Scalar<T>* out);
+
+	/*
+
+	 Non-owning view of a block-sparse rows x cols matrix, compressed by block column
+	 (BSR of its transpose, the input-major layout BasicModel keeps W1 in). The columns
+	 are split into block columns of C; each lists its stored R x C blocks, block k
+	 covering rows blockRow[k] .. blockRow[k] + R - 1 (a multiple of R). A block holds
+	 C runs of R values, one run per column. 1 x 1 blocks are plain CSC.
+
+	*/
+	template <typename T>
+	struct BscView {
+		const T* values = nullptr;               // blocks * R * C
+		const std::uint32_t* colStart = nullptr; // blockCols() + 1 offsets into blockRow
+		const std::uint32_t* blockRow = nullptr;
+		std::size_t rows = 0;
+		std::size_t cols = 0;
+		std::size_t R = 1;
+		std::size_t C = 1;
+
+		std::size_t blockCols() const { return (cols + C - 1) / C; }
+		std::size_t paddedRows() const { return (rows + R - 1) / R * R; }
+	};
+
+	// out = M * x for a sparse x of M.cols entries, reading only the blocks of x's nonzero
+	// columns. out has room for M.paddedRows() values (the padding rows come out zero).
+	template <typename T>
+	void bscMatVec(const BscView<T>& M, const SparseVector<T>& x, T* out);
+
+	// Fused optimizer updates of n parameters p from gradients g, one pass over p and
+	// the state (see Optimizer). Momentum: v = mu * v + g, p -= rate * v, or
+	// p -= rate * (g + mu * v) for Nesterov.
+	template <typename T>
+	void momentumStep(std::size_t n, T rate, T mu, bool nesterov, const T* g, T* v, T* p);
+	// Adam: m and v are the moment estimates; rate and eps carry the bias correction
+	template <typename T>
+	void adamStep(std::size_t n, T rate, T beta1, T beta2, T eps, const T* g, T* m, T* v, T* p);
+
+	// dst[i] = src[i] * scale, e.g. 8-bit pixels to [0..1] with scale = 1/255
+	template <typename T>
+	void scaleBytes(const std::uint8_t* src, std::size_t n, T scale, T* dst);
+
+	// One output row of an image warp: dst[j] = image sampled at (col, row) = (x0 + j*dx, y0 + j*dy),
+	// nearest-neighbour or bilinear, fill outside the rows x cols image (see utils::warpImages)
+	template <typename T>
+	void warpRow(const T* src, std::size_t rows, std::size_t cols,
+		float x0, float y0, float dx, float dy, std::size_t n, bool bilinear, T fill, T* dst);
+
+	// out[i] = dot(M row i, v) on int8 data with int32 accumulation (quantized inference)
+	void matVecMultiply(MatrixView<const std::int8_t> M, const std::int8_t* v, std::int32_t* out);
+
+	/*
+
+	 General matrix multiply, C = alpha * op(A) * op(B) + beta * C
+	 All matrices are row-major with leading dimensions lda/ldb/ldc (in elements);
+	 op(X) is X^T when transX is set. op(A) is M x K, op(B) is K x N, C is M x N.
+	 Cache-blocked and register-tiled; safe to call from several threads at once.
+
+	*/
+	template <typename T>
+	void gemm(bool transA, bool transB, std::size_t M, std::size_t N, std::size_t K,
+		T alpha, const T* A, std::size_t lda, const T* B, std::size_t ldb,
+		T beta, T* C, std::size_t ldc);
+
+	/*
+
+	 Convolution helpers on channels x height x width images, stride 1.
+	 im2col unrolls the image into a (channels * kernel * kernel) x (outH * outW) matrix,
+	 rows colStride apart: row (c, ky, kx) holds the input pixel under that filter tap
+	 for every output position, 0 where it falls into the zero padding of width pad.
+	 A convolution is then one gemm, filters x taps times taps x positions.
+	 col2im is the adjoint: it adds such a matrix back into an image.
+
+	*/
+	template <typename T>
+	void im2col(const T* image, std::size_t height, std::size_t width, std::size_t channels,
+		std::size_t kernel, std::size_t pad, T* cols, std::size_t colStride);
+	template <typename T>
+	void col2im(const T* cols, std::size_t colStride, std::size_t height, std::size_t width,
+		std::size_t channels, std::size_t kernel, std::size_t pad, T* image);
+
+	// Max over kernel x kernel windows with stride kernel, per channel (trailing rows and
+	// columns that don't fill a window are dropped). The backward pass overwrites dImage and
+	// routes each output gradient to the first maximum of its window.
+	template <typename T>
+	void maxPool(const T* image, std::size_t height, std::size_t width, std::size_t channels,
+		std::size_t kernel, T* out);
+	template <typename T>
+	void maxPoolBackward(const T* image, const T* out, const T* dOut, std::size_t height,
+		std::size_t width, std::size_t channels, std::size_t kernel, T* dImage);
+
+	template <typename T>
+	std::vector<T> relu(const std::vector<T>& v);
+	template <typename T>
+	std::vector<T> sigmoid(const std::vector<T>& v);
+	template <typename T>
+	void sigmoidInPlace(std::vector<T>& v);
+	template <typename T>
+	void sigmoidInPlace(T* v, std::size_t n);
+	template <typename T>
+	std::vector<T> softmax(const std::vector<T>& logits);
+	template <typename T>
+	void softmaxInPlace(T* logits, std::size_t n);
+
+	/*
+
+	 Softmax + cross-entropy against an integer label, and its gradient, in one go:
+	 grad = (softmax(logits) - onehot(label)) * gradScale, returns -log softmax(logits)[label].
+	 grad may be logits itself. predicted, if given, receives the arg max of the logits.
+
+	*/
+	template <typename T>
+	T softmaxCrossEntropy(const T* logits, std::size_t n, int label, T gradScale, T* grad,
+		int* predicted = nullptr);
+	template <typename T>
+	T crossEntropy(const std::vector<T>& prediction, const std::vector<T>& target);
+	template <typename T>
+	T meanSquaredError(const std::vector<T>& prediction, const std::vector<T>& target);
 }
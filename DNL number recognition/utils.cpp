@@ -1,5 +1,7 @@
 #include "utils.h"
 
+#include <array>
+
 double utils::randomWeight(double range)
 {
     static std::mt19937 rng{ std::random_device{}() };
@@ -7,17 +9,44 @@ double utils::randomWeight(double range)
     return dist(rng);
 }
 
-double utils::getPixel(const std::vector<double>& img, int row, int col)
+namespace {
+    constexpr auto kCrcTable = [] {
+        std::array<std::uint32_t, 256> table{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }();
+}
+
+std::uint32_t utils::crc32(const void* data, std::size_t size, std::uint32_t crc)
+{
+    const auto* bytes = static_cast<const std::uint8_t*>(data);
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc = kCrcTable[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+template <typename T>
+T utils::getPixel(const std::vector<T>& img, int row, int col)
 {
     return img[row * 28 + col];
 }
 
-void utils::setPixel(std::vector<double>& img, int row, int col, double value)
+template <typename T>
+void utils::setPixel(std::vector<T>& img, int row, int col, T value)
 {
     img[row * 28 + col] = value;
 }
 
-double utils::sampleNearest(const std::vector<double>& img, float row, float col)
+template <typename T>
+T utils::sampleNearest(const std::vector<T>& img, float row, float col)
 {
     int r = static_cast<int>(std::round(row));
     int c = static_cast<int>(std::round(col));
@@ -25,72 +54,86 @@ double utils::sampleNearest(const std::vector<double>& img, float row, float col
     // If out of bounds, return an invalid marker or handle externally
     if (r < 0 || r >= 28 || c < 0 || c >= 28) {
         // We'll handle out-of-bounds in the main loop by fillValue
-        return -1.0;
+        return T(-1);
     }
 
     return getPixel(img, r, c);
 }
 
-std::vector<double> utils::augmentImage(const std::vector<double>& input,
+template <typename T>
+std::vector<T> utils::augmentImage(const std::vector<T>& input,
     double angleDegrees,
     double scaleFactor,
     int translateX,
     int translateY,
-    double fillValue)
+    T fillValue)
 {
     // We'll produce a new 28x28
-    std::vector<double> output(28 * 28, fillValue);
+    std::vector<T> output(28 * 28, fillValue);
+    const T* src = input.data();
+    Affine transform = augmentTransform(angleDegrees, scaleFactor, translateX, translateY);
+    warpImages(&src, &transform, 1, 28, 28, output.data(), Sampling::Nearest, fillValue);
+    return output;
+}
 
+utils::Affine utils::augmentTransform(double angleDegrees, double scaleFactor, int translateX, int translateY, int rows, int cols)
+{
     // Convert angle to radians, but note for inverse we can just use -angle
     static const auto PI = 3.14159265358979323846;
     double angleRad = angleDegrees * PI / 180.0;
-    double cosA = std::cos(-angleRad);
-    double sinA = std::sin(-angleRad);
+    double cosA = std::cos(-angleRad) / scaleFactor;
+    double sinA = std::sin(-angleRad) / scaleFactor;
 
     // Center of image
-    double cx = 13.5;
-    double cy = 13.5;
+    double cx = (cols - 1) / 2.0;
+    double cy = (rows - 1) / 2.0;
 
-    // For each output pixel (r_out, c_out), we do an inverse transform:
+    // For each output pixel (r_out, c_out) the inverse transform is:
     // 1) Translate by (-translateX, -translateY)
     // 2) Move center to (0,0)
     // 3) Scale by (1/scaleFactor)
     // 4) Rotate by (-angle)
     // 5) Move center back
-    for (int r_out = 0; r_out < 28; ++r_out) {
-        for (int c_out = 0; c_out < 28; ++c_out) {
-            // Shift by translateX, translateY
-            double x = c_out - translateX;
-            double y = r_out - translateY;
-
-            // Move center to 0,0
-            x -= cx;
-            y -= cy;
-
-            // Apply scale
-            x /= scaleFactor;
-            y /= scaleFactor;
-
-            // Apply rotation (inverse)
-            double x_rot = x * cosA - y * sinA;
-            double y_rot = x * sinA + y * cosA;
-
-            // Move center back
-            x_rot += cx;
-            y_rot += cy;
-
-            // Sample from input
-            double val = sampleNearest(input, y_rot, x_rot); // note: row ~ y, col ~ x
-
-            // If out of bounds, we do fillValue
-            if (val < 0.0) {
-                output[r_out * 28 + c_out] = fillValue;
-            }
-            else {
-                output[r_out * 28 + c_out] = val;
-            }
+    // which is linear in (c_out, r_out):
+    double x = -translateX - cx;
+    double y = -translateY - cy;
+
+    Affine a;
+    a.xx = static_cast<float>(cosA);
+    a.xy = static_cast<float>(-sinA);
+    a.x0 = static_cast<float>(x * cosA - y * sinA + cx);
+    a.yx = static_cast<float>(sinA);
+    a.yy = static_cast<float>(cosA);
+    a.y0 = static_cast<float>(x * sinA + y * cosA + cy);
+    return a;
+}
+
+template <typename T>
+void utils::warpImages(const T* const* images, const Affine* transforms, std::size_t count,
+    std::size_t rows, std::size_t cols, T* out, Sampling sampling, T fillValue)
+{
+    const bool bilinear = sampling == Sampling::Bilinear;
+    for (std::size_t i = 0; i < count; ++i) {
+        const Affine& a = transforms[i];
+        T* dst = out + i * rows * cols;
+
+        // The source position of column 0 moves by (xy, yy) from one output row to the next,
+        // and by (xx, yx) along a row inside the kernel
+        float x0 = a.x0, y0 = a.y0;
+        for (std::size_t r = 0; r < rows; ++r) {
+            math::warpRow(images[i], rows, cols, x0, y0, a.xx, a.yx, cols, bilinear, fillValue, dst + r * cols);
+            x0 += a.xy;
+            y0 += a.yy;
         }
     }
-
-    return output;
 }
+
+#define UTILS_INSTANTIATE(T) \
+    template T utils::getPixel(const std::vector<T>&, int, int); \
+    template void utils::setPixel(std::vector<T>&, int, int, T); \
+    template T utils::sampleNearest(const std::vector<T>&, float, float); \
+    template std::vector<T> utils::augmentImage(const std::vector<T>&, double, double, int, int, T); \
+    template void utils::warpImages(const T* const*, const Affine*, std::size_t, std::size_t, std::size_t, T*, Sampling, T);
+
+UTILS_INSTANTIATE(float)
+UTILS_INSTANTIATE(double)
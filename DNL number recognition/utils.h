@@ -5,12 +5,23 @@
 #include <cmath>
 #include <algorithm>
 #include <stdexcept>
+#include <cstdint>
+
+#include "math.h"
 
 namespace utils {
 	double randomWeight(double range = 0.01);
-	double getPixel(const std::vector<double>& img, int row, int col);
-	void setPixel(std::vector<double>& img, int row, int col, double value);
-	double sampleNearest(const std::vector<double>& img, float row, float col);
+
+	// CRC-32 (IEEE, as in zip/png); pass the previous result as crc to continue a running checksum
+	std::uint32_t crc32(const void* data, std::size_t size, std::uint32_t crc = 0);
+
+	// Image helpers below work on 28x28 images of float or double pixels
+	template <typename T>
+	T getPixel(const std::vector<T>& img, int row, int col);
+	template <typename T>
+	void setPixel(std::vector<T>& img, int row, int col, T value);
+	template <typename T>
+	T sampleNearest(const std::vector<T>& img, float row, float col);
 
 	/*
 	
@@ -20,10 +31,40 @@ namespace utils {
      fillValue:    e.g., 0.0 for background
 	
 	*/
-	std::vector<double> augmentImage(const std::vector<double>& input,
+	template <typename T>
+	std::vector<T> augmentImage(const std::vector<T>& input,
 		double angleDegrees,
 		double scaleFactor,
 		int translateX,
 		int translateY,
-		double fillValue = 0.0);
+		T fillValue = T(0));
+
+	/*
+
+	 Inverse map of a warp: output pixel (row r, col c) is sampled from the
+	 source at col = xx * c + xy * r + x0, row = yx * c + yy * r + y0.
+
+	*/
+	struct Affine {
+		float xx, xy, x0;
+		float yx, yy, y0;
+	};
+
+	// The transform augmentImage applies: rotation and scale about the image centre, then a shift
+	Affine augmentTransform(double angleDegrees, double scaleFactor, int translateX, int translateY,
+		int rows = 28, int cols = 28);
+
+	enum class Sampling { Nearest, Bilinear };
+
+	/*
+
+	 Warp count images of rows x cols pixels, image i through transforms[i], into
+	 out[i * rows * cols ...] (preallocated). Output rows are walked incrementally
+	 and sampled with the SIMD row kernel; pixels mapping outside the source get fillValue.
+
+	*/
+	template <typename T>
+	void warpImages(const T* const* images, const Affine* transforms, std::size_t count,
+		std::size_t rows, std::size_t cols, T* out,
+		Sampling sampling = Sampling::Nearest, T fillValue = T(0));
 }
\ No newline at end of file